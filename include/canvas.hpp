@@ -1,10 +1,24 @@
 #include <wx/wx.h>
 
 #include <chrono>
+#include <future>
 #include <set>
-
-#include "../third_party/miniaudio.h"
+#include <unordered_map>
+
+#include "chart_snapshot.hpp"
+#include "counting_dc.hpp"
+#include "display_list_dc.hpp"
+#include "frame_stats.hpp"
+#include "label_cache.hpp"
+#include "live_preview.hpp"
 #include "notechart.hpp"
+#include "onset.hpp"
+#include "playback.hpp"
+#include "raster.hpp"
+#include "spectrogram.hpp"
+#include "tempo_detect.hpp"
+#include "tempo_map.hpp"
+#include "thread_pool.hpp"
 
 enum Mode { MODE_POINTER, MODE_CREATE };
 const std::vector<std::string> ModeStr{"MODE_POINTER", "MODE_CREATE"};
@@ -17,6 +31,56 @@ class Canvas : public wxPanel {
     void paintNow();
     void render(wxDC &dc);
     void update_frame(wxDC &dc, double delta_time);
+    void update_highlight(wxCoord height, int current_tick);
+    void update_tempo_detection();
+    void update_tempo_map();
+    void update_snapshot();
+    void update_autosave();
+    void update_live_preview();
+    void update_ghost_notes();
+    void update_spectrogram(wxCoord height, int current_tick);
+    void update_overview(wxCoord height);
+    void update_lane_filter();
+    bool is_note_shown(const Note &note);
+    void update_layers(wxCoord width, wxCoord height, int current_tick);
+    void update_software(CountingDC &dc, wxCoord width, wxCoord height,
+                         int current_tick);
+    void draw_content(CountingDC &dc, wxDC &background_dc, wxCoord width,
+                      wxCoord height, int current_tick, int y_min, int y_max);
+
+    // Shared by the wxDC and the software backend; DC is CountingDC or
+    // DisplayListDC
+    template <typename DC>
+    void draw_background(DC &dc, wxCoord width, wxCoord height);
+    template <typename DC>
+    void draw_grid(DC &dc, wxCoord width, wxCoord height, int current_tick,
+                   int y_min, int y_max);
+    template <typename DC>
+    void draw_connectors(DC &dc, wxCoord height, int current_tick, int y_min,
+                         int y_max);
+    template <typename DC>
+    void draw_notes(DC &dc, wxCoord height, int current_tick, int y_min,
+                    int y_max);
+    template <typename DC>
+    void draw_spectrogram(DC &dc, wxCoord height, int current_tick, int y_min,
+                          int y_max);
+    void draw_spectrogram_tile(CountingDC &dc,
+                               const std::shared_ptr<const SpectrogramTile> &tile,
+                               wxCoord x, wxCoord y);
+    void draw_spectrogram_tile(DisplayListDC &dc,
+                               const std::shared_ptr<const SpectrogramTile> &tile,
+                               wxCoord x, wxCoord y);
+    template <typename DC>
+    void draw_density(DC &dc, wxCoord width, wxCoord height, int current_tick,
+                      int y_min, int y_max);
+    void draw_ghost_notes(CountingDC &dc, wxCoord height, int current_tick);
+    void draw_overview(CountingDC &dc, wxCoord height, int current_tick);
+    void draw_label(CountingDC &dc, const std::string &text,
+                    const wxFont &font, const wxColour &colour, wxCoord x,
+                    wxCoord y, double angle = 0.0);
+    void draw_label(DisplayListDC &dc, const std::string &text,
+                    const wxFont &font, const wxColour &colour, wxCoord x,
+                    wxCoord y, double angle = 0.0);
 
     void mouseUp(wxMouseEvent &event);
     void mouseDown(wxMouseEvent &event);
@@ -25,17 +89,75 @@ class Canvas : public wxPanel {
     void keyDown(wxKeyEvent &event);
     void keyUp(wxKeyEvent &event);
 
-    ma_engine_config engine_config{NULL};
-    ma_engine engine{NULL};
-    ma_sound sound{NULL};
+    wxRect selection_rect();
+    long tick_at(wxCoord height, int current_tick, int screen_y);
+    int ticks_per_pixel() const { return 1 << this->zoom_out_shift; }
+    bool is_lod() const;
+    void warp_to(double tick);
+    // Swap in an imported or merged chart. Its versions count from zero
+    // again, so caches keyed on the old chart's version are dropped here.
+    void replace_chart(std::unique_ptr<Notechart> new_chart);
+
+    Playback playback;
+    std::string song_path;
     double offset{-0.82};
     double BPM{140};
 
+    // Tick/time conversion from the chart's BPM notes, with BPM as the
+    // tempo before the first one
+    TempoMap tempo_map;
+    // Chart version the map was built from, and a revision bumped on every
+    // rebuild that the ghost notes and spectrogram tiles follow
+    long tempo_map_chart_version{-1};
+    long tempo_map_version{-1};
+
+    // Onsets found in the song, shown as ghost notes snapped to the current
+    // tick granularity until they are accepted
+    std::future<std::vector<Onset>> onset_job;
+    std::vector<Onset> onsets;
+    std::vector<Note> ghost_notes;
+    long ghost_tempo_version{-1};
+    int ghost_granularity_index{-1};
+
+    // Tempo and offset estimated from the song; replaces the BPM notes
+    std::future<TempoEstimate> tempo_job;
+
+    // Spectrogram column beside the lanes, one tile per measure. Tiles are
+    // scaled to the row size once and kept as bitmaps while on screen.
+    bool is_spectrogram_shown{false};
+    SpectrogramCache spectrogram;
+    std::string spectrogram_song_path;
+    long spectrogram_tempo_version{-1};
+    double spectrogram_offset{0.0};
+    int spectrogram_row_size{0};
+    std::unordered_map<long, std::pair<std::shared_ptr<const SpectrogramTile>,
+                                       wxBitmap>>
+        spectrogram_bitmaps;
+
     std::unique_ptr<Notechart> chart;
 
+    // The chart as background work sees it, republished after every edit,
+    // and the autosave that writes it out periodically from a worker thread
+    SnapshotChannel published_chart;
+    std::future<std::shared_ptr<const ChartSnapshot>> autosave_job;
+    std::shared_ptr<const ChartSnapshot> autosaved_chart;
+    std::chrono::time_point<std::chrono::steady_clock> autosave_time;
+
+    // Link to a running game build, toggled with ';'; sends what changed
+    // in each frame to every subscriber
+    LivePreviewServer live_preview;
+
     bool is_highlighted{false};
     int highlight_x{0}, highlight_y{0};
-    std::set<int> highlighted_notes;
+    std::set<NoteHandle> highlighted_notes;
+
+    // Lane groups hidden with 1, 2 and 3 (bit 0 hard, bit 1 normal, bit 2
+    // easy) and the slots of the notes still drawn, matched from the chart's
+    // lane index whenever the chart or the mask changes
+    int hidden_lane_groups{0};
+    RoaringBitmap shown_notes;
+    long shown_notes_version{-1};
+    int shown_notes_mask{0};
 
     int tick_granularity_index{0};
     Mode mode{Mode::MODE_POINTER};
@@ -44,6 +166,16 @@ class Canvas : public wxPanel {
     double current_tick_double{12.0};
     int current_row_size{3};
 
+    // Past row size 1 the view zooms out to 2^zoom_out_shift ticks per
+    // pixel; once a measure gets too short for notes, each lane shows a
+    // density bar per measure instead, from the snapshot's lane counts
+    int zoom_out_shift{0};
+
+    // Whole-song density strip in column 0, rebuilt from the same counts
+    // when the snapshot or the window height changes; click to warp
+    wxBitmap overview_bitmap;
+    std::shared_ptr<const ChartSnapshot> overview_snapshot;
+
     Side current_side{SIDE_NONE};
 
     bool is_long_note{false};
@@ -54,6 +186,34 @@ class Canvas : public wxPanel {
 
     bool is_background_drawn{false};
 
+    // Cached layers: lane backgrounds, and the grid plus notes as they were
+    // drawn at content_tick. The transient overlay is drawn on top per frame.
+    wxBitmap background_layer, content_layer, scratch_layer;
+    bool is_content_drawn{false};
+    int content_tick{0};
+    int content_row_size{0};
+    int content_zoom_out_shift{0};
+    int content_granularity_index{0};
+    long content_chart_version{-1};
+    long content_spectrogram_revision{-1};
+    int content_hidden_lane_groups{0};
+    std::set<NoteHandle> content_highlighted_notes;
+
+    // Software backend: the display list is rasterized in tiles on the
+    // worker pool and presented with a single bitmap blit
+    bool is_software_rendering{false};
+    std::unique_ptr<ThreadPool> raster_pool;
+    std::unique_ptr<TiledRasterizer> rasterizer;
+    DisplayList display_list;
+    Framebuffer framebuffer;
+    std::vector<unsigned char> framebuffer_rgb;
+
+    bool is_perf_hud_shown{false};
+    FrameStats frame_stats;
+
+    wxFont overlay_font, arrow_font, measure_font;
+    LabelCache label_cache;
+
     wxCoord width, height;
 
     std::chrono::time_point<std::chrono::steady_clock> latest_update_time;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+class Note;
+
+// 64-bit hash of everything a note holds except its ID, so charts that
+// differ only in numbering hash the same
+uint64_t note_hash(const Note &note);
+
+// Content hashes of a chart, one per measure, kept current as notes come
+// and go. A measure's hash is the sum of its notes' hashes, so adding or
+// removing a note is O(1) whatever the order of edits; the measures are
+// the leaves of a 16-ary Merkle tree whose root is the chart's digest.
+//
+// The tree is refreshed lazily, only along the paths of measures changed
+// since the last read. A node whose children past the first are all empty
+// takes its first child's hash, so trailing empty measures and the height
+// of the tree never change the digest.
+class ChartDigest {
+   public:
+    static constexpr size_t FANOUT = 16;
+
+    void add(long measure, uint64_t hash);
+    void remove(long measure, uint64_t hash);
+    void clear();
+
+    // 0 for a measure without notes
+    uint64_t measure_hash(long measure) const;
+
+    // 0 for an empty chart
+    uint64_t root() const;
+
+    // Measures whose content differs between the two charts, in increasing
+    // order. Only subtrees whose hashes differ are visited, so the cost
+    // follows the number of changed measures rather than the chart size.
+    std::vector<long> diff(const ChartDigest &other) const;
+
+    size_t memory_usage() const;
+
+   private:
+    struct Leaf {
+        uint64_t sum{0};
+        uint32_t count{0};
+    };
+
+    void refresh() const;
+    uint64_t node(size_t level, size_t index) const;
+    uint64_t combine(size_t level, size_t index) const;
+    void diff_node(const ChartDigest &other, size_t level, size_t index,
+                   std::vector<long> &measures) const;
+
+    std::vector<Leaf> leaves;
+
+    // levels[0] holds the leaf hashes and each level above one hash per
+    // FANOUT nodes below, up to a single root
+    mutable std::vector<std::vector<uint64_t>> levels;
+    mutable std::set<size_t> dirty_leaves;
+    mutable bool is_stale{false};
+};
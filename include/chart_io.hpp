@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "notechart.hpp"
+
+// Reading and writing .thapsteak files. Nothing here depends on wxWidgets,
+// so the editor and the command-line tool share the same code path.
+
+Lane lane_from_text(const std::string &text);
+Side side_from_text(const std::string &text);
+
+// Parse a whitespace-separated filter such as "hard right flick 40-60":
+// lane groups (hard, normal, easy) or lanes (H1..E3, BPM), sides (left,
+// right, noside), flicks (flick, flick-up, ..., noflick), long or tap, and
+// a measure or an inclusive measure range. Returns false on an unknown word.
+bool parse_note_filter(const std::string &text, NoteFilter &filter);
+
+// Parse a JSON document into `chart`; returns the number of events read.
+// Throws nlohmann::json::exception on malformed input and
+// std::invalid_argument on a negative row or a flick angle that is not a
+// Direction.
+size_t parse_chart(const std::string &content, Notechart &chart);
+
+// `dropped`, when given, receives the number of notes that shared a cell
+// with an earlier note of the file and were left out
+bool import_chart(const std::string &file_path, Notechart &chart,
+                  size_t *dropped = nullptr);
+bool export_chart(const std::string &file_path, Notechart &chart);
+
+bool read_file(const std::string &file_path, std::string &content);
+bool write_file(const std::string &file_path, const std::string &content);
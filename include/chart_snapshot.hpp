@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "notechart.hpp"
+
+// Copies of the notes of one measure (192 ticks), in (tick, lane) order,
+// with the number of notes per lane counted once when the copy is made and
+// the measure's content hash
+struct MeasureNotes {
+    long measure;
+    std::vector<Note> notes;
+    std::array<uint32_t, LANE_E3 + 1> lane_counts{};
+    uint64_t hash{0};
+};
+
+// Immutable version of a chart that any thread may read. Measures are
+// shared between consecutive snapshots, so publishing an edit only copies
+// the notes of the measures it touched plus one pointer per measure.
+class ChartSnapshot {
+   public:
+    ChartSnapshot(long _version, uint64_t _digest,
+                  std::vector<std::shared_ptr<const MeasureNotes>> _measures);
+
+    // Notechart::version() the snapshot was taken at
+    long version() const { return this->chart_version; }
+
+    // Notechart::digest() at that version; snapshots of different versions
+    // may still hold the same content
+    uint64_t digest() const { return this->chart_digest; }
+
+    // Number of notes
+    size_t size() const { return this->note_count; }
+
+    // Non-empty measures, in increasing order
+    const std::vector<std::shared_ptr<const MeasureNotes>> &measures() const {
+        return this->measure_list;
+    }
+
+    // nullptr when the measure has no notes
+    std::shared_ptr<const MeasureNotes> measure(long measure) const;
+
+    // Index into measures() of the first one at or after `measure`
+    size_t lower_bound_measure(long measure) const;
+
+    // One past the last measure with notes
+    long measure_count() const {
+        return this->measure_list.empty()
+                   ? 0
+                   : this->measure_list.back()->measure + 1;
+    }
+
+    // Calls body(note) for every note in (tick, lane) order
+    template <typename Body>
+    void for_each(Body body) const {
+        for (const std::shared_ptr<const MeasureNotes> &measure :
+             this->measure_list) {
+            for (const Note &note : measure->notes) {
+                body(note);
+            }
+        }
+    }
+
+    // Same document as Notechart::to_string()
+    std::string to_string() const;
+
+    // Measures held by both snapshots rather than copied
+    size_t shared_measures(const ChartSnapshot &other) const;
+
+   private:
+    long chart_version;
+    uint64_t chart_digest;
+    size_t note_count{0};
+    std::vector<std::shared_ptr<const MeasureNotes>> measure_list;
+};
+
+// The latest snapshot, published by the thread that owns the Notechart and
+// loaded by background readers (autosave, analysis, export) without locking
+// the chart
+class SnapshotChannel {
+   public:
+    void publish(std::shared_ptr<const ChartSnapshot> snapshot) {
+        this->current.store(std::move(snapshot), std::memory_order_release);
+    }
+
+    // nullptr until the first publish
+    std::shared_ptr<const ChartSnapshot> load() const {
+        return this->current.load(std::memory_order_acquire);
+    }
+
+   private:
+    std::atomic<std::shared_ptr<const ChartSnapshot>> current;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <wx/wx.h>
+
+#include "frame_stats.hpp"
+
+// Thin wrapper over a wxDC that counts draw calls and state changes for the
+// performance HUD. Without THAPSTEAK_PERF_HUD every method is a plain
+// forwarding call.
+class CountingDC {
+   public:
+    CountingDC(wxDC &_dc, FrameStats &_stats) : dc(_dc), stats(_stats) {}
+
+    void GetSize(wxCoord *width, wxCoord *height) const {
+        dc.GetSize(width, height);
+    }
+
+    void SetBackground(const wxBrush &brush) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetBackground(brush);
+    }
+    void SetPen(const wxPen &pen) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetPen(pen);
+    }
+    void SetBrush(const wxBrush &brush) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetBrush(brush);
+    }
+    void SetFont(const wxFont &font) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetFont(font);
+    }
+    void SetTextForeground(const wxColour &colour) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetTextForeground(colour);
+    }
+
+    void Clear() {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.Clear();
+    }
+    void DrawRectangle(wxCoord x, wxCoord y, wxCoord width, wxCoord height) {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.DrawRectangle(x, y, width, height);
+    }
+    void DrawLine(wxCoord x1, wxCoord y1, wxCoord x2, wxCoord y2) {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.DrawLine(x1, y1, x2, y2);
+    }
+    void DrawText(const wxString &text, wxCoord x, wxCoord y) {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.DrawText(text, x, y);
+    }
+    void DrawRotatedText(const wxString &text, wxCoord x, wxCoord y,
+                         double angle) {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.DrawRotatedText(text, x, y, angle);
+    }
+    void DrawBitmap(const wxBitmap &bitmap, wxCoord x, wxCoord y,
+                    bool use_mask = false) {
+        PERF_ADD(stats, draw_calls, 1);
+        dc.DrawBitmap(bitmap, x, y, use_mask);
+    }
+
+    bool Blit(wxCoord x, wxCoord y, wxCoord width, wxCoord height,
+              wxDC *source, wxCoord source_x, wxCoord source_y) {
+        PERF_ADD(stats, draw_calls, 1);
+        return dc.Blit(x, y, width, height, source, source_x, source_y);
+    }
+
+    void SetClippingRegion(wxCoord x, wxCoord y, wxCoord width,
+                           wxCoord height) {
+        PERF_ADD(stats, state_changes, 1);
+        dc.SetClippingRegion(x, y, width, height);
+    }
+    void DestroyClippingRegion() {
+        PERF_ADD(stats, state_changes, 1);
+        dc.DestroyClippingRegion();
+    }
+
+   private:
+    wxDC &dc;
+    FrameStats &stats;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <wx/wx.h>
+
+#include "frame_stats.hpp"
+#include "label_cache.hpp"
+#include "raster.hpp"
+
+// Records the subset of wxDC calls used by the chart view into a display
+// list for the software rasterizer. Shares the drawing code with CountingDC,
+// so both backends produce the same geometry. Pens and brushes follow wxDC
+// semantics: a rectangle is filled with the brush and outlined with the pen.
+class DisplayListDC {
+   public:
+    DisplayListDC(DisplayList &_list, wxCoord _width, wxCoord _height,
+                  FrameStats &_stats)
+        : list(_list), width(_width), height(_height), stats(_stats) {}
+
+    void GetSize(wxCoord *_width, wxCoord *_height) const {
+        *_width = this->width;
+        *_height = this->height;
+    }
+
+    void SetBackground(const wxBrush &brush) {
+        PERF_ADD(stats, state_changes, 1);
+        this->background = pack(brush.GetColour());
+    }
+    void SetPen(const wxPen &pen) {
+        PERF_ADD(stats, state_changes, 1);
+        this->pen = pack(pen.GetColour());
+        this->pen_width = pen.GetWidth();
+    }
+    void SetBrush(const wxBrush &brush) {
+        PERF_ADD(stats, state_changes, 1);
+        this->brush = pack(brush.GetColour());
+    }
+
+    void Clear() {
+        PERF_ADD(stats, draw_calls, 1);
+        this->list.fill_rect(0, 0, this->width, this->height,
+                             this->background | 0xff000000);
+    }
+    void DrawRectangle(wxCoord x, wxCoord y, wxCoord w, wxCoord h) {
+        PERF_ADD(stats, draw_calls, 1);
+        this->list.fill_rect(x, y, w, h, this->brush);
+        if (w > 2 && h > 2) {
+            this->list.fill_rect(x, y, w, 1, this->pen);
+            this->list.fill_rect(x, y + h - 1, w, 1, this->pen);
+            this->list.fill_rect(x, y + 1, 1, h - 2, this->pen);
+            this->list.fill_rect(x + w - 1, y + 1, 1, h - 2, this->pen);
+        } else {
+            this->list.fill_rect(x, y, w, h, this->pen);
+        }
+    }
+    void DrawLine(wxCoord x1, wxCoord y1, wxCoord x2, wxCoord y2) {
+        PERF_ADD(stats, draw_calls, 1);
+        this->list.line(x1, y1, x2, y2, this->pen_width, this->pen);
+    }
+    void DrawLabel(const LabelCache::Label &label, wxCoord x, wxCoord y) {
+        PERF_ADD(stats, draw_calls, 1);
+        this->list.mask(x + label.offset_x, y + label.offset_y, label.mask);
+    }
+    void DrawImage(std::shared_ptr<const RasterImage> image, wxCoord x,
+                   wxCoord y, wxCoord w, wxCoord h) {
+        PERF_ADD(stats, draw_calls, 1);
+        this->list.image(x, y, w, h, std::move(image));
+    }
+
+    // The whole frame is rasterized every time, so clipping is a no-op
+    void SetClippingRegion(wxCoord, wxCoord, wxCoord, wxCoord) {}
+    void DestroyClippingRegion() {}
+
+   private:
+    static uint32_t pack(const wxColour &colour) {
+        return ((uint32_t)colour.Alpha() << 24) |
+               ((uint32_t)colour.Red() << 16) |
+               ((uint32_t)colour.Green() << 8) | colour.Blue();
+    }
+
+    DisplayList &list;
+    wxCoord width, height;
+    FrameStats &stats;
+
+    uint32_t background{0xffffffff};
+    uint32_t pen{0xff000000};
+    int pen_width{1};
+    uint32_t brush{0xffffffff};
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Radix-2 complex FFT over split real/imaginary arrays. The tables are built
+// once and never written afterwards, so one instance can be shared by every
+// worker as long as each brings its own scratch buffers.
+class FFT {
+   public:
+    // `_size` must be a power of two
+    explicit FFT(size_t _size);
+
+    size_t size() const { return this->length; }
+
+    // In-place forward transform
+    void forward(float *re, float *im) const;
+
+    // Hann-windowed magnitude spectrum of a real frame: size() / 2 + 1 bins.
+    // `re` and `im` are scratch buffers of size() floats.
+    void magnitudes(const float *frame, float *magnitudes, float *re,
+                    float *im) const;
+
+   private:
+    size_t length;
+    std::vector<uint32_t> bit_reverse;
+    // Twiddles of every stage back to back, contiguous per stage so the
+    // butterflies stream through them
+    std::vector<float> twiddle_re, twiddle_im;
+    std::vector<float> window;
+};
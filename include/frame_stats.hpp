@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+
+// Per-frame counters shown on the performance HUD
+struct FrameCounters {
+    long notes_considered{0};
+    long notes_drawn{0};
+    long draw_calls{0};
+    long state_changes{0};
+};
+
+class FrameStats {
+   public:
+    // Number of frames kept for the rolling frame-time percentiles
+    static constexpr int WINDOW_SIZE = 240;
+
+    void begin_frame();
+    void end_frame(double frame_time);
+    void percentiles(double &p50, double &p95, double &p99) const;
+
+    // Counters of the frame being drawn and of the last finished one
+    FrameCounters counters;
+    FrameCounters latest;
+
+   private:
+    std::array<double, WINDOW_SIZE> frame_times{};
+    int cursor{0};
+    int count{0};
+};
+
+// Counters compile out unless the HUD is enabled at configure time
+#ifdef THAPSTEAK_PERF_HUD
+#define PERF_ADD(stats, counter, n) ((stats).counters.counter += (n))
+#else
+#define PERF_ADD(stats, counter, n) ((void)0)
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <wx/wx.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "raster.hpp"
+
+// Pre-rendered text labels for the note overlays. Each label is rasterized
+// once into an alpha bitmap and then blitted, so per-frame text drawing no
+// longer goes through the font rasterizer. Least recently used labels are
+// evicted once the cache exceeds its memory budget.
+class LabelCache {
+   public:
+    struct Label {
+        wxBitmap bitmap;
+        // Position of the bitmap relative to the point passed to DrawText
+        wxCoord offset_x{0}, offset_y{0};
+        // Same coverage for the software rasterizer
+        std::shared_ptr<const RasterMask> mask;
+        size_t bytes{0};
+    };
+
+    explicit LabelCache(size_t _memory_budget = 16 * 1024 * 1024);
+
+    // Same placement rules as wxDC::DrawText / wxDC::DrawRotatedText
+    const Label &get(const std::string &text, const wxFont &font,
+                     const wxColour &colour, double angle = 0.0);
+
+    void clear();
+
+    size_t size() const { return this->entries.size(); }
+    size_t memory_usage() const { return this->used_bytes; }
+
+    long hits{0}, misses{0};
+
+   private:
+    struct Key {
+        std::string text;
+        int point_size;
+        int weight;
+        int angle;
+        unsigned long colour;
+
+        bool operator==(const Key &other) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    Label render(const std::string &text, const wxFont &font,
+                 const wxColour &colour, double angle);
+
+    // Most recently used first
+    std::list<std::pair<Key, Label>> entries;
+    std::unordered_map<Key, std::list<std::pair<Key, Label>>::iterator, KeyHash>
+        index;
+
+    size_t memory_budget;
+    size_t used_bytes{0};
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chart_snapshot.hpp"
+
+// Live preview link: the editor streams its chart to subscribers (a game
+// build, or `thapsteak_cli subscribe`) over a local Unix domain socket.
+//
+// Everything that changed during one editor frame goes out as one packet:
+//
+//   u32 length of the rest, u32 sequence, u16 message count, messages...
+//
+// and every message is a u8 type followed by its fields, little-endian:
+//
+//   RESET                  drop every note; starts a full resync
+//   INSERT   id note       note: i32 tick, u8 lane, i16 direction, u8 side,
+//                                u8 long note, f32 value
+//   DELETE   id            id: u32 slot index, u32 generation
+//   UPDATE   id u8 mask    then only the fields whose PREVIEW_FIELD_* bit
+//                          is set, in the order of `note` above
+//   TEMPO    f64 bpm, f64 offset        tempo before the first BPM note and
+//                                       chart time minus song time
+//   PLAYHEAD f64 tick, f64 song seconds, u8 playing
+//
+// A subscriber that connects gets RESET, an INSERT per note, TEMPO and
+// PLAYHEAD in its first packet, and deltas from then on.
+
+enum PreviewMessage : uint8_t {
+    PREVIEW_RESET,
+    PREVIEW_INSERT,
+    PREVIEW_DELETE,
+    PREVIEW_UPDATE,
+    PREVIEW_TEMPO,
+    PREVIEW_PLAYHEAD
+};
+
+enum PreviewField : uint8_t {
+    PREVIEW_FIELD_TICK = 1,
+    PREVIEW_FIELD_LANE = 2,
+    PREVIEW_FIELD_DIRECTION = 4,
+    PREVIEW_FIELD_SIDE = 8,
+    PREVIEW_FIELD_LONGNOTE = 16,
+    PREVIEW_FIELD_VALUE = 32
+};
+
+// Editor state sent besides the notes
+struct PreviewTransport {
+    double bpm{140.0};
+    double offset{0.0};
+    double tick{0.0};
+    double song_seconds{0.0};
+    bool is_playing{false};
+};
+
+// Where the editor listens unless told otherwise: thapsteak-preview.sock in
+// the temp directory
+std::string default_preview_socket();
+
+// Messages turning `from` into `to`, appended to `out`; a full resync when
+// `from` is null. Only measures not shared by the two snapshots are
+// compared. Returns the number of messages.
+size_t encode_chart_delta(const ChartSnapshot *from, const ChartSnapshot &to,
+                          std::vector<uint8_t> &out);
+
+// Editor side. Every call is non-blocking and meant for the UI thread; a
+// subscriber that stops reading is dropped once its backlog gets too large.
+class LivePreviewServer {
+   public:
+    LivePreviewServer() = default;
+    ~LivePreviewServer();
+
+    LivePreviewServer(const LivePreviewServer &) = delete;
+    LivePreviewServer &operator=(const LivePreviewServer &) = delete;
+
+    // Listen on `socket_path`, replacing a stale socket file; false when the
+    // socket cannot be created or Unix sockets are not available
+    bool start(const std::string &socket_path);
+    void stop();
+    bool is_running() const { return this->listen_fd >= 0; }
+
+    // Once per frame: accept subscribers, resync the new ones, and send the
+    // others what changed since the previous call
+    void publish(std::shared_ptr<const ChartSnapshot> snapshot,
+                 const PreviewTransport &transport);
+
+    size_t subscriber_count() const { return this->subscribers.size(); }
+    // Size of the latest delta packet, in bytes
+    size_t last_packet_size() const { return this->packet_size; }
+
+   private:
+    struct Subscriber {
+        int fd;
+        std::vector<uint8_t> backlog;
+    };
+
+    void begin_packet(std::vector<uint8_t> &packet);
+    void end_packet(std::vector<uint8_t> &packet, size_t message_count);
+    // False when the subscriber is gone or too far behind
+    bool send(Subscriber &subscriber, const std::vector<uint8_t> &packet);
+
+    std::string path;
+    int listen_fd{-1};
+    std::vector<Subscriber> subscribers;
+
+    std::shared_ptr<const ChartSnapshot> sent_snapshot;
+    PreviewTransport sent_transport;
+    uint32_t sequence{0};
+    size_t packet_size{0};
+};
+
+// Reference subscriber: keeps a copy of the editor's chart up to date
+class LivePreviewClient {
+   public:
+    LivePreviewClient() = default;
+    ~LivePreviewClient();
+
+    LivePreviewClient(const LivePreviewClient &) = delete;
+    LivePreviewClient &operator=(const LivePreviewClient &) = delete;
+
+    bool connect(const std::string &socket_path);
+    void close();
+
+    // Wait up to `timeout_ms` for data and apply every complete packet;
+    // false once the editor has closed the link or sent garbage
+    bool poll(int timeout_ms);
+
+    // Apply one packet without its length prefix; false when malformed
+    bool apply(const uint8_t *data, size_t size);
+
+    std::map<NoteHandle, Note> notes;
+    PreviewTransport transport;
+
+    // Latest sequence and packets so far, and the notes changed by the
+    // latest poll()
+    uint32_t sequence{0};
+    size_t packets{0};
+    size_t inserts{0}, deletes{0}, updates{0};
+
+   private:
+    int fd{-1};
+    std::vector<uint8_t> buffer;
+};
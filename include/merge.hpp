@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "notechart.hpp"
+
+struct MergeConflict {
+    long tick;
+    Lane lane;
+    std::string reason;
+};
+
+// Three-way merge of charts whose notes are ordered by (tick, lane), as
+// Notechart keeps them. The three event lists are walked together in a
+// single pass, so the merge is linear in the total number of notes.
+// Conflicting cells keep our version (or whichever side still has the note)
+// and are reported back.
+std::vector<MergeConflict> merge_charts(const Notechart &base,
+                                        const Notechart &ours,
+                                        const Notechart &theirs,
+                                        Notechart &merged);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "notechart.hpp"
+#include "pcm.hpp"
+#include "tempo_map.hpp"
+#include "thread_pool.hpp"
+
+// Offline render of the song with a hitsound on every note, written to a
+// 16-bit WAV file. The song is decoded once, front to back; each chunk of
+// the timeline is mixed and converted on the pool while the next one is
+// decoded, and finished chunks are written in order, so only a few chunks
+// are ever held in memory.
+
+enum HitsoundKind {
+    HITSOUND_HARD,
+    HITSOUND_NORMAL,
+    HITSOUND_EASY,
+    HITSOUND_FLICK
+};
+constexpr int HITSOUND_KIND_COUNT = 4;
+const std::vector<std::string> hitsound_text{"hard", "normal", "easy",
+                                             "flick"};
+
+// One sample per kind, all in the layout of the mix
+struct HitsoundSet {
+    PcmBuffer sounds[HITSOUND_KIND_COUNT];
+};
+
+struct Hit {
+    // Song time
+    double seconds;
+    HitsoundKind kind;
+};
+
+struct MixdownOptions {
+    uint32_t channels{2};
+    uint32_t sample_rate{44100};
+    float song_gain{0.8f};
+    float hitsound_gain{0.6f};
+    size_t chunk_frames{65536};
+};
+
+struct MixdownStats {
+    size_t frames{0};
+    size_t hits{0};
+    // Samples that went past full scale and were clamped
+    size_t clipped_samples{0};
+};
+
+// Short synthesized clicks: a bright tick for hard, lower ones for normal
+// and easy, and a noise swish for flicks
+HitsoundSet default_hitsounds(uint32_t channels, uint32_t sample_rate);
+
+// Replace the sounds that exist as <kind>.wav (or .mp3, .flac) in
+// `directory`, converted to the given layout; returns how many were loaded
+size_t load_hitsounds(const std::string &directory, uint32_t channels,
+                      uint32_t sample_rate, HitsoundSet &hitsounds);
+
+// One hit per note the filter matches, flicks taking the flick sound and
+// every other note the sound of its lane group; BPM notes stay silent
+std::vector<Hit> chart_hits(Notechart &chart, const TempoMap &tempo_map,
+                            double offset, const NoteFilter &filter);
+
+// Render to `output_path`; the file runs until the song or the last
+// hitsound ends, whichever is later. `hits` may come in any order. False
+// when the song cannot be decoded or the file cannot be written.
+bool mixdown(const std::string &song_path, const std::vector<Hit> &hits,
+             const HitsoundSet &hitsounds, const std::string &output_path,
+             const MixdownOptions &options, ThreadPool &pool,
+             MixdownStats &stats);
@@ -1,8 +1,17 @@
+#pragma once
+
+#include <climits>
 #include <memory>
+#include <set>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "chart_digest.hpp"
+#include "roaring.hpp"
+#include "slot_map.hpp"
+
+class ChartSnapshot;
+
 enum Direction {
     DIR_NONE = -1,
     DIR_RIGHT = 0,
@@ -11,6 +20,11 @@ enum Direction {
     DIR_ULEFT = 135,
     DIR_LEFT = 180
 };
+// Whether a flick angle read from a file is one of the directions above
+inline bool is_direction(long angle) {
+    return angle == DIR_NONE || (angle >= DIR_RIGHT && angle <= DIR_LEFT &&
+                                 angle % 45 == 0);
+}
 enum Side { SIDE_NONE, SIDE_LEFT, SIDE_RIGHT };
 const std::vector<std::string> side_text{"null", "left", "right"};
 
@@ -34,9 +48,24 @@ const std::vector<std::string> lane_text{"",   "BPM", "",   "H1", "H2", "H3",
                                          "H4", "H5",  "",   "N1", "N2", "N3",
                                          "N4", "",    "E1", "E2", "E3"};
 
+// Stable note ID; stops resolving once the note is deleted
+using NoteHandle = SlotHandle;
+
+// Which notes a query matches. Every non-empty list must contain the note's
+// value; the tick range is half-open.
+struct NoteFilter {
+    std::vector<Lane> lanes;
+    std::vector<Side> sides;
+    std::vector<Direction> directions;
+    // -1: either, 0: taps only, 1: long notes only
+    int is_longnote{-1};
+    long tick_begin{0};
+    long tick_end{LONG_MAX};
+};
+
 class Note {
    public:
-    long id;
+    NoteHandle id;
     long tick;
     Lane lane;
     Direction direction{DIR_NONE};
@@ -47,24 +76,116 @@ class Note {
     Note(long _tick, Lane _lane, Direction _direction, Side _side,
          bool _is_longnote);
 
-    std::string to_string();
+    std::string to_string() const;
 };
 
 class Notechart {
    public:
+    // Whether the content differs from when update() was last called (an
+    // edit that is undone by hand no longer counts)
     bool is_updated();
     void modify();
     void update();
     void add_note(Note note);
+    void add_notes(const std::vector<Note> &new_notes);
+    void remove_notes(const std::set<NoteHandle> &ids);
+
+    // Bulk transforms over the selected note IDs. The ones that move notes
+    // return false and leave the chart untouched when a note would end up
+    // before tick 0 or on a cell already held by another note, and when the
+    // cell size or scale factor is not positive.
+    bool shift_notes(const std::set<NoteHandle> &ids, long delta);
+    bool mirror_notes(const std::set<NoteHandle> &ids);
+    void swap_sides(const std::set<NoteHandle> &ids);
+    bool quantize_notes(const std::set<NoteHandle> &ids,
+                        long cell_range_in_ticks);
+    bool scale_notes(const std::set<NoteHandle> &ids, double factor);
+
+    // Field edits go through here so the indexes stay current
+    void set_direction(const std::set<NoteHandle> &ids, Direction direction);
+    void set_side(const std::set<NoteHandle> &ids, Side side);
+
+    // Notes matching every attribute of the filter, ignoring its tick range,
+    // as a bitmap of slot indices
+    RoaringBitmap match(const NoteFilter &filter);
+
+    // Notes matching the filter within its tick range, in no particular
+    // order. Intersects the indexes, then either walks the matches or scans
+    // the tick range, whichever is smaller.
+    std::vector<NoteHandle> query(const NoteFilter &filter);
+
+    // nullptr when the note has been deleted since the ID was taken
+    std::shared_ptr<Note> find_note(NoteHandle id);
 
     std::vector<std::shared_ptr<Note>> notes;
-    std::unordered_map<int, std::shared_ptr<Note>> note_index;
 
     bool is_same_lane_group(std::shared_ptr<Note> a, std::shared_ptr<Note> b);
 
+    // Index of the first note at or after `tick`
+    size_t lower_bound_tick(long tick);
+
+    // Bumped on every modification so that caches can detect stale data
+    long version();
+
+    // Merkle root over the per-measure content hashes: equal for charts
+    // holding the same notes, whatever their IDs or edit history
+    uint64_t digest();
+    const ChartDigest &content_digest() const { return this->measure_hashes; }
+
+    // Indices into `notes` split into the chains that long-note connectors
+    // follow: one chain per (lane group, side), each ordered by tick
+    const std::vector<std::vector<size_t>> &connector_chains();
+
+    // Re-sort, drop duplicated cells and renumber IDs from zero; IDs taken
+    // before the call no longer resolve
+    void normalize();
+
     std::string to_string();
 
+    // Immutable copy of the current version for other threads. Measures no
+    // edit touched since the previous call are shared with the previous
+    // snapshot; calling it again without edits returns the same snapshot.
+    std::shared_ptr<const ChartSnapshot> snapshot();
+
+    // Approximate heap footprint of the notes and their index, in bytes
+    size_t memory_usage();
+
    private:
-    int current_sequence{0};
-    bool updated{false};
+    std::vector<std::shared_ptr<Note>> collect(const std::set<NoteHandle> &ids);
+    // Whether the selected notes can move to (ticks[i], lanes[i]): no two
+    // of them share a target, and no target holds a note outside `ids`
+    bool can_move(const std::set<NoteHandle> &ids,
+                  const std::vector<long> &ticks,
+                  const std::vector<int> &lanes);
+    void organize();
+
+    // Add or drop the note's current fields in the secondary indexes
+    void index_note(const Note &note);
+    void unindex_note(const Note &note);
+    void reindex();
+
+    // Add or drop the note's current content in the hash of its measure,
+    // and mark the measure for the next snapshot
+    void count_note(const Note &note);
+    void uncount_note(const Note &note);
+
+    // Secondary indexes over slot indices: one bitmap per lane, side and
+    // flick direction (DIR_NONE first, then by angle), and the long notes
+    RoaringBitmap lane_index[LANE_E3 + 1];
+    RoaringBitmap side_index[3];
+    RoaringBitmap direction_index[6];
+    RoaringBitmap longnote_index;
+
+    SlotMap<std::shared_ptr<Note>> note_slots;
+    long current_version{0};
+
+    ChartDigest measure_hashes;
+    uint64_t saved_digest{0};
+
+    long chains_version{-1};
+    std::vector<std::vector<size_t>> chains;
+
+    std::shared_ptr<const ChartSnapshot> latest_snapshot;
+    std::set<long> dirty_measures;
+    bool is_all_dirty{true};
 };
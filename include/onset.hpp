@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "notechart.hpp"
+#include "pcm.hpp"
+#include "tempo_map.hpp"
+#include "thread_pool.hpp"
+
+struct Onset {
+    // Song time
+    double seconds;
+    // Peak of the normalized spectral flux, 0 to 1
+    float strength;
+    // Where in the spectrum the energy rose, 0 (lows) to 1 (highs)
+    float brightness;
+};
+
+struct OnsetOptions {
+    size_t fft_size{2048};
+    size_t hop_size{512};
+    // Added to the local mean of the flux to form the adaptive threshold
+    float threshold{0.05f};
+    // Frames on each side for the local mean and for the local maximum
+    size_t mean_radius{12};
+    size_t peak_radius{3};
+    double min_interval{0.05};
+};
+
+// Spectral flux of a mono signal, one value per hop, normalized to a peak of
+// 1. The frames are computed in independent chunks on the pool; each chunk
+// recomputes the spectrum just before it, so the result does not depend on
+// how the work is split. `brightness` receives the spectral position of
+// each rise when given.
+std::vector<float> onset_envelope(const PcmBuffer &mono, ThreadPool &pool,
+                                  const OnsetOptions &options,
+                                  std::vector<float> *brightness = nullptr);
+
+// Peaks of the onset envelope
+std::vector<Onset> detect_onsets(const PcmBuffer &mono, ThreadPool &pool,
+                                 const OnsetOptions &options = OnsetOptions());
+
+// Snap onsets to cells of `cell_ticks` through the tempo map. Brighter onsets
+// go further right across the hard lanes; one note per cell at most.
+std::vector<Note> onsets_to_notes(const std::vector<Onset> &onsets,
+                                  const TempoMap &tempo, double offset,
+                                  long cell_ticks);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interleaved 32-bit float samples
+struct PcmBuffer {
+    uint32_t channels{0};
+    uint32_t sample_rate{0};
+    std::vector<float> samples;
+
+    size_t frames() const {
+        return this->channels == 0 ? 0 : this->samples.size() / this->channels;
+    }
+    double seconds() const {
+        return this->sample_rate == 0
+                   ? 0.0
+                   : (double)this->frames() / this->sample_rate;
+    }
+};
+
+// Decode a whole file, converting to the given layout; false when the file
+// cannot be decoded
+bool decode_audio(const std::string &file_path, uint32_t channels,
+                  uint32_t sample_rate, PcmBuffer &pcm);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../third_party/miniaudio.h"
+
+// A song decoded once into 16-bit blocks, so playback and scrubbing can jump
+// to any sample without touching the compressed stream. A background thread
+// publishes whole blocks as it decodes them, and readers only see what has
+// been published. read() takes no locks and never allocates, so it is safe
+// on the audio thread.
+//
+// Blocks live on the heap up to the memory budget. Past the budget they are
+// written to an unlinked temporary file and mapped back, so the page cache
+// holds the rest of a long track instead of the process.
+class PcmCache {
+   public:
+    static constexpr size_t BLOCK_FRAMES = 65536;
+    // Six hours of 48 kHz audio; decoding stops there
+    static constexpr size_t MAX_BLOCKS = 16384;
+
+    explicit PcmCache(size_t _memory_budget = 128 * 1024 * 1024);
+    ~PcmCache();
+
+    PcmCache(const PcmCache &) = delete;
+    PcmCache &operator=(const PcmCache &) = delete;
+
+    // Start decoding in the background; false when the file cannot be decoded
+    bool open(const std::string &file_path, uint32_t _channels,
+              uint32_t _sample_rate);
+    void close();
+
+    uint32_t get_channels() const { return this->channels; }
+    uint32_t get_sample_rate() const { return this->sample_rate; }
+
+    // Frames from the start of the song that read() can serve
+    size_t frames_ready() const {
+        return this->ready_frames.load(std::memory_order_acquire);
+    }
+    bool is_complete() const {
+        return this->is_decoded.load(std::memory_order_acquire);
+    }
+
+    // Copy up to `frame_count` interleaved f32 frames starting at `frame`;
+    // returns how many were available
+    size_t read(size_t frame, float *frames, size_t frame_count) const;
+
+    size_t memory_usage() const { return this->heap_bytes.load(); }
+    size_t mapped_bytes() const { return this->file_bytes.load(); }
+
+   private:
+    void decode();
+    const int16_t *store_block(const int16_t *samples, size_t bytes);
+
+    uint32_t channels{0}, sample_rate{0};
+    size_t memory_budget;
+
+    ma_decoder decoder;
+    std::thread worker;
+    std::atomic<bool> is_stopping{false};
+
+    // Sized once by open() so readers never see it move; entries are written
+    // before ready_frames is released past them
+    std::unique_ptr<const int16_t *[]> blocks;
+    std::atomic<size_t> ready_frames{0};
+    std::atomic<bool> is_decoded{false};
+
+    std::vector<std::unique_ptr<int16_t[]>> heap_blocks;
+    std::atomic<size_t> heap_bytes{0};
+
+    // Spill file and the blocks mapped from it
+    std::FILE *spill_file{nullptr};
+    std::vector<std::pair<void *, size_t>> mappings;
+    std::atomic<size_t> file_bytes{0};
+};
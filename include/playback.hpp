@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "../third_party/miniaudio.h"
+#include "pcm_cache.hpp"
+#include "time_stretch.hpp"
+
+// Song playback through miniaudio. The song feeds a custom data source that
+// runs the time-stretch stage, so it can be slowed down for charting without
+// changing pitch. Seeks and rate changes are handed to the audio thread
+// through atomics and applied at the start of its next read.
+//
+// The song is decoded once into a PcmCache in the background. Audio that is
+// already cached is read from there, which makes seeking instant and exact;
+// the streaming decoder only covers what has not been decoded yet.
+class Playback {
+   public:
+    Playback() = default;
+    ~Playback();
+
+    Playback(const Playback &) = delete;
+    Playback &operator=(const Playback &) = delete;
+
+    bool open(const std::string &file_path);
+    void close();
+    bool is_open() const { return this->is_opened; }
+
+    void start();
+    void stop();
+    bool is_playing() const;
+
+    void seek(double seconds);
+
+    // Play a short snippet at `seconds` as audible feedback while scrolling.
+    // Only cached audio is scrubbed; a newer request cuts the previous one.
+    void scrub(double seconds);
+
+    // Song time of the audio being played, in seconds. Follows the
+    // stretched clock, so the chart scroll stays in sync at any rate.
+    double position() const;
+
+    void set_rate(double rate);
+    double get_rate() const;
+
+    const PcmCache &get_cache() const { return this->cache; }
+
+   private:
+    struct Source {
+        ma_data_source_base base;
+        Playback *owner;
+    };
+
+    static ma_result source_read(ma_data_source *data_source, void *frames,
+                                 ma_uint64 frame_count, ma_uint64 *frames_read);
+    static ma_result scrub_read(ma_data_source *data_source, void *frames,
+                                ma_uint64 frame_count, ma_uint64 *frames_read);
+    static ma_result source_seek(ma_data_source *data_source,
+                                 ma_uint64 frame_index);
+    static ma_result source_get_data_format(ma_data_source *data_source,
+                                            ma_format *format,
+                                            ma_uint32 *channels,
+                                            ma_uint32 *sample_rate,
+                                            ma_channel *channel_map,
+                                            size_t channel_map_capacity);
+    static ma_result source_get_cursor(ma_data_source *data_source,
+                                       ma_uint64 *cursor);
+    static size_t read_song(void *user_data, float *frames,
+                            size_t frame_count);
+
+    static ma_data_source_vtable source_vtable;
+    static ma_data_source_vtable scrub_vtable;
+
+    ma_engine engine;
+    ma_decoder decoder;
+    ma_sound sound;
+    Source source;
+    TimeStretch stretch;
+    PcmCache cache;
+
+    // Audio thread only: next frame the stretch stage reads, and where the
+    // streaming decoder currently is
+    long long song_frame{0};
+    long long decoder_frame{0};
+
+    ma_sound scrub_sound;
+    Source scrub_source;
+    long long scrub_frame{0};
+    size_t scrub_remaining{0};
+    std::atomic<long long> pending_scrub{-1};
+
+    bool is_engine_initialized{false};
+    bool is_opened{false};
+
+    std::atomic<long long> pending_seek{-1};
+    std::atomic<double> pending_rate{1.0};
+    std::atomic<double> cursor_frames{0.0};
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "notechart.hpp"
+#include "tempo_map.hpp"
+#include "thread_pool.hpp"
+
+// Headless playtest: replays one difficulty of a chart through the tempo map
+// against a simulated player, many times with different seeds, and reports
+// how the runs were judged overall and per measure. Nothing waits on a
+// clock, so a run takes microseconds however long the song is.
+
+enum Difficulty { DIFFICULTY_HARD, DIFFICULTY_NORMAL, DIFFICULTY_EASY };
+const std::vector<std::string> difficulty_text{"hard", "normal", "easy"};
+
+enum Judgement { JUDGE_PERFECT, JUDGE_GREAT, JUDGE_GOOD, JUDGE_MISS };
+constexpr int JUDGEMENT_COUNT = 4;
+const std::vector<std::string> judgement_text{"perfect", "great", "good",
+                                              "miss"};
+
+enum MissReason {
+    // Outside the timing windows
+    MISS_TIMING,
+    // Hit in time, but flicked the wrong way
+    MISS_FLICK,
+    // Long note released early or late, or its start was missed
+    MISS_HOLD,
+    // The note's hand was still holding a long note
+    MISS_HAND_BUSY
+};
+constexpr int MISS_REASON_COUNT = 4;
+const std::vector<std::string> miss_reason_text{"timing", "flick", "hold",
+                                                "hand busy"};
+
+// Half-widths of the timing windows, in seconds
+struct JudgementWindows {
+    double perfect{0.033};
+    double great{0.066};
+    double good{0.100};
+    // A flick counts when its angle is this close to the arrow
+    double flick_tolerance_degrees{22.5};
+    // A long note counts when it is let go this close to its end
+    double release{0.100};
+};
+
+// Error of the simulated player. Sided notes are played by their own hand
+// and unsided ones by whichever hand is free first; a hand cannot tap again
+// sooner than `min_hand_interval` and cannot tap while it holds a long note.
+struct PlayerModel {
+    // Mean and spread of the tap timing error, in seconds; positive is late
+    double timing_bias{0.0};
+    double timing_sigma{0.025};
+    double flick_sigma_degrees{10.0};
+    double release_sigma{0.040};
+    double min_hand_interval{0.070};
+    // Deterministic error added to every tap, e.g. drifting late over the
+    // song; gets the note and its chart time
+    std::function<double(const Note &, double)> timing_script;
+};
+
+struct MeasureReport {
+    long measure{0};
+    // Per run
+    long notes{0};
+    // Summed over every run
+    long judgements[JUDGEMENT_COUNT]{};
+    long misses[MISS_REASON_COUNT]{};
+
+    double miss_rate(size_t runs) const;
+    MissReason main_miss_reason() const;
+};
+
+struct PlaytestReport {
+    Difficulty difficulty{DIFFICULTY_HARD};
+    long notes{0};
+    size_t runs{0};
+
+    // Weighted 1, 0.7, 0.3, 0 by judgement, averaged over the notes of a run
+    double mean_accuracy{0.0};
+    double accuracy_stddev{0.0};
+    // Runs without a miss
+    double full_combo_rate{0.0};
+    long judgements[JUDGEMENT_COUNT]{};
+
+    // Measures that hold notes, in order
+    std::vector<MeasureReport> measures;
+
+    // Chart time covered by all runs, and the wall time they took
+    double simulated_seconds{0.0};
+    double elapsed_seconds{0.0};
+
+    // Measures with the highest miss rate first; measures without misses
+    // are left out
+    std::vector<MeasureReport> hotspots(size_t count) const;
+};
+
+PlaytestReport playtest(Notechart &chart, Difficulty difficulty,
+                        const TempoMap &tempo_map,
+                        const JudgementWindows &windows,
+                        const PlayerModel &player, size_t runs, uint64_t seed,
+                        ThreadPool &pool);
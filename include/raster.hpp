@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Software rasterizer for the chart view. Colours are 0xAARRGGBB; the
+// framebuffer itself is always opaque.
+
+// Alpha coverage of a pre-rendered label, tinted with a single colour
+struct RasterMask {
+    int width{0}, height{0};
+    uint32_t colour{0};
+    std::vector<uint8_t> alpha;
+};
+
+// Opaque picture, scaled to its destination with nearest-neighbour sampling
+struct RasterImage {
+    int width{0}, height{0};
+    std::vector<uint32_t> pixels;
+};
+
+struct RasterCommand {
+    enum Kind { FILL_RECT, FILL_QUAD, MASK, IMAGE };
+
+    Kind kind;
+    uint32_t colour{0};
+    // FILL_RECT, MASK and IMAGE: top-left corner and size
+    int x{0}, y{0}, width{0}, height{0};
+    // FILL_QUAD: convex corners in drawing order
+    float xs[4]{}, ys[4]{};
+    std::shared_ptr<const RasterMask> mask;
+    std::shared_ptr<const RasterImage> image;
+    // Rows touched, inclusive, used to bin commands into tiles
+    int y_min{0}, y_max{0};
+};
+
+class DisplayList {
+   public:
+    void clear() { this->commands.clear(); }
+
+    void fill_rect(int x, int y, int width, int height, uint32_t colour);
+    void line(int x0, int y0, int x1, int y1, int thickness, uint32_t colour);
+    void mask(int x, int y, std::shared_ptr<const RasterMask> mask);
+    void image(int x, int y, int width, int height,
+               std::shared_ptr<const RasterImage> image);
+
+    std::vector<RasterCommand> commands;
+};
+
+struct Framebuffer {
+    int width{0}, height{0};
+    std::vector<uint32_t> pixels;
+
+    void resize(int _width, int _height);
+};
+
+// Splits the framebuffer into horizontal tiles, bins the display list into
+// them and rasterizes the tiles in parallel. Commands keep their order
+// within a tile, so the result matches drawing them one after another.
+class TiledRasterizer {
+   public:
+    explicit TiledRasterizer(ThreadPool &_pool, int _tile_height = 32);
+
+    void render(const DisplayList &list, Framebuffer &framebuffer);
+
+    // Pack into 8-bit RGB rows, as wxImage expects
+    void to_rgb(const Framebuffer &framebuffer, uint8_t *rgb);
+
+   private:
+    void render_tile(const DisplayList &list, Framebuffer &framebuffer,
+                     size_t tile);
+
+    ThreadPool &pool;
+    int tile_height;
+    std::vector<std::vector<uint32_t>> bins;
+};
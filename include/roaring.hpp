@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed bitmap of 32-bit values in the style of Roaring bitmaps. Values
+// are split by their high 16 bits into containers; a container keeps the
+// low halves as a sorted array while it holds at most 4096 of them and
+// switches to a 65536-bit bitset past that, so both sparse and dense sets
+// stay small and intersections run container by container.
+class RoaringBitmap {
+   public:
+    void add(uint32_t value);
+    // Returns false when the value was not in the set
+    bool remove(uint32_t value);
+    bool contains(uint32_t value) const;
+
+    size_t cardinality() const;
+    bool empty() const { return this->containers.empty(); }
+    void clear() { this->containers.clear(); }
+
+    RoaringBitmap operator&(const RoaringBitmap &other) const;
+    RoaringBitmap operator|(const RoaringBitmap &other) const;
+    // Values in this set and not in `other`
+    RoaringBitmap operator-(const RoaringBitmap &other) const;
+    RoaringBitmap &operator&=(const RoaringBitmap &other);
+    RoaringBitmap &operator|=(const RoaringBitmap &other);
+    RoaringBitmap &operator-=(const RoaringBitmap &other);
+
+    // Calls body(value) in increasing order
+    template <typename Body>
+    void for_each(Body body) const {
+        for (const Container &container : this->containers) {
+            uint32_t high = (uint32_t)container.key << 16;
+            if (container.is_bitset()) {
+                for (size_t word = 0; word < container.bits.size(); word++) {
+                    uint64_t bits = container.bits[word];
+                    while (bits != 0) {
+                        body(high | (uint32_t)(word * 64 +
+                                               __builtin_ctzll(bits)));
+                        bits &= bits - 1;
+                    }
+                }
+            } else {
+                for (uint16_t low : container.array) {
+                    body(high | low);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> to_vector() const;
+
+    // Heap footprint of the containers, in bytes
+    size_t memory_usage() const;
+
+   private:
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t BITSET_WORDS = 65536 / 64;
+
+    struct Container {
+        uint16_t key{0};
+        uint32_t cardinality{0};
+        // Exactly one of the two is in use
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool is_bitset() const { return !this->bits.empty(); }
+        bool contains(uint16_t low) const;
+        void to_bitset();
+        void to_array();
+    };
+
+    static Container intersect(const Container &a, const Container &b);
+    static Container unite(const Container &a, const Container &b);
+    static Container subtract(const Container &a, const Container &b);
+
+    // Index of the container for `key`, or of where it would go
+    size_t find(uint16_t key) const;
+
+    // Sorted by key, none of them empty
+    std::vector<Container> containers;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <vector>
+
+// Reference into a SlotMap: the slot index plus the generation the slot had
+// when the value was inserted. Erasing a value bumps its slot's generation,
+// so every handle issued for it stops resolving, even after the slot is
+// reused.
+struct SlotHandle {
+    uint32_t index{UINT32_MAX};
+    uint32_t generation{0};
+
+    bool operator==(const SlotHandle &other) const = default;
+    auto operator<=>(const SlotHandle &other) const = default;
+};
+
+// Dense array of slots with a free list: O(1) insert, erase and lookup
+// without hashing. Freed slots are reused lowest-index first after clear(),
+// most recently freed first otherwise.
+template <typename T>
+class SlotMap {
+   public:
+    SlotHandle insert(T value) {
+        uint32_t index;
+        if (!this->free_list.empty()) {
+            index = this->free_list.back();
+            this->free_list.pop_back();
+        } else {
+            index = (uint32_t)this->slots.size();
+            this->slots.emplace_back();
+        }
+
+        Slot &slot = this->slots[index];
+        slot.value = std::move(value);
+        slot.is_occupied = true;
+        this->occupied++;
+        return SlotHandle{index, slot.generation};
+    }
+
+    // Returns false when the handle is stale
+    bool erase(SlotHandle handle) {
+        if (this->get(handle) == nullptr) return false;
+
+        Slot &slot = this->slots[handle.index];
+        slot.value = T();
+        slot.is_occupied = false;
+        slot.generation++;
+        this->free_list.push_back(handle.index);
+        this->occupied--;
+        return true;
+    }
+
+    // nullptr when the handle is stale or was never issued
+    T *get(SlotHandle handle) {
+        if (handle.index >= this->slots.size()) return nullptr;
+
+        Slot &slot = this->slots[handle.index];
+        if (!slot.is_occupied || slot.generation != handle.generation) {
+            return nullptr;
+        }
+        return &slot.value;
+    }
+
+    // Current value of slot `index` whatever its generation; nullptr when
+    // the slot is free
+    T *at(uint32_t index) {
+        if (index >= this->slots.size() || !this->slots[index].is_occupied) {
+            return nullptr;
+        }
+        return &this->slots[index].value;
+    }
+
+    // Invalidate every handle and hand out slots from index 0 again
+    void clear() {
+        this->free_list.clear();
+        for (size_t index = this->slots.size(); index-- > 0;) {
+            Slot &slot = this->slots[index];
+            if (slot.is_occupied) {
+                slot.value = T();
+                slot.is_occupied = false;
+                slot.generation++;
+            }
+            this->free_list.push_back((uint32_t)index);
+        }
+        this->occupied = 0;
+    }
+
+    size_t size() const { return this->occupied; }
+
+    size_t memory_usage() const {
+        return this->slots.capacity() * sizeof(Slot) +
+               this->free_list.capacity() * sizeof(uint32_t);
+    }
+
+   private:
+    struct Slot {
+        T value{};
+        uint32_t generation{0};
+        bool is_occupied{false};
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_list;
+    size_t occupied{0};
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pcm.hpp"
+#include "raster.hpp"
+#include "tempo_map.hpp"
+#include "thread_pool.hpp"
+
+// Spectrogram of the song cut into one tile per measure, so it lines up with
+// the chart whatever the tempo does. Tiles are computed on a private worker
+// pool and kept in a least recently used cache with a memory budget; the UI
+// thread only schedules and looks up tiles and never waits on the FFT.
+struct SpectrogramTile {
+    // One row per tick of a 4/4 measure, and log-spaced frequency columns
+    static constexpr int ROWS = 192;
+    static constexpr int BINS = 96;
+
+    long measure{0};
+    // Row 0 is the last tick of the measure, so the tile draws top-down
+    std::shared_ptr<const RasterImage> image;
+};
+
+class SpectrogramCache {
+   public:
+    explicit SpectrogramCache(size_t _memory_budget = 64 * 1024 * 1024,
+                              size_t thread_count = 2);
+    ~SpectrogramCache();
+
+    SpectrogramCache(const SpectrogramCache &) = delete;
+    SpectrogramCache &operator=(const SpectrogramCache &) = delete;
+
+    // Decode the song in the background; tiles follow once it is ready
+    void open(const std::string &file_path);
+    void close();
+    bool is_open() const;
+
+    // Drop every tile, e.g. once the tempo map or the offset moved the song
+    // under the chart
+    void invalidate();
+
+    // Schedule the missing tiles of measures [first, last]. Queued tiles
+    // that have scrolled out of the latest requested range are skipped when
+    // a worker reaches them.
+    void request(long first, long last, const TempoMap &tempo_map,
+                 double offset);
+
+    // Null until the tile has been computed
+    std::shared_ptr<const SpectrogramTile> get(long measure);
+
+    // Move finished tiles into the cache; true when any arrived
+    bool collect();
+
+    // Bumped whenever the set of cached tiles changes
+    long revision() const { return this->current_revision; }
+
+    size_t size() const { return this->entries.size(); }
+    size_t memory_usage() const { return this->used_bytes; }
+    size_t pending() const;
+
+   private:
+    using Entry = std::shared_ptr<const SpectrogramTile>;
+
+    void compute(long measure, std::vector<double> row_seconds,
+                 long generation);
+    void insert(Entry tile);
+
+    // UI thread only. Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<long, std::list<Entry>::iterator> index;
+    size_t memory_budget;
+    size_t used_bytes{0};
+    long current_revision{0};
+
+    // Shared with the workers
+    mutable std::mutex mutex;
+    std::shared_ptr<const PcmBuffer> pcm;
+    std::set<long> scheduled;
+    std::vector<Entry> finished;
+    long generation{0};
+    std::atomic<long> wanted_first{0}, wanted_last{-1};
+
+    // Last member, so queued work drains before anything it touches goes
+    std::unique_ptr<ThreadPool> pool;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "notechart.hpp"
+#include "onset.hpp"
+#include "pcm.hpp"
+#include "thread_pool.hpp"
+
+struct TempoOptions {
+    double min_bpm{60.0};
+    double max_bpm{200.0};
+    // Local tempo is estimated over sliding windows of the onset envelope
+    double window_seconds{8.0};
+    double step_seconds{2.0};
+    // Relative tempo difference that starts a new segment
+    double change_tolerance{0.03};
+};
+
+// A stretch of constant tempo starting on a beat
+struct TempoSegment {
+    long tick;
+    double seconds;
+    double bpm;
+};
+
+struct TempoEstimate {
+    // Song offset that puts the first beat on tick 0 (see Canvas::offset)
+    double offset{0.0};
+    std::vector<TempoSegment> segments;
+    // Beat times in song seconds
+    std::vector<double> beats;
+};
+
+// Tempo from the autocorrelation of the onset envelope, beats from dynamic
+// programming over the envelope (Ellis 2007) with the local tempo as the
+// target period, then tempo segments from the beat intervals
+TempoEstimate detect_tempo(const PcmBuffer &mono, ThreadPool &pool,
+                           const TempoOptions &options = TempoOptions(),
+                           const OnsetOptions &onset_options = OnsetOptions());
+
+// One LANE_BPM note per segment
+std::vector<Note> tempo_to_notes(const TempoEstimate &estimate);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "notechart.hpp"
+
+// Converts between chart ticks and chart time using the LANE_BPM notes.
+// 192 ticks make a 4/4 measure, so a beat is 48 ticks. Song time is chart
+// time minus the song offset; the conversions here are offset-free.
+class TempoMap {
+   public:
+    explicit TempoMap(double _default_bpm = 140.0);
+
+    // Rebuild from the chart; before the first BPM note (or without any) the
+    // default tempo applies
+    void build(Notechart &chart);
+
+    double seconds_at(double tick) const;
+    double tick_at(double seconds) const;
+    double bpm_at(double tick) const;
+
+    double default_bpm;
+
+   private:
+    struct Segment {
+        double tick;
+        double bpm;
+        double seconds;
+    };
+
+    // Sorted by tick, the first one always at tick 0
+    std::vector<Segment> segments;
+};
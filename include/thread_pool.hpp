@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing thread pool. Every worker owns a deque: it pops
+// its own tasks from the back and, once empty, steals from the front of the
+// other workers' deques. Tasks submitted from a worker stay on that worker.
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished
+    void wait();
+
+    // Run body(i) for i in [begin, end), split into chunks of `grain`, and
+    // return once those chunks are done. Safe to call from a pool task: the
+    // calling worker runs queued tasks while it waits.
+    void parallel_for(size_t begin, size_t end, size_t grain,
+                      const std::function<void(size_t)> &body);
+
+    size_t size() const { return this->threads.size(); }
+
+   private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void run(size_t index);
+    bool pop_task(size_t index, std::function<void()> &task);
+    // Run a popped task and count it as finished
+    void run_task(std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex state_mutex;
+    std::condition_variable wake_condition;
+    std::condition_variable idle_condition;
+    size_t queued{0};
+    size_t pending{0};
+    bool is_stopping{false};
+
+    std::atomic<size_t> next_worker{0};
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pitch-preserving time stretch (WSOLA). Output is built from overlapping
+// Hann-windowed frames taken from the source at `rate` times the output
+// speed; each frame is shifted within a small tolerance to the position
+// that best continues the previous one, so the waveform stays coherent
+// without changing pitch.
+//
+// All buffers are sized by configure(); process() never allocates and is
+// safe to call from the audio callback.
+class TimeStretch {
+   public:
+    // Fill `frames` with up to `frame_count` interleaved frames and return
+    // how many were written; 0 means the source is exhausted
+    using Reader = size_t (*)(void *user_data, float *frames,
+                              size_t frame_count);
+
+    static constexpr double MIN_RATE = 0.25;
+    static constexpr double MAX_RATE = 2.0;
+
+    void configure(uint32_t _channels, uint32_t _sample_rate);
+
+    // Takes effect from the next frame boundary
+    void set_rate(double _rate);
+    double get_rate() const { return this->rate; }
+
+    // Restart at `source_frame`, e.g. after the reader has been seeked
+    void reset(long long source_frame);
+
+    // Returns frames written; less than `frame_count` only at the end
+    size_t process(float *output, size_t frame_count, Reader reader,
+                   void *user_data);
+
+    // Source frame that the next output frame corresponds to
+    double source_position() const;
+
+    uint32_t get_channels() const { return this->channels; }
+    uint32_t get_sample_rate() const { return this->sample_rate; }
+
+   private:
+    bool fill_input(long long begin, long long end, Reader reader,
+                    void *user_data);
+    bool produce_hop(Reader reader, void *user_data);
+    long long best_offset(long long target, long long nominal);
+    const float *frame_at(long long source_frame) const;
+
+    uint32_t channels{0}, sample_rate{0};
+    double rate{1.0};
+
+    // Frame length, hop and search tolerance in frames
+    size_t frame_size{0}, hop_size{0}, tolerance{0};
+    std::vector<float> window;
+
+    // Linear window over the source starting at `input_origin`
+    std::vector<float> input;
+    size_t input_capacity{0}, input_frames{0};
+    long long input_origin{0};
+
+    long long stream_start{0};
+    long long source_end{-1};
+    double nominal_position{0.0};
+    long long previous_position{0};
+
+    // Output of the last hop, drained by process()
+    std::vector<float> hop;
+    size_t hop_offset{0}, hop_frames{0};
+    double hop_source_position{0.0}, hop_rate{1.0};
+};
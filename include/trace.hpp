@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+// Scoped tracing that can be switched on at runtime and dumped as a
+// Chrome/Perfetto trace-event JSON file. Every thread appends to its own
+// buffer, so recording never takes a lock; when tracing is off a scope costs
+// a single relaxed atomic load.
+class Tracer {
+   public:
+    static void start();
+    static void stop();
+    static bool is_enabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Microseconds since the tracer was first used
+    static long long now();
+    static void record(const char *name, long long begin, long long end);
+
+    // Write every event recorded since the last start(); false when the
+    // file cannot be written
+    static bool dump(const std::string &file_path);
+
+   private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope {
+   public:
+    explicit TraceScope(const char *_name)
+        : name(_name), begin(Tracer::is_enabled() ? Tracer::now() : -1) {}
+    ~TraceScope() { this->end(); }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    // Close the scope early, before the end of the enclosing block
+    void end() {
+        if (this->begin >= 0) {
+            Tracer::record(this->name, this->begin, Tracer::now());
+            this->begin = -1;
+        }
+    }
+
+   private:
+    const char *name;
+    long long begin;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
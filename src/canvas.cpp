@@ -1,18 +1,26 @@
-#define MINIAUDIO_IMPLEMENTATION
 #include "../include/canvas.hpp"
 
 #include <fmt/format.h>
+#include <filesystem>
 #include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
 #include <wx/numdlg.h>
 
-#include <nlohmann/json.hpp>
-
-#include "../third_party/miniaudio.h"
-
-using json = nlohmann::json;
+#include "../include/chart_io.hpp"
+#include "../include/merge.hpp"
+#include "../include/trace.hpp"
 
 constexpr int COL_SIZE = 48;
 constexpr int NOTE_SIZE = 3;
+constexpr int SPECTROGRAM_X = COL_SIZE * 17;
+constexpr auto AUTOSAVE_INTERVAL = std::chrono::seconds(30);
+constexpr int OVERVIEW_WIDTH = COL_SIZE - 8;
+// Zoomed out to fewer pixels per measure than this, notes are drawn as
+// per-lane density bars
+constexpr int LOD_MEASURE_PIXELS = 192;
+// Notes in one lane and measure that fill a density bar
+constexpr int LOD_FULL_COUNT = 16;
+constexpr int MAX_ZOOM_OUT_SHIFT = 5;
 
 RenderTimer::RenderTimer(Canvas *pane) : wxTimer() { RenderTimer::pane = pane; }
 
@@ -36,27 +44,29 @@ std::vector<int> drawable_x_cells = {1,  3,  4,  5,  6,  7, 9,
 std::vector<int> tick_granularity = {1,  2,  4,  6,  8,  12, 16,
                                      24, 32, 48, 64, 96, 192};
 
+// 0 for hard, 1 for normal, 2 for easy, -1 for the other lanes
+static int lane_group(int lane) {
+    return (lane >= LANE_H1 && lane <= LANE_H5)   ? 0
+           : (lane >= LANE_N1 && lane <= LANE_N4) ? 1
+           : (lane >= LANE_E1 && lane <= LANE_E3) ? 2
+                                                  : -1;
+}
+
 Canvas::Canvas(wxFrame *parent) : wxPanel(parent) {
     this->chart = std::make_unique<Notechart>();
-    this->current_tick_double = 0;
-
-    // ma_result result;
 
-    // engine_config = ma_engine_config_init();
+    // Every pixel is repainted from the layers, so skip background erasing
+    SetBackgroundStyle(wxBG_STYLE_PAINT);
 
-    // result = ma_engine_init(&engine_config, &engine);
-    // if (result != MA_SUCCESS) {
-    //     return;
-    // }
+    this->overlay_font = wxFont{12, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL};
+    this->arrow_font = wxFont{32, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL};
+    this->measure_font = wxFont{128, wxFONTFAMILY_SWISS, wxNORMAL, wxBOLD};
+    this->current_tick_double = 0;
 
-    // result = ma_sound_init_from_file(
-    //     &engine,
-    //     "/Users/pnx/Documents/Project/Thapsteak/thapsteak_editor/audio/"
-    //     "audio.mp3",
-    //     0, NULL, NULL, &sound);
-    // if (result != MA_SUCCESS) {
-    //     return;
-    // }
+    // Nothing to autosave until the first edit
+    this->autosaved_chart = this->chart->snapshot();
+    this->published_chart.publish(this->autosaved_chart);
+    this->autosave_time = std::chrono::steady_clock::now();
 
     this->is_init = true;
 }
@@ -93,9 +103,11 @@ void Canvas::keyDown(wxKeyEvent &event) {
                 }
                 break;
             }
-            // Change row size
+            // Change row size, then zoom out past one pixel per tick
             case ']': {
-                if (this->current_row_size < 8) {
+                if (this->zoom_out_shift > 0) {
+                    this->zoom_out_shift--;
+                } else if (this->current_row_size < 8) {
                     this->current_row_size++;
                 }
                 break;
@@ -103,6 +115,8 @@ void Canvas::keyDown(wxKeyEvent &event) {
             case '[': {
                 if (this->current_row_size > 1) {
                     this->current_row_size--;
+                } else if (this->zoom_out_shift < MAX_ZOOM_OUT_SHIFT) {
+                    this->zoom_out_shift++;
                 }
                 break;
             }
@@ -110,86 +124,151 @@ void Canvas::keyDown(wxKeyEvent &event) {
             case 'F': {
                 long prompt =
                     wxGetNumberFromUser("Warp to", "", "", 0, 0, INT_MAX);
-                this->current_tick_double = prompt * 192.0;
+                this->warp_to(prompt * 192.0);
                 break;
             }
             // Flick
             case 'Z': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_RIGHT;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_RIGHT);
                 break;
             }
             case 'X': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_URIGHT;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_URIGHT);
                 break;
             }
             case 'C': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_UP;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_UP);
                 break;
             }
             case 'V': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_ULEFT;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_ULEFT);
                 break;
             }
             case 'B': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_LEFT;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_LEFT);
                 break;
             }
             case 'N': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->direction = DIR_NONE;
-                }
+                this->chart->set_direction(this->highlighted_notes, DIR_NONE);
                 break;
             }
             // Side
             case ',': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->side = SIDE_NONE;
-                }
+                this->chart->set_side(this->highlighted_notes, SIDE_NONE);
                 this->current_side = SIDE_NONE;
                 break;
             }
             case '.': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->side = SIDE_LEFT;
-                }
+                this->chart->set_side(this->highlighted_notes, SIDE_LEFT);
                 this->current_side = SIDE_LEFT;
                 break;
             }
             case '/': {
-                for (int note_id : this->highlighted_notes) {
-                    std::shared_ptr<Note> ptr_to_note =
-                        this->chart->note_index[note_id];
-                    ptr_to_note->side = SIDE_RIGHT;
-                }
+                this->chart->set_side(this->highlighted_notes, SIDE_RIGHT);
                 this->current_side = SIDE_RIGHT;
                 break;
             }
+            // Performance HUD
+            case 'P': {
+                this->is_perf_hud_shown = !this->is_perf_hud_shown;
+                break;
+            }
+            // Live preview link
+            case ';': {
+                if (this->live_preview.is_running()) {
+                    this->live_preview.stop();
+                } else if (!this->live_preview.start(
+                               default_preview_socket())) {
+                    wxMessageBox("Cannot listen on " + default_preview_socket(),
+                                 "Live preview");
+                }
+                break;
+            }
+            // Rendering backend
+            case 'R': {
+                this->is_software_rendering = !this->is_software_rendering;
+                break;
+            }
+            // Tracing
+            case 'O': {
+                if (!Tracer::is_enabled()) {
+                    Tracer::start();
+                    break;
+                }
+
+                Tracer::stop();
+
+                wxFileDialog trace_dialog(
+                    this, _("Save trace"), "", "trace.json",
+                    "Trace event files (*.json)|*.json",
+                    wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+                if (trace_dialog.ShowModal() == wxID_CANCEL) {
+                    break;
+                }
+
+                std::string file_path(trace_dialog.GetPath());
+                if (!Tracer::dump(file_path)) {
+                    wxMessageBox("Cannot write " + file_path, "Save trace");
+                }
+                break;
+            }
+            // Select the notes matching a filter, e.g. "hard right flick 40-60"
+            case 'D': {
+                wxString prompt = wxGetTextFromUser(
+                    "Lanes, sides, flicks, long/tap and measures", "Select");
+                std::string str_prompt(prompt);
+                if (str_prompt.empty()) {
+                    break;
+                }
+
+                NoteFilter filter;
+                if (!parse_note_filter(str_prompt, filter)) {
+                    wxMessageBox("Cannot parse " + str_prompt, "Select");
+                    break;
+                }
+
+                std::vector<NoteHandle> matches = this->chart->query(filter);
+                this->highlighted_notes =
+                    std::set<NoteHandle>(matches.begin(), matches.end());
+                break;
+            }
+            // Show or hide the hard, normal and easy lane groups
+            case '1':
+            case '2':
+            case '3': {
+                this->hidden_lane_groups ^= 1 << (uc - '1');
+                break;
+            }
+            // Bulk transforms
+            case 'M': {
+                if (!this->chart->mirror_notes(this->highlighted_notes)) {
+                    wxBell();
+                }
+                break;
+            }
+            case 'K': {
+                this->chart->swap_sides(this->highlighted_notes);
+                break;
+            }
+            case 'G': {
+                if (!this->chart->quantize_notes(
+                        this->highlighted_notes,
+                        192 / tick_granularity[tick_granularity_index])) {
+                    wxBell();
+                }
+                break;
+            }
+            case 'T': {
+                wxString prompt = wxGetTextFromUser("Time scale", "", "2.0");
+                std::string str_prompt(prompt);
+                double factor = std::atof(str_prompt.c_str());
+                if (!this->chart->scale_notes(this->highlighted_notes,
+                                              factor)) {
+                    wxBell();
+                }
+                break;
+            }
             // Import
             case 'I': {
                 wxFileDialog import_dialog(
@@ -201,74 +280,180 @@ void Canvas::keyDown(wxKeyEvent &event) {
                     break;
                 }
 
+                TRACE_SCOPE("Canvas::import");
+
                 std::string file_path(import_dialog.GetPath());
-                std::FILE *imported_file = std::fopen(file_path.c_str(), "rb");
-                std::fseek(imported_file, 0, SEEK_END);
-                long imported_file_size = std::ftell(imported_file);
-
-                std::string buffer;
-                buffer.resize(imported_file_size);
-
-                std::rewind(imported_file);
-                std::fread(buffer.data(), sizeof(uint32_t), imported_file_size,
-                           imported_file);
-
-                this->chart->notes.clear();
-
-                json data = json::parse(buffer);
-                for (auto &e : data["events"]) {
-                    Note new_note(0, LANE_NONE, DIR_NONE, SIDE_NONE, false);
-
-                    for (auto &[key, value] : e.items()) {
-                        if (key == "row") {
-                            new_note.tick = value;
-                        } else if (key == "channel") {
-                            if (value == "BPM") {
-                                new_note.lane = LANE_BPM;
-                            } else if (value == "H1") {
-                                new_note.lane = LANE_H1;
-                            } else if (value == "H2") {
-                                new_note.lane = LANE_H2;
-                            } else if (value == "H3") {
-                                new_note.lane = LANE_H3;
-                            } else if (value == "H4") {
-                                new_note.lane = LANE_H4;
-                            } else if (value == "H5") {
-                                new_note.lane = LANE_H5;
-                            } else if (value == "N1") {
-                                new_note.lane = LANE_N1;
-                            } else if (value == "N2") {
-                                new_note.lane = LANE_N2;
-                            } else if (value == "N3") {
-                                new_note.lane = LANE_N3;
-                            } else if (value == "N4") {
-                                new_note.lane = LANE_N4;
-                            } else if (value == "E1") {
-                                new_note.lane = LANE_E1;
-                            } else if (value == "E2") {
-                                new_note.lane = LANE_E2;
-                            } else if (value == "E3") {
-                                new_note.lane = LANE_E3;
-                            }
-                        } else if (key == "longNote") {
-                            new_note.is_longnote = value;
-                        } else if (key == "angle") {
-                            new_note.direction = value;
-                        } else if (key == "side") {
-                            if (value == "left") {
-                                new_note.side = SIDE_LEFT;
-                            } else if (value == "right") {
-                                new_note.side = SIDE_RIGHT;
-                            }
-                        } else if (key == "value") {
-                            new_note.value = value;
+                std::unique_ptr<Notechart> imported_chart =
+                    std::make_unique<Notechart>();
+                size_t dropped = 0;
+                if (!import_chart(file_path, *imported_chart, &dropped)) {
+                    wxMessageBox("Cannot import " + file_path, "Import JSON");
+                    break;
+                }
+                if (dropped > 0) {
+                    wxMessageBox(fmt::format("{} note(s) sharing a cell with "
+                                             "an earlier one were left out",
+                                             dropped),
+                                 "Import JSON");
+                }
+
+                imported_chart->update();
+                this->replace_chart(std::move(imported_chart));
+                break;
+            }
+            // Load the song
+            case 'L': {
+                wxFileDialog song_dialog(
+                    this, _("Open song"), "", "",
+                    "Audio files (*.mp3;*.wav;*.flac)|*.mp3;*.wav;*.flac",
+                    wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+
+                if (song_dialog.ShowModal() == wxID_CANCEL) {
+                    break;
+                }
+
+                std::string file_path(song_dialog.GetPath());
+                this->is_autoplay = false;
+                if (!this->playback.open(file_path)) {
+                    wxMessageBox("Cannot open " + file_path, "Open song");
+                    break;
+                }
+                this->song_path = file_path;
+                this->onsets.clear();
+                this->ghost_notes.clear();
+                break;
+            }
+            // Onset detection: analyze the song, or dismiss the ghost notes
+            case 'J': {
+                if (this->onset_job.valid()) {
+                    break;
+                }
+                if (!this->onsets.empty()) {
+                    this->onsets.clear();
+                    this->ghost_notes.clear();
+                    break;
+                }
+                if (this->song_path.empty()) {
+                    wxMessageBox("Open a song first", "Onset detection");
+                    break;
+                }
+
+                this->onset_job = std::async(
+                    std::launch::async, [file_path = this->song_path]() {
+                        PcmBuffer pcm;
+                        if (!decode_audio(file_path, 1, 44100, pcm)) {
+                            return std::vector<Onset>();
                         }
-                    }
+                        ThreadPool pool;
+                        return detect_onsets(pcm, pool);
+                    });
+                break;
+            }
+            // Estimate the tempo, tempo changes and offset of the song
+            case 'E': {
+                if (this->tempo_job.valid()) {
+                    break;
+                }
+                if (this->song_path.empty()) {
+                    wxMessageBox("Open a song first", "Tempo detection");
+                    break;
+                }
 
-                    this->chart->add_note(new_note);
+                this->tempo_job = std::async(
+                    std::launch::async, [file_path = this->song_path]() {
+                        PcmBuffer pcm;
+                        if (!decode_audio(file_path, 1, 44100, pcm)) {
+                            return TempoEstimate();
+                        }
+                        ThreadPool pool;
+                        return detect_tempo(pcm, pool);
+                    });
+                break;
+            }
+            // Show or hide the spectrogram column
+            case 'H': {
+                this->is_spectrogram_shown = !this->is_spectrogram_shown;
+                break;
+            }
+            // Accept every ghost note
+            case 'A': {
+                if (this->ghost_notes.empty()) {
+                    break;
+                }
+                this->chart->add_notes(this->ghost_notes);
+                this->onsets.clear();
+                this->ghost_notes.clear();
+                break;
+            }
+            // Playback rate: 1x, 0.75x, 0.5x
+            case 'Y': {
+                double rate = this->playback.get_rate();
+                this->playback.set_rate(rate > 0.875  ? 0.75
+                                        : rate > 0.625 ? 0.5
+                                                       : 1.0);
+                break;
+            }
+            // Merge: the open chart is "ours"
+            case 'U': {
+                wxFileDialog base_dialog(
+                    this, _("Merge: common base"), "", "",
+                    "Thapsteak files (*.thapsteak)|*.thapsteak",
+                    wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+                if (base_dialog.ShowModal() == wxID_CANCEL) {
+                    break;
+                }
+                wxFileDialog theirs_dialog(
+                    this, _("Merge: their chart"), "", "",
+                    "Thapsteak files (*.thapsteak)|*.thapsteak",
+                    wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+                if (theirs_dialog.ShowModal() == wxID_CANCEL) {
+                    break;
+                }
+
+                std::string base_path(base_dialog.GetPath());
+                std::string theirs_path(theirs_dialog.GetPath());
+                Notechart base, theirs;
+                size_t base_dropped = 0, theirs_dropped = 0;
+                if (!import_chart(base_path, base, &base_dropped) ||
+                    !import_chart(theirs_path, theirs, &theirs_dropped)) {
+                    wxMessageBox("Cannot import the charts to merge", "Merge");
+                    break;
+                }
+
+                std::unique_ptr<Notechart> merged =
+                    std::make_unique<Notechart>();
+                std::vector<MergeConflict> conflicts =
+                    merge_charts(base, *this->chart, theirs, *merged);
+                this->replace_chart(std::move(merged));
+
+                // Select the conflicting notes for review
+                size_t conflict_idx = 0;
+                for (std::shared_ptr<Note> &note : this->chart->notes) {
+                    while (conflict_idx < conflicts.size() &&
+                           std::make_pair(conflicts[conflict_idx].tick,
+                                          conflicts[conflict_idx].lane) <
+                               std::make_pair(note->tick, note->lane)) {
+                        conflict_idx++;
+                    }
+                    if (conflict_idx < conflicts.size() &&
+                        conflicts[conflict_idx].tick == note->tick &&
+                        conflicts[conflict_idx].lane == note->lane) {
+                        this->highlighted_notes.insert(note->id);
+                    }
                 }
 
-                std::fclose(imported_file);
+                wxMessageBox(fmt::format("{} notes merged, {} conflict(s) "
+                                         "selected{}",
+                                         this->chart->notes.size(),
+                                         conflicts.size(),
+                                         base_dropped + theirs_dropped > 0
+                                             ? fmt::format(
+                                                   "; {} duplicated cell(s) "
+                                                   "dropped on load",
+                                                   base_dropped +
+                                                       theirs_dropped)
+                                             : ""),
+                             "Merge");
                 break;
             }
             case 'S': {
@@ -281,13 +466,14 @@ void Canvas::keyDown(wxKeyEvent &event) {
                     break;
                 }
 
-                std::string content = this->chart->to_string();
+                TRACE_SCOPE("Canvas::export");
 
                 std::string file_path(export_dialog.GetPath());
-                std::FILE *exported_file = std::fopen(file_path.c_str(), "w");
-                std::fwrite(content.data(), sizeof(char), content.size(),
-                            exported_file);
-                std::fclose(exported_file);
+                if (!export_chart(file_path, *this->chart)) {
+                    wxMessageBox("Cannot export " + file_path, "Export JSON");
+                } else {
+                    this->chart->update();
+                }
 
                 break;
             }
@@ -298,14 +484,26 @@ void Canvas::keyDown(wxKeyEvent &event) {
         // Delete notes
         case WXK_BACK:
         case WXK_DELETE: {
-            for (int note_id : this->highlighted_notes) {
-                this->chart->notes.erase(
-                    std::remove_if(this->chart->notes.begin(),
-                                   this->chart->notes.end(),
-                                   [note_id](const std::shared_ptr<Note> &n) {
-                                       return note_id == n->id;
-                                   }),
-                    this->chart->notes.end());
+            this->chart->remove_notes(this->highlighted_notes);
+            this->highlighted_notes.clear();
+            break;
+        }
+        // Shift selected notes by one cell
+        case WXK_UP: {
+            // Refused when a note would land on an occupied cell
+            if (!this->chart->shift_notes(
+                    this->highlighted_notes,
+                    192 / tick_granularity[tick_granularity_index])) {
+                wxBell();
+            }
+            break;
+        }
+        case WXK_DOWN: {
+            // Refused when a note would land on an occupied cell
+            if (!this->chart->shift_notes(
+                    this->highlighted_notes,
+                    -192 / tick_granularity[tick_granularity_index])) {
+                wxBell();
             }
             break;
         }
@@ -318,25 +516,18 @@ void Canvas::keyDown(wxKeyEvent &event) {
         case WXK_SPACE: {
             this->is_autoplay = !this->is_autoplay;
 
-            // if (this->is_autoplay) {
-            //     // Play audio
-            //     double beats = this->current_tick_double / 192 * 4;
-            //     double milliseconds = (beats * 60.0 * 1000.0) / this->BPM;
-            //     milliseconds -= offset * 1000.0;
+            if (this->is_autoplay) {
+                // Play audio from the current row
+                this->update_tempo_map();
+                double seconds =
+                    this->tempo_map.seconds_at(this->current_tick_double);
+                seconds -= offset;
 
-            //     unsigned int sample_rate = ma_engine_get_sample_rate(&engine);
-            //     double fpms = (double)sample_rate / (double)1000.0;
-
-            //     ma_sound_seek_to_pcm_frame(&sound, (int)(fpms * milliseconds));
-
-            //     // float seconds = 0.0;
-            //     // ma_sound_get_cursor_in_seconds(&sound, &seconds);
-            //     // printf("%f %f\n", milliseconds / 1000.0, seconds);
-
-            //     ma_sound_start(&sound);
-            // } else {
-            //     ma_sound_stop(&sound);
-            // }
+                this->playback.seek(seconds);
+                this->playback.start();
+            } else {
+                this->playback.stop();
+            }
 
             break;
         }
@@ -359,7 +550,25 @@ void Canvas::keyUp(wxKeyEvent &event) {
 }
 
 void Canvas::mouseDown(wxMouseEvent &event) {
+    // Overview strip: warp so the clicked point of the song is mid-screen
+    if (this->current_x < OVERVIEW_WIDTH && this->overview_snapshot &&
+        this->overview_snapshot->measure_count() > 0) {
+        double tick = (double)(this->height - this->current_y) /
+                      this->height *
+                      this->overview_snapshot->measure_count() * 192.0;
+        long half_screen = (this->tick_at(this->height, 0, 0) -
+                            this->tick_at(this->height, 0, this->height)) /
+                           2;
+        this->warp_to(std::max(tick - half_screen, 0.0));
+        return;
+    }
+
     if (mode == Mode::MODE_CREATE) {
+        // Notes are too small to place by hand from this far out
+        if (this->is_lod()) {
+            return;
+        }
+
         int current_tick = (int)this->current_tick_double;
 
         int cell_range_in_ticks =
@@ -394,7 +603,7 @@ void Canvas::mouseDown(wxMouseEvent &event) {
         bool is_dragging = false;
         if (this->highlighted_notes.size() == 1) {
             // int note_id = this->highlighted_notes.begin().next();
-            // std::shared_ptr<Note> note = this->chart->note_index[note_id];
+            // std::shared_ptr<Note> note = this->chart->find_note(note_id);
 
             // Check if this note is on the mouse cursor?
         }
@@ -417,14 +626,20 @@ void Canvas::mouseUp(wxMouseEvent &event) {
 void Canvas::mouseWheel(wxMouseEvent &event) {
     if (event.GetWheelRotation() != 0) {
         this->is_autoplay = false;
-        // ma_sound_stop(&sound);
-        this->current_tick_double += event.GetWheelRotation();
+        this->playback.stop();
+        this->current_tick_double +=
+            event.GetWheelRotation() * this->ticks_per_pixel();
         if (this->current_tick_double < 0) this->current_tick_double = 0;
+
+        // Let the song under the cursor line be heard while scrolling
+        this->playback.scrub(
+            this->tempo_map.seconds_at(this->current_tick_double) -
+            this->offset);
     }
 }
 
 void Canvas::paintEvent(wxPaintEvent &evt) {
-    wxPaintDC dc(this);
+    wxAutoBufferedPaintDC dc(this);
     dc.GetSize(&(this->width), &(this->height));
     render(dc);
 }
@@ -435,21 +650,475 @@ void Canvas::paintNow() {
 }
 
 void Canvas::render(wxDC &dc) {
+    std::chrono::time_point<std::chrono::steady_clock> frame_start =
+        std::chrono::steady_clock::now();
     std::chrono::duration<double> delta_time =
-        std::chrono::steady_clock::now() - this->latest_update_time;
+        frame_start - this->latest_update_time;
+
+    this->frame_stats.begin_frame();
     // 1 frame per second = 1 second per frame
     this->update_frame(dc, (1.0 / 60.0) - delta_time.count());
+    if (this->latest_update_time.time_since_epoch().count() != 0) {
+        this->frame_stats.end_frame(delta_time.count());
+    }
 
-    this->latest_update_time = std::chrono::steady_clock::now();
+    this->latest_update_time = frame_start;
 }
 
-void Canvas::update_frame(wxDC &dc, double delta_time) {
-    wxCoord width, height;
-    dc.GetSize(&width, &height);
+void Canvas::draw_label(CountingDC &dc, const std::string &text,
+                        const wxFont &font, const wxColour &colour, wxCoord x,
+                        wxCoord y, double angle) {
+    const LabelCache::Label &label =
+        this->label_cache.get(text, font, colour, angle);
+    dc.DrawBitmap(label.bitmap, x + label.offset_x, y + label.offset_y, true);
+}
 
-    // Scroll
-    int current_tick = (int)current_tick_double;
+void Canvas::draw_label(DisplayListDC &dc, const std::string &text,
+                        const wxFont &font, const wxColour &colour, wxCoord x,
+                        wxCoord y, double angle) {
+    dc.DrawLabel(this->label_cache.get(text, font, colour, angle), x, y);
+}
+
+wxRect Canvas::selection_rect() {
+    int x1 = std::min(this->highlight_x, this->current_x);
+    int x2 = std::max(this->highlight_x, this->current_x);
+    int y1 = std::min(this->highlight_y, this->current_y);
+    int y2 = std::max(this->highlight_y, this->current_y);
+
+    return wxRect(x1, y1, x2 - x1, y2 - y1);
+}
+
+long Canvas::tick_at(wxCoord height, int current_tick, int screen_y) {
+    if (this->zoom_out_shift > 0) {
+        return current_tick + (long)(height - screen_y) * this->ticks_per_pixel();
+    }
+    return current_tick + (height - screen_y) / this->current_row_size;
+}
 
+bool Canvas::is_lod() const {
+    return 192 * this->current_row_size / this->ticks_per_pixel() <
+           LOD_MEASURE_PIXELS;
+}
+
+void Canvas::warp_to(double tick) {
+    this->current_tick_double = tick;
+
+    double seconds = this->tempo_map.seconds_at(tick) - this->offset;
+    if (this->playback.is_playing()) {
+        this->playback.seek(seconds);
+    } else {
+        this->playback.scrub(seconds);
+    }
+}
+
+void Canvas::replace_chart(std::unique_ptr<Notechart> new_chart) {
+    this->chart = std::move(new_chart);
+    this->highlighted_notes.clear();
+
+    this->is_content_drawn = false;
+    this->tempo_map_chart_version = -1;
+    this->shown_notes_version = -1;
+}
+
+void Canvas::update_tempo_detection() {
+    if (!this->tempo_job.valid() ||
+        this->tempo_job.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+        return;
+    }
+
+    TempoEstimate estimate = this->tempo_job.get();
+    if (estimate.segments.empty()) {
+        return;
+    }
+
+    // The detected tempo map replaces the charted one
+    std::set<NoteHandle> bpm_notes;
+    for (std::shared_ptr<Note> &note : this->chart->notes) {
+        if (note->lane == LANE_BPM) {
+            bpm_notes.insert(note->id);
+        }
+    }
+    this->chart->remove_notes(bpm_notes);
+    this->chart->add_notes(tempo_to_notes(estimate));
+    this->highlighted_notes.clear();
+
+    this->BPM = estimate.segments.front().bpm;
+    this->offset = estimate.offset;
+}
+
+void Canvas::update_tempo_map() {
+    if (this->tempo_map_chart_version == this->chart->version() &&
+        this->tempo_map.default_bpm == this->BPM) {
+        return;
+    }
+
+    this->tempo_map.default_bpm = this->BPM;
+    this->tempo_map.build(*this->chart);
+    this->tempo_map_chart_version = this->chart->version();
+    this->tempo_map_version++;
+}
+
+void Canvas::update_snapshot() {
+    // Returns the previous snapshot when nothing changed
+    std::shared_ptr<const ChartSnapshot> snapshot = this->chart->snapshot();
+    if (snapshot != this->published_chart.load()) {
+        this->published_chart.publish(std::move(snapshot));
+    }
+}
+
+void Canvas::update_live_preview() {
+    if (!this->live_preview.is_running()) return;
+
+    PreviewTransport transport;
+    transport.bpm = this->BPM;
+    transport.offset = this->offset;
+    transport.tick = this->current_tick_double;
+    transport.song_seconds =
+        this->playback.is_open()
+            ? this->playback.position()
+            : this->tempo_map.seconds_at(this->current_tick_double) -
+                  this->offset;
+    transport.is_playing = this->is_autoplay;
+    this->live_preview.publish(this->published_chart.load(), transport);
+}
+
+void Canvas::update_autosave() {
+    auto now = std::chrono::steady_clock::now();
+
+    if (this->autosave_job.valid()) {
+        if (this->autosave_job.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            return;
+        }
+        // A failed write is retried at the next interval
+        if (std::shared_ptr<const ChartSnapshot> saved =
+                this->autosave_job.get()) {
+            this->autosaved_chart = std::move(saved);
+        }
+        this->autosave_time = now;
+    }
+
+    // Edits that came back to the saved content need no new save
+    if (now - this->autosave_time < AUTOSAVE_INTERVAL ||
+        this->published_chart.load()->digest() ==
+            this->autosaved_chart->digest()) {
+        return;
+    }
+
+    // The worker reads whatever is published when it runs; the chart itself
+    // keeps being edited meanwhile
+    std::error_code error;
+    std::filesystem::path file_path =
+        std::filesystem::temp_directory_path(error) /
+        "thapsteak-autosave.thapsteak";
+    this->autosave_job = std::async(
+        std::launch::async,
+        [channel = &this->published_chart, file_path = file_path.string()]() {
+            TRACE_SCOPE("Canvas::autosave");
+
+            std::shared_ptr<const ChartSnapshot> snapshot = channel->load();
+            if (!snapshot || !write_file(file_path, snapshot->to_string())) {
+                return std::shared_ptr<const ChartSnapshot>();
+            }
+            return snapshot;
+        });
+}
+
+void Canvas::update_ghost_notes() {
+    // Collect a finished analysis
+    if (this->onset_job.valid() &&
+        this->onset_job.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready) {
+        this->onsets = this->onset_job.get();
+        this->ghost_granularity_index = -1;
+    }
+
+    if (this->onsets.empty() ||
+        (this->ghost_tempo_version == this->tempo_map_version &&
+         this->ghost_granularity_index == this->tick_granularity_index)) {
+        return;
+    }
+
+    this->ghost_notes = onsets_to_notes(
+        this->onsets, this->tempo_map, this->offset,
+        192 / tick_granularity[this->tick_granularity_index]);
+    this->ghost_tempo_version = this->tempo_map_version;
+    this->ghost_granularity_index = this->tick_granularity_index;
+}
+
+void Canvas::update_spectrogram(wxCoord height, int current_tick) {
+    // Tiles are not worth fetching when a measure is a few pixels tall
+    if (!this->is_spectrogram_shown || this->is_lod()) {
+        return;
+    }
+
+    if (this->spectrogram_song_path != this->song_path) {
+        this->spectrogram_song_path = this->song_path;
+        if (this->song_path.empty()) {
+            this->spectrogram.close();
+        } else {
+            this->spectrogram.open(this->song_path);
+        }
+    }
+
+    // Tiles are cut by measure, so a tempo or offset change moves the song
+    // under every one of them
+    if (this->spectrogram_tempo_version != this->tempo_map_version ||
+        this->spectrogram_offset != this->offset) {
+        this->spectrogram.invalidate();
+        this->spectrogram_tempo_version = this->tempo_map_version;
+        this->spectrogram_offset = this->offset;
+    }
+
+    this->spectrogram.collect();
+
+    long first = this->tick_at(height, current_tick, height) /
+                 SpectrogramTile::ROWS;
+    long last = this->tick_at(height, current_tick, 0) / SpectrogramTile::ROWS;
+    this->spectrogram.request(first, last, this->tempo_map, this->offset);
+
+    // Keep bitmaps for what is on screen only
+    if (this->spectrogram_row_size != this->current_row_size) {
+        this->spectrogram_bitmaps.clear();
+        this->spectrogram_row_size = this->current_row_size;
+    }
+    std::erase_if(this->spectrogram_bitmaps, [first, last](const auto &entry) {
+        return entry.first < first || entry.first > last;
+    });
+}
+
+template <typename DC>
+void Canvas::draw_spectrogram(DC &dc, wxCoord height, int current_tick,
+                              int y_min, int y_max) {
+    if (!this->is_spectrogram_shown || this->is_lod()) {
+        return;
+    }
+
+    TRACE_SCOPE("update_frame/spectrogram");
+
+    long first = this->tick_at(height, current_tick, y_max) /
+                 SpectrogramTile::ROWS;
+    long last = this->tick_at(height, current_tick, y_min) /
+                SpectrogramTile::ROWS;
+    for (long measure = std::max(first, 0L); measure <= last; measure++) {
+        std::shared_ptr<const SpectrogramTile> tile =
+            this->spectrogram.get(measure);
+        if (!tile) {
+            continue;
+        }
+
+        int y_position = height - (((measure + 1) * SpectrogramTile::ROWS -
+                                    current_tick) *
+                                   this->current_row_size);
+        this->draw_spectrogram_tile(dc, tile, SPECTROGRAM_X, y_position);
+    }
+}
+
+void Canvas::draw_spectrogram_tile(
+    CountingDC &dc, const std::shared_ptr<const SpectrogramTile> &tile,
+    wxCoord x, wxCoord y) {
+    auto &[cached_tile, bitmap] = this->spectrogram_bitmaps[tile->measure];
+    if (cached_tile != tile) {
+        const RasterImage &source = *tile->image;
+        wxImage image(source.width, source.height, false);
+        unsigned char *rgb = image.GetData();
+        for (size_t i = 0; i < source.pixels.size(); i++) {
+            rgb[i * 3 + 0] = (source.pixels[i] >> 16) & 0xff;
+            rgb[i * 3 + 1] = (source.pixels[i] >> 8) & 0xff;
+            rgb[i * 3 + 2] = source.pixels[i] & 0xff;
+        }
+
+        cached_tile = tile;
+        bitmap = wxBitmap(image.Scale(source.width,
+                                      source.height * this->current_row_size));
+    }
+    dc.DrawBitmap(bitmap, x, y);
+}
+
+void Canvas::draw_spectrogram_tile(
+    DisplayListDC &dc, const std::shared_ptr<const SpectrogramTile> &tile,
+    wxCoord x, wxCoord y) {
+    dc.DrawImage(tile->image, x, y, tile->image->width,
+                 tile->image->height * this->current_row_size);
+}
+
+void Canvas::draw_ghost_notes(CountingDC &dc, wxCoord height,
+                              int current_tick) {
+    if (this->ghost_notes.empty() || this->is_lod()) {
+        return;
+    }
+
+    long tick_lo = this->tick_at(height, current_tick, height) - 1;
+    long tick_hi = this->tick_at(height, current_tick, 0) + 1;
+    auto first = std::lower_bound(
+        this->ghost_notes.begin(), this->ghost_notes.end(), tick_lo,
+        [](const Note &note, long tick) { return note.tick < tick; });
+
+    dc.SetPen(wxPen(wxColor(128, 128, 128, 127), 1));
+    dc.SetBrush(wxColor(160, 160, 160, 96));
+    for (auto it = first; it != this->ghost_notes.end() && it->tick <= tick_hi;
+         it++) {
+        int y_position =
+            height - ((it->tick - current_tick) * this->current_row_size) -
+            (NOTE_SIZE * 6);
+        dc.DrawRectangle(it->lane * COL_SIZE, y_position, COL_SIZE + 1,
+                         (NOTE_SIZE * 6) + 1);
+    }
+}
+
+void Canvas::update_overview(wxCoord height) {
+    std::shared_ptr<const ChartSnapshot> snapshot = this->chart->snapshot();
+    // Same notes, same strip, whatever the edits in between
+    if (this->overview_snapshot &&
+        snapshot->digest() == this->overview_snapshot->digest() &&
+        this->overview_bitmap.IsOk() &&
+        this->overview_bitmap.GetHeight() == height) {
+        return;
+    }
+
+    TRACE_SCOPE("update_frame/overview");
+
+    this->overview_snapshot = snapshot;
+    long measure_count = snapshot->measure_count();
+    if (measure_count == 0) {
+        this->overview_bitmap = wxBitmap();
+        return;
+    }
+
+    // Busiest measure under each pixel row, the song starting at the bottom
+    std::vector<uint32_t> row_counts(height, 0);
+    for (const std::shared_ptr<const MeasureNotes> &measure :
+         snapshot->measures()) {
+        uint32_t count = 0;
+        for (int lane = LANE_H1; lane <= LANE_E3; lane++) {
+            count += measure->lane_counts[lane];
+        }
+        long row_begin = height - (measure->measure + 1) * height / measure_count;
+        long row_end = height - measure->measure * height / measure_count;
+        for (long row = row_begin; row < std::max(row_end, row_begin + 1);
+             row++) {
+            if (row >= 0 && row < height) {
+                row_counts[row] = std::max(row_counts[row], count);
+            }
+        }
+    }
+
+    wxImage image(OVERVIEW_WIDTH, height, false);
+    unsigned char *rgb = image.GetData();
+    for (int row = 0; row < height; row++) {
+        // Four full lanes' worth of notes is the darkest shade
+        double density = std::min(
+            (double)row_counts[row] / (LOD_FULL_COUNT * 4), 1.0);
+        unsigned char red = (unsigned char)(255 - 159 * density);
+        unsigned char blue = (unsigned char)(255 - 95 * density);
+        for (int x = 0; x < OVERVIEW_WIDTH; x++) {
+            unsigned char *pixel = rgb + ((size_t)row * OVERVIEW_WIDTH + x) * 3;
+            pixel[0] = red;
+            pixel[1] = red;
+            pixel[2] = blue;
+        }
+    }
+    this->overview_bitmap = wxBitmap(image);
+}
+
+void Canvas::draw_overview(CountingDC &dc, wxCoord height, int current_tick) {
+    if (!this->overview_bitmap.IsOk()) {
+        return;
+    }
+
+    dc.DrawBitmap(this->overview_bitmap, 0, 0);
+
+    // Outline the part of the song on screen
+    double rows_per_tick =
+        (double)height / (this->overview_snapshot->measure_count() * 192);
+    int y_top = height - (int)(this->tick_at(height, current_tick, 0) *
+                               rows_per_tick);
+    int y_bottom = height - (int)(this->tick_at(height, current_tick, height) *
+                                  rows_per_tick);
+    dc.SetPen(wxPen(wxColor(64, 64, 64), 1));
+    dc.SetBrush(*wxTRANSPARENT_BRUSH);
+    dc.DrawRectangle(0, y_top, OVERVIEW_WIDTH, std::max(y_bottom - y_top, 2));
+}
+
+void Canvas::update_lane_filter() {
+    if (this->hidden_lane_groups == 0 ||
+        (this->shown_notes_version == this->chart->version() &&
+         this->shown_notes_mask == this->hidden_lane_groups)) {
+        return;
+    }
+
+    TRACE_SCOPE("update_frame/lane_filter");
+
+    const std::vector<std::vector<Lane>> lane_groups{
+        {LANE_H1, LANE_H2, LANE_H3, LANE_H4, LANE_H5},
+        {LANE_N1, LANE_N2, LANE_N3, LANE_N4},
+        {LANE_E1, LANE_E2, LANE_E3}};
+
+    // BPM notes stay visible whatever is hidden
+    NoteFilter filter;
+    filter.lanes.push_back(LANE_BPM);
+    for (size_t group = 0; group < lane_groups.size(); group++) {
+        if (!(this->hidden_lane_groups & (1 << group))) {
+            filter.lanes.insert(filter.lanes.end(), lane_groups[group].begin(),
+                                lane_groups[group].end());
+        }
+    }
+
+    this->shown_notes = this->chart->match(filter);
+    this->shown_notes_version = this->chart->version();
+    this->shown_notes_mask = this->hidden_lane_groups;
+}
+
+bool Canvas::is_note_shown(const Note &note) {
+    return this->hidden_lane_groups == 0 ||
+           this->shown_notes.contains(note.id.index);
+}
+
+void Canvas::update_highlight(wxCoord height, int current_tick) {
+    if (!this->is_highlighted) {
+        return;
+    }
+
+    wxRect rect = this->selection_rect();
+    int x1 = rect.x, x2 = rect.x + rect.width;
+    int y1 = rect.y, y2 = rect.y + rect.height;
+
+    // Only notes on screen can be under the selection rectangle
+    this->highlighted_notes = std::set<NoteHandle>();
+    long tick_lo = this->tick_at(height, current_tick, height) - 1;
+    long tick_hi = this->tick_at(height, current_tick, 0) + 1;
+    bool is_lod = this->is_lod();
+    if (is_lod) {
+        // Density bars have no note rectangles; take every note in the
+        // swept ticks instead
+        tick_lo = this->tick_at(height, current_tick, y2);
+        tick_hi = this->tick_at(height, current_tick, y1);
+    }
+    for (size_t idx = this->chart->lower_bound_tick(tick_lo);
+         idx < this->chart->notes.size() &&
+         this->chart->notes[idx]->tick <= tick_hi;
+         idx++) {
+        std::shared_ptr<Note> note(this->chart->notes[idx]);
+        if (!this->is_note_shown(*note)) {
+            continue;
+        }
+
+        int x_position = note->lane * COL_SIZE;
+        int y_position =
+            height - ((note->tick - current_tick) * this->current_row_size) -
+            (NOTE_SIZE * 6);
+
+        if (x_position > x1 - (COL_SIZE + 1) && x_position < x2 &&
+            (is_lod || (y_position > y1 - ((NOTE_SIZE * 6) + 1) &&
+                        y_position < y2))) {
+            this->highlighted_notes.insert(note->id);
+        }
+    }
+}
+
+template <typename DC>
+void Canvas::draw_background(DC &dc, wxCoord width, wxCoord height) {
     // Clear the previous frame
     dc.SetBackground(*wxWHITE_BRUSH);
     dc.Clear();
@@ -477,11 +1146,22 @@ void Canvas::update_frame(wxDC &dc, double delta_time) {
     for (int col = 0; col < 19; col++) {
         dc.DrawLine(col * COL_SIZE, 0, col * COL_SIZE, height);
     }
+}
+
+template <typename DC>
+void Canvas::draw_grid(DC &dc, wxCoord width, wxCoord height, int current_tick,
+                       int y_min, int y_max) {
+    TRACE_SCOPE("update_frame/grid");
 
     // 1 row = 1/192 room
     // 1 note = 1/32 room
-    for (int screen_y = height; screen_y >= 0;
-         screen_y -= this->current_row_size) {
+    // Only the rows whose lines or measure labels can reach the band
+    int row_begin =
+        std::max((height - y_max - 256) / this->current_row_size, 0);
+    int row_end = std::min((height - y_min + 256) / this->current_row_size,
+                           height / this->current_row_size);
+    for (int row = row_begin; row <= row_end; row++) {
+        int screen_y = height - row * this->current_row_size;
         int y = screen_y - (current_tick * this->current_row_size);
 
         if (tick_granularity[tick_granularity_index] % 192 == 0) {
@@ -564,200 +1244,415 @@ void Canvas::update_frame(wxDC &dc, double delta_time) {
         }
 
         if ((height - y - 96) % (this->current_row_size * 192) == 0) {
-            dc.SetFont(wxFont{128, wxFONTFAMILY_SWISS, wxNORMAL, wxBOLD});
-            dc.SetTextForeground(wxColor(224, 224, 224));
-            dc.DrawText(
-                wxT("#" +
-                    fmt::format("{:03d}",
-                                (height - y) / (this->current_row_size * 192))),
-                width - 320, screen_y - 128 + 96);
+            this->draw_label(
+                dc,
+                fmt::format("#{:03d}",
+                            (height - y) / (this->current_row_size * 192)),
+                this->measure_font, wxColor(224, 224, 224), width - 320,
+                screen_y - 128 + 96);
         } else if ((height - y) % (this->current_row_size * 192) == 0) {
-            dc.SetFont(wxFont{128, wxFONTFAMILY_SWISS, wxNORMAL, wxBOLD});
-            dc.SetTextForeground(wxColor(224, 224, 224));
-            dc.DrawText(
-                wxT("#" +
-                    fmt::format("{:03d}",
-                                (height - y) / (this->current_row_size * 192))),
-                width - 320, screen_y - 128);
+            this->draw_label(
+                dc,
+                fmt::format("#{:03d}",
+                            (height - y) / (this->current_row_size * 192)),
+                this->measure_font, wxColor(224, 224, 224), width - 320,
+                screen_y - 128);
         }
     }
 
-    // Reset the highlight set
-    int x1, x2, y1, y2;
-    if (this->is_highlighted) {
-        this->highlighted_notes = std::set<int>();
-        x1 = this->highlight_x;
-        x2 = this->current_x;
-        y1 = this->highlight_y;
-        y2 = this->current_y;
+}
 
-        if (x1 > x2) {
-            x2 = this->highlight_x;
-            x1 = this->current_x;
-        }
+template <typename DC>
+void Canvas::draw_connectors(DC &dc, wxCoord height, int current_tick,
+                             int y_min, int y_max) {
+    TRACE_SCOPE("update_frame/connectors");
+
+    long tick_lo = this->tick_at(height, current_tick, y_max + 64) - 1;
+    long tick_hi = this->tick_at(height, current_tick, y_min - 64) + 1;
+
+    dc.SetPen(wxPen(wxColor(128, 128, 128), 5));
 
-        if (y1 > y2) {
-            y2 = this->highlight_y;
-            y1 = this->current_y;
+    // Every long note is joined to the previous note of its chain; a segment
+    // crosses the band when it ends above the band's bottom and starts below
+    // its top, which also catches segments whose both ends are off screen
+    for (const std::vector<size_t> &chain : this->chart->connector_chains()) {
+        auto first = std::lower_bound(
+            chain.begin(), chain.end(), tick_lo, [this](size_t idx, long tick) {
+                return this->chart->notes[idx]->tick < tick;
+            });
+
+        for (size_t k = std::max<size_t>(first - chain.begin(), 1);
+             k < chain.size(); k++) {
+            std::shared_ptr<Note> prev(this->chart->notes[chain[k - 1]]);
+            std::shared_ptr<Note> note(this->chart->notes[chain[k]]);
+
+            if (prev->tick > tick_hi) {
+                break;
+            }
+            if (!note->is_longnote || !this->is_note_shown(*note)) {
+                continue;
+            }
+
+            int y_position = height -
+                             ((note->tick - current_tick) *
+                              this->current_row_size) -
+                             (NOTE_SIZE * 6);
+            int x_position = note->lane * COL_SIZE;
+            int prev_y_position = height -
+                                  ((prev->tick - current_tick) *
+                                   this->current_row_size) -
+                                  (NOTE_SIZE * 6);
+            int prev_x_position = prev->lane * COL_SIZE;
+
+            dc.DrawLine(x_position + ((COL_SIZE + 1) / 2),
+                        y_position + (((NOTE_SIZE * 6) + 1) / 2),
+                        prev_x_position + ((COL_SIZE + 1) / 2),
+                        prev_y_position + (((NOTE_SIZE * 6) + 1) / 2));
         }
     }
+}
+
+template <typename DC>
+void Canvas::draw_notes(DC &dc, wxCoord height, int current_tick, int y_min,
+                        int y_max) {
+    TRACE_SCOPE("update_frame/notes");
 
-    // Render notes
-    for (int idx = 0; idx < this->chart->notes.size(); idx++) {
+    // Margin for the flick arrows that stick out of the note
+    long tick_lo = this->tick_at(height, current_tick, y_max + 64) - 1;
+    long tick_hi = this->tick_at(height, current_tick, y_min - 64) + 1;
+
+    for (size_t idx = this->chart->lower_bound_tick(tick_lo);
+         idx < this->chart->notes.size() &&
+         this->chart->notes[idx]->tick <= tick_hi;
+         idx++) {
         std::shared_ptr<Note> note(this->chart->notes[idx]);
+        PERF_ADD(frame_stats, notes_considered, 1);
+
+        if (!this->is_note_shown(*note)) {
+            continue;
+        }
 
         int y_position =
             height - ((note->tick - current_tick) * this->current_row_size) -
             (NOTE_SIZE * 6);
 
-        if (y_position + ((NOTE_SIZE * 6) + 1) >= 0 && y_position < height) {
-            // The bottom line is (current_tick)
-            int x_position = note->lane * COL_SIZE;
+        if (y_position + ((NOTE_SIZE * 6) + 1) < 0 || y_position >= height) {
+            continue;
+        }
 
-            // Note color
-            switch (note->side) {
-                case SIDE_LEFT:
-                    dc.SetBrush(wxColor(255, 191, 191));
+        // The bottom line is (current_tick)
+        int x_position = note->lane * COL_SIZE;
+        PERF_ADD(frame_stats, notes_drawn, 1);
+
+        // Note color
+        switch (note->side) {
+            case SIDE_LEFT:
+                dc.SetBrush(wxColor(255, 191, 191));
+                break;
+            case SIDE_RIGHT:
+                dc.SetBrush(wxColor(191, 191, 255));
+                break;
+            default:
+                dc.SetBrush(wxColor(191, 191, 191));
+        }
+
+        if (note->lane == LANE_BPM) {
+            dc.SetBrush(wxColor(128, 128, 128));
+        }
+
+        if (this->highlighted_notes.contains(note->id)) {
+            dc.SetBrush(wxColor(128, 192, 128));
+        }
+
+        dc.SetPen(wxPen(wxColor(128, 128, 128), 1));
+        dc.DrawRectangle(x_position, y_position, COL_SIZE + 1,
+                         (NOTE_SIZE * 6) + 1);
+
+        // Overlay
+        if (note->lane == LANE_BPM) {
+            this->draw_label(dc, fmt::format("{:.3f}", note->value),
+                             this->overlay_font, wxColor(255, 255, 255),
+                             x_position, y_position + 3);
+            continue;
+        }
+
+        if (note->is_longnote) {
+            this->draw_label(dc, "DRAG", this->overlay_font,
+                             wxColor(255, 255, 255), x_position,
+                             y_position + 3);
+        }
+
+        if (note->direction != DIR_NONE) {
+            switch (note->direction) {
+                case DIR_LEFT: {
+                    this->draw_label(dc, "➔", this->arrow_font,
+                                     wxColor(128, 128, 128), x_position + 24,
+                                     y_position - 9, 180 - note->direction);
                     break;
-                case SIDE_RIGHT:
-                    dc.SetBrush(wxColor(191, 191, 255));
+                }
+                case DIR_ULEFT: {
+                    this->draw_label(dc, "➔", this->arrow_font,
+                                     wxColor(128, 128, 128), x_position + 15,
+                                     y_position - 2, 180 - note->direction);
                     break;
-                default:
-                    dc.SetBrush(wxColor(191, 191, 191));
+                }
+                case DIR_UP: {
+                    this->draw_label(dc, "➔", this->arrow_font,
+                                     wxColor(128, 128, 128), x_position + 10,
+                                     y_position + 8, 180 - note->direction);
+                    break;
+                }
+                case DIR_URIGHT: {
+                    this->draw_label(dc, "➔", this->arrow_font,
+                                     wxColor(128, 128, 128), x_position + 17,
+                                     y_position + 17, 180 - note->direction);
+                    break;
+                }
+                case DIR_RIGHT: {
+                    this->draw_label(dc, "➔", this->arrow_font,
+                                     wxColor(128, 128, 128), x_position + 24,
+                                     y_position + 18, 180 - note->direction);
+                    break;
+                }
             }
+        }
+    }
+}
 
-            if (note->lane == LANE_BPM) {
-                dc.SetBrush(wxColor(128, 128, 128));
-            }
+template <typename DC>
+void Canvas::draw_density(DC &dc, wxCoord width, wxCoord height,
+                          int current_tick, int y_min, int y_max) {
+    TRACE_SCOPE("update_frame/density");
+
+    std::shared_ptr<const ChartSnapshot> snapshot = this->chart->snapshot();
+    const std::vector<std::shared_ptr<const MeasureNotes>> &measures =
+        snapshot->measures();
+
+    int measure_pixels =
+        192 * this->current_row_size / this->ticks_per_pixel();
+    auto y_at = [&](long tick) {
+        return height - (int)((tick - current_tick) * this->current_row_size /
+                              this->ticks_per_pixel());
+    };
+
+    // Margin below the band for the numbers that sit above their line
+    long first =
+        std::max(this->tick_at(height, current_tick, y_max + 24) / 192, 0L);
+    long last = this->tick_at(height, current_tick, y_min) / 192;
+
+    // Measure lines and numbers, thinned out so the numbers never overlap
+    long label_every = 1;
+    while (label_every * measure_pixels < 24) {
+        label_every *= 2;
+    }
+    dc.SetPen(wxPen(wxColor(255, 0, 0), 1));
+    for (long measure = first - first % label_every; measure <= last + 1;
+         measure += label_every) {
+        int y_position = y_at(measure * 192);
+        dc.DrawLine(0, y_position, width, y_position);
+        this->draw_label(dc, fmt::format("#{:03d}", measure),
+                         this->overlay_font, wxColor(128, 128, 128),
+                         COL_SIZE * 2, y_position - 18);
+    }
 
-            if (this->is_highlighted && x_position > x1 - (COL_SIZE + 1) &&
-                x_position < x2 && y_position > y1 - ((NOTE_SIZE * 6) + 1) &&
-                y_position < y2) {
-                this->highlighted_notes.insert(note->id);
+    // One bar per lane and measure, as wide as the lane is busy
+    dc.SetPen(wxPen(wxColor(96, 96, 160), 1));
+    dc.SetBrush(wxColor(96, 96, 160));
+    for (size_t idx = snapshot->lower_bound_measure(first);
+         idx < measures.size() && measures[idx]->measure <= last; idx++) {
+        const MeasureNotes &measure = *measures[idx];
+        int y_position = y_at((measure.measure + 1) * 192) + 1;
+        PERF_ADD(frame_stats, notes_considered, measure.notes.size());
+
+        for (int lane = LANE_BPM; lane <= LANE_E3; lane++) {
+            uint32_t count = measure.lane_counts[lane];
+            int group = lane_group(lane);
+            if (count == 0 ||
+                (group >= 0 && (this->hidden_lane_groups & (1 << group)))) {
+                continue;
             }
 
-            if (this->highlighted_notes.contains(note->id)) {
-                dc.SetBrush(wxColor(128, 192, 128));
-            }
+            int bar_width =
+                std::max((COL_SIZE - 4) *
+                             (int)std::min<uint32_t>(count, LOD_FULL_COUNT) /
+                             LOD_FULL_COUNT,
+                         2);
+            dc.DrawRectangle(lane * COL_SIZE + (COL_SIZE - bar_width) / 2,
+                             y_position, bar_width,
+                             std::max(measure_pixels - 1, 1));
+        }
+    }
+}
 
-            dc.SetPen(wxPen(wxColor(128, 128, 128), 1));
-            dc.DrawRectangle(x_position, y_position, COL_SIZE + 1,
-                             (NOTE_SIZE * 6) + 1);
-
-            // Overlay
-            if (note->lane == LANE_BPM) {
-                dc.SetFont(wxFont{12, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL});
-                dc.SetTextForeground(wxColor(255, 255, 255));
-                dc.DrawText(wxT("" + fmt::format("{:.3f}", note->value)),
-                            x_position, y_position + 3);
-            } else {
-                if (note->is_longnote) {
-                    dc.SetFont(
-                        wxFont{12, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL});
-                    dc.SetTextForeground(wxColor(255, 255, 255));
-                    dc.DrawText(wxT("DRAG"), x_position, y_position + 3);
-
-                    // Draw LN line
-                    // Find the previous connector (note with the same side)
-                    for (int j = idx - 1; j >= 0; j--) {
-                        std::shared_ptr<Note> prev(this->chart->notes[j]);
-
-                        if (prev->side == note->side &&
-                            this->chart->is_same_lane_group(prev, note)) {
-                            int prev_y_position = height -
-                                                  ((prev->tick - current_tick) *
-                                                   this->current_row_size) -
-                                                  (NOTE_SIZE * 6);
-                            int prev_x_position = prev->lane * COL_SIZE;
-
-                            dc.SetPen(wxPen(wxColor(128, 128, 128), 5));
-                            dc.DrawLine(
-                                x_position + ((COL_SIZE + 1) / 2),
-                                y_position + (((NOTE_SIZE * 6) + 1) / 2),
-                                prev_x_position + ((COL_SIZE + 1) / 2),
-                                prev_y_position + (((NOTE_SIZE * 6) + 1) / 2));
-
-                            break;
-                        }
-                    }
-                }
+void Canvas::draw_content(CountingDC &dc, wxDC &background_dc, wxCoord width,
+                          wxCoord height, int current_tick, int y_min,
+                          int y_max) {
+    dc.SetClippingRegion(0, y_min, width, y_max - y_min);
+
+    dc.Blit(0, y_min, width, y_max - y_min, &background_dc, 0, y_min);
+    if (this->is_lod()) {
+        this->draw_density(dc, width, height, current_tick, y_min, y_max);
+    } else {
+        this->draw_spectrogram(dc, height, current_tick, y_min, y_max);
+        this->draw_grid(dc, width, height, current_tick, y_min, y_max);
+        this->draw_connectors(dc, height, current_tick, y_min, y_max);
+        this->draw_notes(dc, height, current_tick, y_min, y_max);
+    }
 
-                if (note->side != SIDE_NONE) {
-                    // Check whether the next connector is out-of-screen
-                    for (int j = idx + 1; j < this->chart->notes.size(); j++) {
-                        std::shared_ptr<Note> next(this->chart->notes[j]);
-
-                        if (next->side == note->side &&
-                            this->chart->is_same_lane_group(next, note)) {
-                            if (next->is_longnote) {
-                                int next_y_position =
-                                    height -
-                                    ((next->tick - current_tick) *
-                                     this->current_row_size) -
-                                    (NOTE_SIZE * 6);
-
-                                if (next_y_position < 0) {
-                                    int next_x_position = next->lane * COL_SIZE;
-
-                                    dc.SetPen(wxPen(wxColor(128, 128, 128), 5));
-                                    dc.DrawLine(
-                                        x_position + ((COL_SIZE + 1) / 2),
-                                        y_position +
-                                            (((NOTE_SIZE * 6) + 1) / 2),
-                                        next_x_position + ((COL_SIZE + 1) / 2),
-                                        next_y_position +
-                                            (((NOTE_SIZE * 6) + 1) / 2));
-                                }
-                            }
-
-                            break;
-                        }
-                    }
-                }
+    dc.DestroyClippingRegion();
+}
 
-                if (note->direction != DIR_NONE) {
-                    dc.SetFont(
-                        wxFont{32, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL});
-                    dc.SetTextForeground(wxColor(128, 128, 128));
+void Canvas::update_layers(wxCoord width, wxCoord height, int current_tick) {
+    TRACE_SCOPE("update_frame/layers");
 
-                    switch (note->direction) {
-                        case DIR_LEFT: {
-                            dc.DrawRotatedText(wxT("➔"), x_position + 24,
-                                               y_position - 9,
-                                               180 - note->direction);
-                            break;
-                        }
-                        case DIR_ULEFT: {
-                            dc.DrawRotatedText(wxT("➔"), x_position + 15,
-                                               y_position - 2,
-                                               180 - note->direction);
-                            break;
-                        }
-                        case DIR_UP: {
-                            dc.DrawRotatedText(wxT("➔"), x_position + 10,
-                                               y_position + 8,
-                                               180 - note->direction);
-                            break;
-                        }
-                        case DIR_URIGHT: {
-                            dc.DrawRotatedText(wxT("➔"), x_position + 17,
-                                               y_position + 17,
-                                               180 - note->direction);
-                            break;
-                        }
-                        case DIR_RIGHT: {
-                            dc.DrawRotatedText(wxT("➔"), x_position + 24,
-                                               y_position + 18,
-                                               180 - note->direction);
-                            break;
-                        }
-                    }
-                }
+    // The lane backgrounds only change with the window size
+    if (!this->is_background_drawn ||
+        this->background_layer.GetWidth() != width ||
+        this->background_layer.GetHeight() != height) {
+        this->background_layer = wxBitmap(width, height);
+        this->content_layer = wxBitmap(width, height);
+        this->scratch_layer = wxBitmap(width, height);
+
+        wxMemoryDC background_dc(this->background_layer);
+        CountingDC dc(background_dc, this->frame_stats);
+        this->draw_background(dc, width, height);
+
+        this->is_background_drawn = true;
+        this->is_content_drawn = false;
+    }
+
+    bool is_stale =
+        !this->is_content_drawn ||
+        this->content_chart_version != this->chart->version() ||
+        this->content_row_size != this->current_row_size ||
+        this->content_zoom_out_shift != this->zoom_out_shift ||
+        this->content_granularity_index != this->tick_granularity_index ||
+        this->content_highlighted_notes != this->highlighted_notes ||
+        this->content_spectrogram_revision !=
+            (this->is_spectrogram_shown ? this->spectrogram.revision() : -1) ||
+        this->content_hidden_lane_groups != this->hidden_lane_groups;
+    // Zoomed out, current_tick is a multiple of the ticks per pixel
+    int scroll = this->zoom_out_shift > 0
+                     ? (current_tick - this->content_tick) >> this->zoom_out_shift
+                     : (current_tick - this->content_tick) *
+                           this->current_row_size;
+
+    if (!is_stale && scroll == 0) {
+        return;
+    }
+
+    wxMemoryDC background_dc;
+    background_dc.SelectObjectAsSource(this->background_layer);
+
+    if (is_stale || std::abs(scroll) >= height) {
+        wxMemoryDC content_dc(this->content_layer);
+        CountingDC dc(content_dc, this->frame_stats);
+        this->draw_content(dc, background_dc, width, height, current_tick, 0,
+                           height);
+    } else {
+        // Shift what is still valid and redraw only the exposed strip
+        {
+            wxMemoryDC content_dc;
+            content_dc.SelectObjectAsSource(this->content_layer);
+            wxMemoryDC scratch_dc(this->scratch_layer);
+            CountingDC dc(scratch_dc, this->frame_stats);
+
+            if (scroll > 0) {
+                dc.Blit(0, scroll, width, height - scroll, &content_dc, 0, 0);
+                this->draw_content(dc, background_dc, width, height,
+                                   current_tick, 0, scroll);
+            } else {
+                dc.Blit(0, 0, width, height + scroll, &content_dc, 0, -scroll);
+                this->draw_content(dc, background_dc, width, height,
+                                   current_tick, height + scroll, height);
             }
         }
+        std::swap(this->content_layer, this->scratch_layer);
     }
 
-    if (mode == Mode::MODE_CREATE) {
+    this->is_content_drawn = true;
+    this->content_tick = current_tick;
+    this->content_row_size = this->current_row_size;
+    this->content_zoom_out_shift = this->zoom_out_shift;
+    this->content_granularity_index = this->tick_granularity_index;
+    this->content_chart_version = this->chart->version();
+    this->content_highlighted_notes = this->highlighted_notes;
+    this->content_spectrogram_revision =
+        this->is_spectrogram_shown ? this->spectrogram.revision() : -1;
+    this->content_hidden_lane_groups = this->hidden_lane_groups;
+}
+
+void Canvas::update_software(CountingDC &dc, wxCoord width, wxCoord height,
+                             int current_tick) {
+    TRACE_SCOPE("update_frame/software");
+
+    if (!this->rasterizer) {
+        this->raster_pool = std::make_unique<ThreadPool>();
+        this->rasterizer = std::make_unique<TiledRasterizer>(*this->raster_pool);
+    }
+
+    this->display_list.clear();
+    DisplayListDC list_dc(this->display_list, width, height, this->frame_stats);
+    this->draw_background(list_dc, width, height);
+    if (this->is_lod()) {
+        this->draw_density(list_dc, width, height, current_tick, 0, height);
+    } else {
+        this->draw_spectrogram(list_dc, height, current_tick, 0, height);
+        this->draw_grid(list_dc, width, height, current_tick, 0, height);
+        this->draw_connectors(list_dc, height, current_tick, 0, height);
+        this->draw_notes(list_dc, height, current_tick, 0, height);
+    }
+
+    this->framebuffer.resize(width, height);
+    this->rasterizer->render(this->display_list, this->framebuffer);
+
+    this->framebuffer_rgb.resize((size_t)width * height * 3);
+    this->rasterizer->to_rgb(this->framebuffer, this->framebuffer_rgb.data());
+    wxImage image(width, height, this->framebuffer_rgb.data(), true);
+    dc.DrawBitmap(wxBitmap(image), 0, 0);
+}
+
+void Canvas::update_frame(wxDC &target_dc, double delta_time) {
+    CountingDC dc(target_dc, this->frame_stats);
+
+    wxCoord width, height;
+    dc.GetSize(&width, &height);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    this->update_tempo_detection();
+    this->update_tempo_map();
+    this->update_snapshot();
+    this->update_autosave();
+    this->update_ghost_notes();
+
+    // Scroll; zoomed out, snap to whole pixels so the layers scroll by
+    // whole pixels too
+    int current_tick = (int)current_tick_double;
+    current_tick -= current_tick % this->ticks_per_pixel();
+
+    this->update_spectrogram(height, current_tick);
+    this->update_lane_filter();
+
+    // Reset the highlight set
+    this->update_highlight(height, current_tick);
+
+    // Lanes, grid and notes come from the cached layers, or are rasterized
+    // from scratch by the software backend
+    if (this->is_software_rendering) {
+        this->update_software(dc, width, height, current_tick);
+    } else {
+        this->update_layers(width, height, current_tick);
+        dc.DrawBitmap(this->content_layer, 0, 0);
+    }
+
+    // Everything below is the transient overlay, drawn fresh every frame
+    this->draw_ghost_notes(dc, height, current_tick);
+    this->update_overview(height);
+    this->draw_overview(dc, height, current_tick);
+
+    if (mode == Mode::MODE_CREATE && !this->is_lod()) {
         // Draw hovered notes
         int cell_height = 192 / tick_granularity[tick_granularity_index] *
                           this->current_row_size;
@@ -793,18 +1688,23 @@ void Canvas::update_frame(wxDC &dc, double delta_time) {
             dc.SetPen(wxPen(wxColor(128, 128, 128), 1));
             dc.SetBrush(wxColor(255, 255, 224, 127));
 
-            dc.DrawRectangle(x1, y1, x2 - x1, y2 - y1);
+            wxRect rect = this->selection_rect();
+            dc.DrawRectangle(rect.x, rect.y, rect.width, rect.height);
         }
     }
 
     // Draw GUI
+    TraceScope hud_scope("update_frame/hud");
+
     dc.SetPen(wxPen(wxColor(128, 128, 128), 1));
     dc.SetBrush(wxColor(224, 224, 224, 127));
     dc.DrawRectangle(width - 300, 10, 290, 200);
 
     dc.SetFont(wxFont{16, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL});
     dc.SetTextForeground(wxColor(0, 0, 0));
-    dc.DrawText(wxT("" + fmt::format("Mode: {:<}", ModeStr[this->mode])),
+    dc.DrawText(wxT("" + fmt::format("Mode: {:<}{}", ModeStr[this->mode],
+                                     this->chart->is_updated() ? " (unsaved)"
+                                                               : "")),
                 width - 290, 20);
     dc.DrawText(
         wxT("" + fmt::format("Tick Granularity: {:3d}",
@@ -813,35 +1713,137 @@ void Canvas::update_frame(wxDC &dc, double delta_time) {
     dc.DrawText(
         wxT("" + fmt::format("Side: {:<}", side_text[this->current_side])),
         width - 290, 60);
-    dc.DrawText(wxT("" + fmt::format("Row Size: {:d}", this->current_row_size)),
-                width - 290, 80);
+    if (this->zoom_out_shift > 0) {
+        dc.DrawText(wxT("" + fmt::format("Row Size: 1/{:d}{}",
+                                         this->ticks_per_pixel(),
+                                         this->is_lod() ? " (density)" : "")),
+                    width - 290, 80);
+    } else {
+        dc.DrawText(
+            wxT("" + fmt::format("Row Size: {:d}", this->current_row_size)),
+            width - 290, 80);
+    }
 
     // Compute time
-    double beats = this->current_tick_double / 192 * 4;
-    int milliseconds = (int)((1.0 / this->BPM) * beats * 60.0 * 1000.0);
+    int milliseconds =
+        (int)(this->tempo_map.seconds_at(this->current_tick_double) * 1000.0);
 
     dc.DrawText(wxT("" + fmt::format("Current Time (ms): {:d}", milliseconds)),
                 width - 290, 100);
 
     if (this->is_init) {
-        // float seconds = 0.0;
-        // ma_sound_get_cursor_in_seconds(&sound, &seconds);
-        // seconds += offset;
+        if (this->playback.is_open()) {
+            // The playback clock runs on song time, so the scroll slows
+            // down together with the stretched audio
+            double seconds = this->playback.position() + offset;
 
-        // if (this->is_autoplay) {
-        //     current_tick_double =
-        //         ((seconds / 60.0) * this->BPM) * (192.0 / 4.0);
-        // }
+            if (this->is_autoplay) {
+                current_tick_double = this->tempo_map.tick_at(seconds);
+            }
 
-        // dc.DrawText(wxT("" + fmt::format("Current Time (ms): {:d}",
-        //                                  (int)(seconds * 1000.0))),
-        //             width - 290, 120);
+            dc.DrawText(wxT("" + fmt::format("Song Time (ms): {:d}",
+                                             (int)(seconds * 1000.0))),
+                        width - 290, 120);
+            dc.DrawText(wxT("" + fmt::format("Playback Rate: {:.2f}x",
+                                             this->playback.get_rate())),
+                        width - 290, 140);
 
-        if (this->is_autoplay) {
+            if (this->tempo_job.valid()) {
+                dc.DrawText(wxT("Tempo: analyzing"), width - 290, 180);
+            } else {
+                dc.DrawText(wxT("" + fmt::format("Offset (s): {:.3f}",
+                                                 this->offset)),
+                            width - 290, 180);
+            }
+
+            if (this->onset_job.valid()) {
+                dc.DrawText(wxT("Onsets: analyzing"), width - 290, 160);
+            } else if (!this->ghost_notes.empty()) {
+                dc.DrawText(wxT("" + fmt::format("Onsets: {:d} ghost notes",
+                                                 this->ghost_notes.size())),
+                            width - 290, 160);
+            }
+        } else if (this->is_autoplay) {
             current_tick_double += 1.0;
         }
     }
 
+#ifdef THAPSTEAK_PERF_HUD
+    if (this->is_perf_hud_shown) {
+        double p50, p95, p99;
+        this->frame_stats.percentiles(p50, p95, p99);
+        const FrameCounters &latest = this->frame_stats.latest;
+
+        dc.SetPen(wxPen(wxColor(128, 128, 128), 1));
+        dc.SetBrush(wxColor(224, 224, 224, 127));
+        dc.DrawRectangle(width - 300, 220, 290, 240);
+
+        dc.SetFont(wxFont{16, wxFONTFAMILY_SWISS, wxNORMAL, wxNORMAL});
+        dc.SetTextForeground(wxColor(0, 0, 0));
+        dc.DrawText(
+            wxT("" + fmt::format("Frame p50/95/99: {:.1f}/{:.1f}/{:.1f}",
+                                 p50 * 1000.0, p95 * 1000.0, p99 * 1000.0)),
+            width - 290, 230);
+        dc.DrawText(wxT("" + fmt::format("Notes: {:d} / {:d} drawn",
+                                         latest.notes_considered,
+                                         latest.notes_drawn)),
+                    width - 290, 250);
+        dc.DrawText(wxT("" + fmt::format("Draw Calls: {:d}", latest.draw_calls)),
+                    width - 290, 270);
+        dc.DrawText(
+            wxT("" + fmt::format("State Changes: {:d}", latest.state_changes)),
+            width - 290, 290);
+        dc.DrawText(wxT("" + fmt::format("Chart: {:d} notes, {:d} KiB",
+                                         this->chart->notes.size(),
+                                         this->chart->memory_usage() / 1024)),
+                    width - 290, 310);
+        dc.DrawText(wxT("" + fmt::format("Labels: {:d} cached, {:d} KiB",
+                                         this->label_cache.size(),
+                                         this->label_cache.memory_usage() /
+                                             1024)),
+                    width - 290, 330);
+        dc.DrawText(wxT("" + fmt::format("Backend: {}",
+                                         this->is_software_rendering
+                                             ? "software"
+                                             : "wxDC layers")),
+                    width - 290, 350);
+        dc.DrawText(wxT("" + fmt::format("Spectrogram: {:d} tiles, {:d} KiB",
+                                         this->spectrogram.size(),
+                                         this->spectrogram.memory_usage() /
+                                             1024)),
+                    width - 290, 370);
+        dc.DrawText(
+            wxT("" + fmt::format("Song Cache: {:d} + {:d} MiB mapped",
+                                 this->playback.get_cache().memory_usage() >> 20,
+                                 this->playback.get_cache().mapped_bytes() >>
+                                     20)),
+            width - 290, 390);
+        std::shared_ptr<const ChartSnapshot> published =
+            this->published_chart.load();
+        dc.DrawText(
+            wxT("" + fmt::format("Snapshot: v{:d}, {:d}/{:d} measures saved",
+                                 published ? published->version() : -1L,
+                                 published && this->autosaved_chart
+                                     ? published->shared_measures(
+                                           *this->autosaved_chart)
+                                     : 0,
+                                 published ? published->measures().size()
+                                           : 0)),
+            width - 290, 410);
+        dc.DrawText(
+            wxT("" + (this->live_preview.is_running()
+                          ? fmt::format("Live Preview: {:d} linked, {:d} B",
+                                        this->live_preview.subscriber_count(),
+                                        this->live_preview.last_packet_size())
+                          : std::string("Live Preview: off"))),
+            width - 290, 430);
+    }
+#endif
+    hud_scope.end();
+
+    // Last, once autoplay has moved the playhead for this frame
+    this->update_live_preview();
+
     dc.SetPen(wxPen(wxColor(255, 255, 255, 127), 3));
     dc.DrawLine(0, height, width, height);
 }
@@ -0,0 +1,162 @@
+#include "../include/chart_digest.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../include/notechart.hpp"
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t note_hash(const Note &note) {
+    uint32_t value_bits;
+    std::memcpy(&value_bits, &note.value, sizeof(value_bits));
+
+    uint64_t hash = mix((uint64_t)note.tick);
+    hash = mix(hash ^ ((uint64_t)note.lane | (uint64_t)note.side << 8 |
+                       (uint64_t)note.is_longnote << 16 |
+                       (uint64_t)(uint16_t)note.direction << 24 |
+                       (uint64_t)value_bits << 32));
+    return hash;
+}
+
+void ChartDigest::add(long measure, uint64_t hash) {
+    size_t idx = (size_t)std::max(measure, 0L);
+    if (idx >= this->leaves.size()) {
+        this->leaves.resize(idx + 1);
+        this->is_stale = true;
+    }
+    this->leaves[idx].sum += hash;
+    this->leaves[idx].count++;
+    this->dirty_leaves.insert(idx);
+}
+
+void ChartDigest::remove(long measure, uint64_t hash) {
+    size_t idx = (size_t)std::max(measure, 0L);
+    if (idx >= this->leaves.size() || this->leaves[idx].count == 0) return;
+    this->leaves[idx].sum -= hash;
+    this->leaves[idx].count--;
+    this->dirty_leaves.insert(idx);
+}
+
+void ChartDigest::clear() {
+    this->leaves.clear();
+    this->levels.clear();
+    this->dirty_leaves.clear();
+    this->is_stale = false;
+}
+
+uint64_t ChartDigest::measure_hash(long measure) const {
+    if (measure < 0 || (size_t)measure >= this->leaves.size()) return 0;
+    const Leaf &leaf = this->leaves[measure];
+    // The count keeps a measure whose note hashes happen to cancel out from
+    // looking empty
+    return leaf.count == 0 ? 0 : mix(leaf.sum ^ mix(leaf.count));
+}
+
+uint64_t ChartDigest::combine(size_t level, size_t index) const {
+    const std::vector<uint64_t> &below = this->levels[level - 1];
+    size_t begin = index * FANOUT;
+    size_t end = std::min(begin + FANOUT, below.size());
+    if (std::all_of(below.begin() + begin + 1, below.begin() + end,
+                    [](uint64_t hash) { return hash == 0; })) {
+        return below[begin];
+    }
+
+    uint64_t hash = 0;
+    for (size_t i = begin; i < begin + FANOUT; i++) {
+        hash = mix(hash ^ (i < end ? below[i] : 0));
+    }
+    return hash;
+}
+
+void ChartDigest::refresh() const {
+    if (this->is_stale) {
+        // The leaves outgrew the tree; rebuild every level
+        this->levels.assign(1, std::vector<uint64_t>(this->leaves.size()));
+        for (size_t i = 0; i < this->leaves.size(); i++) {
+            this->levels[0][i] = this->measure_hash((long)i);
+        }
+        while (this->levels.back().size() > 1) {
+            size_t level = this->levels.size();
+            size_t size = (this->levels.back().size() + FANOUT - 1) / FANOUT;
+            this->levels.emplace_back(size);
+            for (size_t i = 0; i < size; i++) {
+                this->levels[level][i] = this->combine(level, i);
+            }
+        }
+        this->is_stale = false;
+        this->dirty_leaves.clear();
+        return;
+    }
+
+    if (this->dirty_leaves.empty()) return;
+
+    // Recompute each changed node once per level, bottom up
+    std::set<size_t> dirty;
+    for (size_t idx : this->dirty_leaves) {
+        this->levels[0][idx] = this->measure_hash((long)idx);
+        dirty.insert(idx / FANOUT);
+    }
+    for (size_t level = 1; level < this->levels.size(); level++) {
+        std::set<size_t> parents;
+        for (size_t idx : dirty) {
+            this->levels[level][idx] = this->combine(level, idx);
+            parents.insert(idx / FANOUT);
+        }
+        dirty = std::move(parents);
+    }
+    this->dirty_leaves.clear();
+}
+
+uint64_t ChartDigest::root() const {
+    this->refresh();
+    return this->levels.empty() ? 0 : this->levels.back()[0];
+}
+
+uint64_t ChartDigest::node(size_t level, size_t index) const {
+    // Above the root, the root stands in for the first node of every level
+    if (level >= this->levels.size()) {
+        return index == 0 && !this->levels.empty() ? this->levels.back()[0]
+                                                   : 0;
+    }
+    const std::vector<uint64_t> &nodes = this->levels[level];
+    return index < nodes.size() ? nodes[index] : 0;
+}
+
+void ChartDigest::diff_node(const ChartDigest &other, size_t level,
+                            size_t index, std::vector<long> &measures) const {
+    if (this->node(level, index) == other.node(level, index)) return;
+    if (level == 0) {
+        measures.push_back((long)index);
+        return;
+    }
+    for (size_t i = 0; i < FANOUT; i++) {
+        this->diff_node(other, level - 1, index * FANOUT + i, measures);
+    }
+}
+
+std::vector<long> ChartDigest::diff(const ChartDigest &other) const {
+    this->refresh();
+    other.refresh();
+
+    std::vector<long> measures;
+    size_t height = std::max(this->levels.size(), other.levels.size());
+    if (height > 0) {
+        this->diff_node(other, height - 1, 0, measures);
+    }
+    return measures;
+}
+
+size_t ChartDigest::memory_usage() const {
+    size_t bytes = this->leaves.capacity() * sizeof(Leaf);
+    for (const std::vector<uint64_t> &level : this->levels) {
+        bytes += level.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
@@ -0,0 +1,204 @@
+#include "../include/chart_io.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#include "../include/trace.hpp"
+
+using json = nlohmann::json;
+
+Lane lane_from_text(const std::string &text) {
+    for (size_t lane = 1; lane < lane_text.size(); lane++) {
+        if (!lane_text[lane].empty() && lane_text[lane] == text) {
+            return (Lane)lane;
+        }
+    }
+    return LANE_NONE;
+}
+
+Side side_from_text(const std::string &text) {
+    if (text == "left") {
+        return SIDE_LEFT;
+    } else if (text == "right") {
+        return SIDE_RIGHT;
+    }
+    return SIDE_NONE;
+}
+
+bool parse_note_filter(const std::string &text, NoteFilter &filter) {
+    const std::vector<std::pair<std::string, Direction>> flicks{
+        {"flick-right", DIR_RIGHT}, {"flick-upright", DIR_URIGHT},
+        {"flick-up", DIR_UP},       {"flick-upleft", DIR_ULEFT},
+        {"flick-left", DIR_LEFT}};
+
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word) {
+        std::transform(word.begin(), word.end(), word.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+
+        std::string upper = word;
+        std::transform(upper.begin(), upper.end(), upper.begin(),
+                       [](unsigned char c) { return std::toupper(c); });
+
+        auto flick = std::find_if(
+            flicks.begin(), flicks.end(),
+            [&word](const auto &entry) { return entry.first == word; });
+
+        long first_measure, last_measure;
+        char dash;
+        std::istringstream range(word);
+
+        if (word == "hard") {
+            for (Lane lane : {LANE_H1, LANE_H2, LANE_H3, LANE_H4, LANE_H5}) {
+                filter.lanes.push_back(lane);
+            }
+        } else if (word == "normal") {
+            for (Lane lane : {LANE_N1, LANE_N2, LANE_N3, LANE_N4}) {
+                filter.lanes.push_back(lane);
+            }
+        } else if (word == "easy") {
+            for (Lane lane : {LANE_E1, LANE_E2, LANE_E3}) {
+                filter.lanes.push_back(lane);
+            }
+        } else if (lane_from_text(upper) != LANE_NONE) {
+            filter.lanes.push_back(lane_from_text(upper));
+        } else if (word == "left" || word == "right") {
+            filter.sides.push_back(side_from_text(word));
+        } else if (word == "noside") {
+            filter.sides.push_back(SIDE_NONE);
+        } else if (word == "flick") {
+            for (const auto &[name, direction] : flicks) {
+                filter.directions.push_back(direction);
+            }
+        } else if (flick != flicks.end()) {
+            filter.directions.push_back(flick->second);
+        } else if (word == "noflick") {
+            filter.directions.push_back(DIR_NONE);
+        } else if (word == "long") {
+            filter.is_longnote = 1;
+        } else if (word == "tap") {
+            filter.is_longnote = 0;
+        } else if (range >> first_measure && first_measure >= 0) {
+            last_measure = first_measure;
+            if (range >> dash && (dash != '-' || !(range >> last_measure) ||
+                                  last_measure < first_measure)) {
+                return false;
+            }
+            if (range.peek() != EOF) {
+                return false;
+            }
+            filter.tick_begin = first_measure * 192;
+            filter.tick_end = (last_measure + 1) * 192;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t parse_chart(const std::string &content, Notechart &chart) {
+    TRACE_SCOPE("parse_chart");
+
+    json data = json::parse(content);
+
+    std::vector<Note> parsed_notes;
+    parsed_notes.reserve(data["events"].size());
+
+    for (auto &e : data["events"]) {
+        Note new_note(0, LANE_NONE, DIR_NONE, SIDE_NONE, false);
+
+        for (auto &[key, value] : e.items()) {
+            if (key == "row") {
+                long row = value;
+                if (row < 0) {
+                    throw std::invalid_argument("negative row " +
+                                                std::to_string(row));
+                }
+                new_note.tick = row;
+            } else if (key == "channel") {
+                new_note.lane = lane_from_text(value);
+            } else if (key == "longNote") {
+                new_note.is_longnote = value;
+            } else if (key == "angle") {
+                long angle = value;
+                if (!is_direction(angle)) {
+                    throw std::invalid_argument("unknown angle " +
+                                                std::to_string(angle));
+                }
+                new_note.direction = (Direction)angle;
+            } else if (key == "side") {
+                new_note.side = side_from_text(value);
+            } else if (key == "value") {
+                new_note.value = value;
+            }
+        }
+
+        parsed_notes.push_back(new_note);
+    }
+
+    chart.add_notes(parsed_notes);
+    return parsed_notes.size();
+}
+
+bool read_file(const std::string &file_path, std::string &content) {
+    std::FILE *file = std::fopen(file_path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    long file_size = std::ftell(file);
+    std::rewind(file);
+
+    content.resize(file_size);
+    size_t read_size = std::fread(content.data(), sizeof(char), file_size, file);
+    std::fclose(file);
+
+    return read_size == (size_t)file_size;
+}
+
+bool write_file(const std::string &file_path, const std::string &content) {
+    std::FILE *file = std::fopen(file_path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    size_t written_size =
+        std::fwrite(content.data(), sizeof(char), content.size(), file);
+    std::fclose(file);
+
+    return written_size == content.size();
+}
+
+bool import_chart(const std::string &file_path, Notechart &chart,
+                  size_t *dropped) {
+    TRACE_SCOPE("import_chart");
+
+    std::string buffer;
+    if (!read_file(file_path, buffer)) {
+        return false;
+    }
+
+    try {
+        size_t before = chart.notes.size();
+        size_t event_count = parse_chart(buffer, chart);
+        if (dropped) {
+            *dropped = before + event_count - chart.notes.size();
+        }
+    } catch (const std::exception &) {
+        // Malformed JSON, or an event parse_chart cannot represent
+        return false;
+    }
+    return true;
+}
+
+bool export_chart(const std::string &file_path, Notechart &chart) {
+    TRACE_SCOPE("export_chart");
+
+    return write_file(file_path, chart.to_string());
+}
@@ -0,0 +1,67 @@
+#include "../include/chart_snapshot.hpp"
+
+#include <algorithm>
+
+ChartSnapshot::ChartSnapshot(
+    long _version, uint64_t _digest,
+    std::vector<std::shared_ptr<const MeasureNotes>> _measures)
+    : chart_version(_version),
+      chart_digest(_digest),
+      measure_list(std::move(_measures)) {
+    for (const std::shared_ptr<const MeasureNotes> &measure :
+         this->measure_list) {
+        this->note_count += measure->notes.size();
+    }
+}
+
+size_t ChartSnapshot::lower_bound_measure(long measure) const {
+    return std::lower_bound(
+               this->measure_list.begin(), this->measure_list.end(), measure,
+               [](const std::shared_ptr<const MeasureNotes> &notes,
+                  long measure) { return notes->measure < measure; }) -
+           this->measure_list.begin();
+}
+
+std::shared_ptr<const MeasureNotes> ChartSnapshot::measure(
+    long measure) const {
+    size_t idx = this->lower_bound_measure(measure);
+    if (idx == this->measure_list.size() ||
+        this->measure_list[idx]->measure != measure) {
+        return nullptr;
+    }
+    return this->measure_list[idx];
+}
+
+std::string ChartSnapshot::to_string() const {
+    std::string buffer;
+    buffer += "{\"events\":[";
+    this->for_each([&buffer](const Note &note) {
+        buffer += note.to_string();
+        buffer += ",";
+    });
+    if (this->note_count > 0) {
+        buffer.resize(buffer.size() - 1);
+    }
+    buffer += "]}";
+
+    return buffer;
+}
+
+size_t ChartSnapshot::shared_measures(const ChartSnapshot &other) const {
+    // Both lists are ordered by measure
+    size_t shared = 0, i = 0, j = 0;
+    while (i < this->measure_list.size() && j < other.measure_list.size()) {
+        const MeasureNotes *a = this->measure_list[i].get();
+        const MeasureNotes *b = other.measure_list[j].get();
+        if (a->measure < b->measure) {
+            i++;
+        } else if (b->measure < a->measure) {
+            j++;
+        } else {
+            shared += a == b;
+            i++;
+            j++;
+        }
+    }
+    return shared;
+}
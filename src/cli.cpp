@@ -0,0 +1,878 @@
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../include/chart_io.hpp"
+#include "../include/live_preview.hpp"
+#include "../include/merge.hpp"
+#include "../include/mixdown.hpp"
+#include "../include/notechart.hpp"
+#include "../include/pcm.hpp"
+#include "../include/playtest.hpp"
+#include "../include/tempo_detect.hpp"
+#include "../include/thread_pool.hpp"
+#include "../include/time_stretch.hpp"
+#include "../include/trace.hpp"
+#include "../third_party/miniaudio.h"
+
+/**
+ * Headless batch tool for .thapsteak files
+ *
+ * thapsteak_cli validate  [-j N] files...
+ * thapsteak_cli normalize [-j N] [-o DIR] files...
+ * thapsteak_cli convert   [-j N] -o DIR files...
+ * thapsteak_cli stats     [-j N] files...
+ * thapsteak_cli merge     -o OUT base ours theirs
+ * thapsteak_cli diff      old new
+ * thapsteak_cli stretch-bench [song]
+ * thapsteak_cli transform-bench [chart]
+ * thapsteak_cli tempo     [-j N] songs...
+ * thapsteak_cli playtest  [-j N] [--runs N] [--seed N] [--sigma MS]
+ *                         [--bias MS] [--difficulty D] files...
+ * thapsteak_cli mixdown   [-j N] [--offset S] [--bpm N] [--difficulty D]
+ *                         [--hitsounds DIR] -o OUT.wav chart song
+ * thapsteak_cli subscribe [--socket PATH] [-o OUT.thapsteak]
+ */
+
+struct Options {
+    std::string command;
+    std::string output;
+    std::string trace_path;
+    size_t thread_count{0};
+    std::vector<std::string> files;
+
+    // playtest
+    size_t runs{1000};
+    uint64_t seed{1};
+    double sigma_ms{25.0};
+    double bias_ms{0.0};
+    std::string difficulty;
+
+    // mixdown
+    double offset{0.0};
+    double bpm{140.0};
+    std::string hitsound_dir;
+
+    // subscribe
+    std::string socket_path;
+};
+
+static void print_usage() {
+    fmt::print(stderr,
+               "usage: thapsteak_cli <command> [options] files...\n"
+               "\n"
+               "commands:\n"
+               "  validate   check charts for structural problems\n"
+               "  normalize  re-sort, dedup and renumber IDs "
+               "(in place unless -o is given)\n"
+               "  convert    write every chart as CSV into -o DIR\n"
+               "  stats      print per-chart statistics\n"
+               "  merge      three-way merge of base, ours and theirs "
+               "into -o FILE\n"
+               "  diff       list the notes that differ between two charts, "
+               "by measure\n"
+               "  stretch-bench [song]\n"
+               "             time the playback time-stretch on one core\n"
+               "  transform-bench [chart]\n"
+               "             time the bulk transforms on every note of a "
+               "chart\n"
+               "             (default: 100k synthetic notes)\n"
+               "  tempo      estimate the offset and tempo changes of songs\n"
+               "  playtest   simulate players on each difficulty and report "
+               "accuracy\n"
+               "             and the measures where they miss most\n"
+               "  mixdown    render the song with a hitsound on every note "
+               "to -o FILE.wav\n"
+               "  subscribe  follow the live preview of a running editor, "
+               "printing each\n"
+               "             frame and writing the last chart to -o FILE\n"
+               "\n"
+               "options:\n"
+               "  -j N       worker threads (default: all cores)\n"
+               "  -o DIR     output directory (output file for merge)\n"
+               "  --trace F  write a trace-event JSON file to F\n"
+               "\n"
+               "playtest options:\n"
+               "  --runs N          simulated runs per difficulty "
+               "(default: 1000)\n"
+               "  --seed N          seed of the first run (default: 1)\n"
+               "  --sigma MS        spread of the timing error (default: 25)\n"
+               "  --bias MS         mean timing error, positive is late "
+               "(default: 0)\n"
+               "  --difficulty D    hard, normal or easy (default: every "
+               "charted one)\n"
+               "\n"
+               "mixdown options:\n"
+               "  --offset S        chart time minus song time, in seconds "
+               "(default: 0)\n"
+               "  --bpm N           tempo before the first BPM note "
+               "(default: 140)\n"
+               "  --difficulty D    only the notes of hard, normal or easy\n"
+               "  --hitsounds DIR   hard, normal, easy and flick .wav files "
+               "replacing\n"
+               "                    the built-in clicks\n"
+               "\n"
+               "subscribe options:\n"
+               "  --socket PATH     editor socket (default: "
+               "thapsteak-preview.sock in\n"
+               "                    the temp directory)\n");
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+    if (argc < 2) return false;
+
+    options.command = argv[1];
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options.runs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            options.sigma_ms = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--bias") == 0 && i + 1 < argc) {
+            options.bias_ms = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--difficulty") == 0 &&
+                   i + 1 < argc) {
+            options.difficulty = argv[++i];
+        } else if (std::strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
+            options.offset = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--bpm") == 0 && i + 1 < argc) {
+            options.bpm = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--hitsounds") == 0 && i + 1 < argc) {
+            options.hitsound_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options.socket_path = argv[++i];
+        } else {
+            options.files.push_back(argv[i]);
+        }
+    }
+
+    return !options.files.empty() || options.command == "stretch-bench" ||
+           options.command == "transform-bench" ||
+           options.command == "subscribe";
+}
+
+static std::string output_path(const Options &options,
+                               const std::string &file_path,
+                               const std::string &extension) {
+    std::filesystem::path path(file_path);
+    if (!options.output.empty()) {
+        path = std::filesystem::path(options.output) / path.filename();
+    }
+    if (!extension.empty()) {
+        path.replace_extension(extension);
+    }
+    return path.string();
+}
+
+static std::vector<std::string> validate_chart(Notechart &chart,
+                                               size_t event_count) {
+    std::vector<std::string> issues;
+
+    if (event_count != chart.notes.size()) {
+        issues.push_back(fmt::format("{} duplicated cell(s) dropped",
+                                     event_count - chart.notes.size()));
+    }
+
+    if (!chart.notes.empty() && !(chart.notes.front()->tick == 0 &&
+                                  chart.notes.front()->lane == LANE_BPM)) {
+        issues.push_back("no BPM event at row 0");
+    }
+
+    for (size_t idx = 0; idx < chart.notes.size(); idx++) {
+        std::shared_ptr<Note> note = chart.notes[idx];
+
+        if (note->lane == LANE_NONE) {
+            issues.push_back(fmt::format("row {}: unknown channel", note->tick));
+        } else if (note->lane == LANE_BPM) {
+            if (note->value <= 0.0) {
+                issues.push_back(
+                    fmt::format("row {}: BPM must be positive", note->tick));
+            }
+        } else if (note->is_longnote) {
+            if (note->side == SIDE_NONE) {
+                issues.push_back(fmt::format(
+                    "row {} {}: long note without a side", note->tick,
+                    lane_text[note->lane]));
+                continue;
+            }
+
+            // A long note continues the previous note of its side and group
+            bool has_start = false;
+            for (size_t j = idx; j-- > 0;) {
+                if (chart.notes[j]->side == note->side &&
+                    chart.is_same_lane_group(chart.notes[j], note)) {
+                    has_start = true;
+                    break;
+                }
+            }
+            if (!has_start) {
+                issues.push_back(fmt::format(
+                    "row {} {}: long note has no starting note", note->tick,
+                    lane_text[note->lane]));
+            }
+        }
+    }
+
+    return issues;
+}
+
+static std::string describe_stats(Notechart &chart) {
+    long hard = 0, normal = 0, easy = 0, bpm = 0;
+    long left = 0, right = 0, flicks = 0, long_notes = 0;
+    std::map<long, long> notes_per_measure;
+
+    for (std::shared_ptr<Note> &note : chart.notes) {
+        if (note->lane == LANE_BPM) {
+            bpm++;
+            continue;
+        }
+
+        if (note->lane >= LANE_H1 && note->lane <= LANE_H5) {
+            hard++;
+        } else if (note->lane >= LANE_N1 && note->lane <= LANE_N4) {
+            normal++;
+        } else if (note->lane >= LANE_E1 && note->lane <= LANE_E3) {
+            easy++;
+        }
+
+        left += note->side == SIDE_LEFT;
+        right += note->side == SIDE_RIGHT;
+        flicks += note->direction != DIR_NONE;
+        long_notes += note->is_longnote;
+        notes_per_measure[note->tick / 192]++;
+    }
+
+    long densest_measure = 0, densest_count = 0;
+    for (auto &[measure, count] : notes_per_measure) {
+        if (count > densest_count) {
+            densest_measure = measure;
+            densest_count = count;
+        }
+    }
+
+    long measures = chart.notes.empty() ? 0 : chart.notes.back()->tick / 192 + 1;
+
+    return fmt::format(
+        "  {} notes over {} measures, {} BPM events\n"
+        "  hard/normal/easy: {}/{}/{}\n"
+        "  left/right: {}/{}, flicks: {}, long notes: {}\n"
+        "  densest measure: #{:03d} ({} notes)\n"
+        "  digest: {:016x}\n",
+        chart.notes.size(), measures, bpm, hard, normal, easy, left, right,
+        flicks, long_notes, densest_measure, densest_count, chart.digest());
+}
+
+static std::string to_csv(Notechart &chart) {
+    std::string buffer = "row,channel,side,longNote,angle,value\n";
+    for (std::shared_ptr<Note> &note : chart.notes) {
+        buffer += fmt::format("{},{},{},{},{},{}\n", note->tick,
+                              lane_text[note->lane], side_text[note->side],
+                              note->is_longnote ? 1 : 0, (int)note->direction,
+                              note->value);
+    }
+    return buffer;
+}
+
+// Process a single chart; returns false when the file is unusable or invalid
+static bool process_file(const Options &options, const std::string &file_path,
+                         std::string &report) {
+    TRACE_SCOPE("cli/process_file");
+
+    std::string content;
+    if (!read_file(file_path, content)) {
+        report = fmt::format("{}: cannot read file\n", file_path);
+        return false;
+    }
+
+    Notechart chart;
+    size_t event_count = 0;
+    try {
+        event_count = parse_chart(content, chart);
+    } catch (const std::exception &e) {
+        report = fmt::format("{}: malformed chart ({})\n", file_path, e.what());
+        return false;
+    }
+
+    if (options.command == "validate") {
+        std::vector<std::string> issues = validate_chart(chart, event_count);
+        report = fmt::format("{}: {}\n", file_path,
+                             issues.empty() ? "ok" : "invalid");
+        for (std::string &issue : issues) {
+            report += "  " + issue + "\n";
+        }
+        return issues.empty();
+    } else if (options.command == "normalize") {
+        chart.normalize();
+        std::string path = output_path(options, file_path, "");
+        if (!write_file(path, chart.to_string())) {
+            report = fmt::format("{}: cannot write {}\n", file_path, path);
+            return false;
+        }
+        report = fmt::format("{}: {} notes -> {}\n", file_path,
+                             chart.notes.size(), path);
+    } else if (options.command == "convert") {
+        std::string path = output_path(options, file_path, ".csv");
+        if (!write_file(path, to_csv(chart))) {
+            report = fmt::format("{}: cannot write {}\n", file_path, path);
+            return false;
+        }
+        report = fmt::format("{}: -> {}\n", file_path, path);
+    } else if (options.command == "stats") {
+        report = fmt::format("{}:\n", file_path) + describe_stats(chart);
+    }
+
+    return true;
+}
+
+static int run_merge(const Options &options) {
+    if (options.files.size() != 3 || options.output.empty()) {
+        fmt::print(stderr, "merge requires -o FILE base ours theirs\n");
+        return 2;
+    }
+
+    Notechart charts[3];
+    for (size_t i = 0; i < 3; i++) {
+        size_t dropped = 0;
+        if (!import_chart(options.files[i], charts[i], &dropped)) {
+            fmt::print(stderr, "{}: cannot import\n", options.files[i]);
+            return 1;
+        }
+        if (dropped > 0) {
+            fmt::print(stderr, "{}: {} duplicated cell(s) dropped\n",
+                       options.files[i], dropped);
+        }
+    }
+
+    Notechart merged;
+    std::vector<MergeConflict> conflicts =
+        merge_charts(charts[0], charts[1], charts[2], merged);
+
+    if (!export_chart(options.output, merged)) {
+        fmt::print(stderr, "{}: cannot write\n", options.output);
+        return 1;
+    }
+
+    for (MergeConflict &conflict : conflicts) {
+        fmt::print("conflict: row {} {}: {}\n", conflict.tick,
+                   lane_text[conflict.lane], conflict.reason);
+    }
+    fmt::print("{} notes merged, {} conflict(s)\n", merged.notes.size(),
+               conflicts.size());
+    return conflicts.empty() ? 0 : 1;
+}
+
+static std::string describe_note(const Note &note) {
+    std::string text = fmt::format("row {} {} {}", note.tick,
+                                   lane_text[note.lane], side_text[note.side]);
+    if (note.is_longnote) text += " long";
+    if (note.direction != DIR_NONE) {
+        text += fmt::format(" angle {}", (int)note.direction);
+    }
+    if (note.value != 0.0) text += fmt::format(" value {}", note.value);
+    return text;
+}
+
+// Compare two charts measure by measure; only the measures whose hashes
+// differ are read
+static int run_diff(const Options &options) {
+    if (options.files.size() != 2) {
+        fmt::print(stderr, "diff requires two charts\n");
+        return 2;
+    }
+
+    Notechart charts[2];
+    for (size_t i = 0; i < 2; i++) {
+        size_t dropped = 0;
+        if (!import_chart(options.files[i], charts[i], &dropped)) {
+            fmt::print(stderr, "{}: cannot import\n", options.files[i]);
+            return 1;
+        }
+        if (dropped > 0) {
+            fmt::print(stderr, "{}: {} duplicated cell(s) dropped\n",
+                       options.files[i], dropped);
+        }
+    }
+    Notechart &old_chart = charts[0];
+    Notechart &new_chart = charts[1];
+
+    if (old_chart.digest() == new_chart.digest()) {
+        fmt::print("same notes ({:016x})\n", old_chart.digest());
+        return 0;
+    }
+
+    std::vector<long> measures =
+        old_chart.content_digest().diff(new_chart.content_digest());
+    for (long measure : measures) {
+        fmt::print("#{:03d}:\n", measure);
+
+        // Both sides are ordered by (tick, lane), one note per cell
+        size_t i = old_chart.lower_bound_tick(measure * 192);
+        size_t j = new_chart.lower_bound_tick(measure * 192);
+        size_t i_end = old_chart.lower_bound_tick((measure + 1) * 192);
+        size_t j_end = new_chart.lower_bound_tick((measure + 1) * 192);
+        while (i < i_end || j < j_end) {
+            const Note *a = i < i_end ? old_chart.notes[i].get() : nullptr;
+            const Note *b = j < j_end ? new_chart.notes[j].get() : nullptr;
+            bool is_a_first =
+                a && (!b || std::make_pair(a->tick, a->lane) <
+                                std::make_pair(b->tick, b->lane));
+            bool is_b_first =
+                b && (!a || std::make_pair(b->tick, b->lane) <
+                                std::make_pair(a->tick, a->lane));
+            if (is_a_first) {
+                fmt::print("  - {}\n", describe_note(*a));
+                i++;
+            } else if (is_b_first) {
+                fmt::print("  + {}\n", describe_note(*b));
+                j++;
+            } else {
+                if (note_hash(*a) != note_hash(*b)) {
+                    fmt::print("  - {}\n  + {}\n", describe_note(*a),
+                               describe_note(*b));
+                }
+                i++;
+                j++;
+            }
+        }
+    }
+    fmt::print("{} of {} measure(s) differ\n", measures.size(),
+               std::max(old_chart.notes.empty()
+                            ? 0
+                            : old_chart.notes.back()->tick / 192 + 1,
+                        new_chart.notes.empty()
+                            ? 0
+                            : new_chart.notes.back()->tick / 192 + 1));
+    return 1;
+}
+
+struct BenchSource {
+    const std::vector<float> *samples;
+    size_t position;
+};
+
+static size_t read_bench_source(void *user_data, float *frames,
+                                size_t frame_count) {
+    BenchSource *source = (BenchSource *)user_data;
+    size_t count =
+        std::min(frame_count, source->samples->size() / 2 - source->position);
+    std::copy_n(source->samples->data() + source->position * 2, count * 2,
+                frames);
+    source->position += count;
+    return count;
+}
+
+// Stretch a whole song (or a synthetic one) in callback-sized blocks and
+// report how much faster than real time the stage runs
+static int run_stretch_bench(const Options &options) {
+    constexpr uint32_t SAMPLE_RATE = 48000;
+    constexpr size_t BLOCK_FRAMES = 512;
+
+    std::vector<float> samples;
+    if (!options.files.empty()) {
+        ma_decoder_config config =
+            ma_decoder_config_init(ma_format_f32, 2, SAMPLE_RATE);
+        ma_decoder decoder;
+        if (ma_decoder_init_file(options.files[0].c_str(), &config,
+                                 &decoder) != MA_SUCCESS) {
+            fmt::print(stderr, "{}: cannot decode\n", options.files[0]);
+            return 1;
+        }
+
+        float chunk[4096 * 2];
+        ma_uint64 frames_read = 0;
+        while (ma_decoder_read_pcm_frames(&decoder, chunk, 4096,
+                                          &frames_read) == MA_SUCCESS &&
+               frames_read > 0) {
+            samples.insert(samples.end(), chunk, chunk + frames_read * 2);
+        }
+        ma_decoder_uninit(&decoder);
+    } else {
+        // Two minutes of a chord with a decaying click on every beat
+        for (size_t i = 0; i < SAMPLE_RATE * 120; i++) {
+            double t = (double)i / SAMPLE_RATE;
+            double beat = std::fmod(t, 60.0 / 140.0);
+            float value = (float)(0.2 * std::sin(2 * M_PI * 220.0 * t) +
+                                  0.2 * std::sin(2 * M_PI * 277.2 * t) +
+                                  0.4 * std::exp(-beat * 40.0) *
+                                      std::sin(2 * M_PI * 1000.0 * t));
+            samples.push_back(value);
+            samples.push_back(value);
+        }
+    }
+
+    double song_seconds = (double)samples.size() / 2 / SAMPLE_RATE;
+    std::vector<float> block(BLOCK_FRAMES * 2);
+
+    for (double rate : {1.0, 0.75, 0.5}) {
+        TimeStretch stretch;
+        stretch.configure(2, SAMPLE_RATE);
+        stretch.set_rate(rate);
+
+        BenchSource source{&samples, 0};
+        size_t output_frames = 0, written = 0;
+        std::chrono::time_point<std::chrono::steady_clock> start =
+            std::chrono::steady_clock::now();
+        while ((written = stretch.process(block.data(), BLOCK_FRAMES,
+                                          read_bench_source, &source)) > 0) {
+            output_frames += written;
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        double output_seconds = (double)output_frames / SAMPLE_RATE;
+        fmt::print("{:.2f}x: {:.1f}s of song -> {:.1f}s of audio in {:.3f}s "
+                   "({:.0f}x real time, {:.1f} us per {}-frame block)\n",
+                   rate, song_seconds, output_seconds, elapsed.count(),
+                   output_seconds / elapsed.count(),
+                   elapsed.count() * 1e6 / (output_frames / BLOCK_FRAMES),
+                   BLOCK_FRAMES);
+    }
+    return 0;
+}
+
+// Apply each bulk transform to every note of a chart (or of 100k synthetic
+// notes) and time it
+static int run_transform_bench(const Options &options) {
+    Notechart chart;
+    if (!options.files.empty()) {
+        if (!import_chart(options.files[0], chart)) {
+            fmt::print(stderr, "{}: cannot import\n", options.files[0]);
+            return 1;
+        }
+    } else {
+        // Five hard notes per 1/16 row, a few ticks late so quantizing
+        // has something to move
+        std::vector<Note> notes;
+        for (long i = 0; i < 100000; i++) {
+            notes.push_back(Note((i / 5) * 12 + 3, (Lane)(LANE_H1 + i % 5),
+                                 i % 7 == 0 ? DIR_UP : DIR_NONE,
+                                 i % 2 == 0 ? SIDE_LEFT : SIDE_RIGHT,
+                                 false));
+        }
+        chart.add_notes(notes);
+    }
+
+    std::set<NoteHandle> ids;
+    for (std::shared_ptr<Note> &note : chart.notes) {
+        ids.insert(note->id);
+    }
+
+    auto time = [&](const char *name, auto &&transform) {
+        std::chrono::time_point<std::chrono::steady_clock> start =
+            std::chrono::steady_clock::now();
+        bool is_applied = transform();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        fmt::print("{:<12} {:>8.2f} ms  {:>7.1f} ns/note{}\n", name,
+                   elapsed.count() * 1e3, elapsed.count() * 1e9 / ids.size(),
+                   is_applied ? "" : "  (refused: cells collide)");
+    };
+
+    fmt::print("{} notes selected\n", ids.size());
+    time("shift +48", [&] { return chart.shift_notes(ids, 48); });
+    time("shift -48", [&] { return chart.shift_notes(ids, -48); });
+    time("mirror", [&] { return chart.mirror_notes(ids); });
+    time("swap sides", [&] {
+        chart.swap_sides(ids);
+        return true;
+    });
+    time("quantize 12", [&] { return chart.quantize_notes(ids, 12); });
+    time("scale 2x", [&] { return chart.scale_notes(ids, 2.0); });
+    time("scale 0.5x", [&] { return chart.scale_notes(ids, 0.5); });
+    return 0;
+}
+
+// Print the detected offset and tempo segments of each song
+static int run_tempo(const Options &options) {
+    ThreadPool pool(options.thread_count);
+
+    int status = 0;
+    for (const std::string &file_path : options.files) {
+        PcmBuffer pcm;
+        if (!decode_audio(file_path, 1, 44100, pcm)) {
+            fmt::print(stderr, "{}: cannot decode\n", file_path);
+            status = 1;
+            continue;
+        }
+
+        std::chrono::time_point<std::chrono::steady_clock> start =
+            std::chrono::steady_clock::now();
+        TempoEstimate estimate = detect_tempo(pcm, pool);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        if (estimate.segments.empty()) {
+            fmt::print(stderr, "{}: no beat found\n", file_path);
+            status = 1;
+            continue;
+        }
+
+        fmt::print("{}: offset {:.3f}s, {} beats in {:.1f}s ({:.3f}s)\n",
+                   file_path, estimate.offset, estimate.beats.size(),
+                   pcm.seconds(), elapsed.count());
+        for (const TempoSegment &segment : estimate.segments) {
+            fmt::print("  tick {:>7}  {:>8.3f}s  {:.2f} BPM\n", segment.tick,
+                       segment.seconds, segment.bpm);
+        }
+    }
+    return status;
+}
+
+// Render a chart's hitsounds over its song into a WAV file
+static int run_mixdown(const Options &options) {
+    if (options.files.size() != 2 || options.output.empty()) {
+        fmt::print(stderr, "mixdown requires -o OUT.wav, a chart and a song\n");
+        return 2;
+    }
+    const std::string &chart_path = options.files[0];
+    const std::string &song_path = options.files[1];
+
+    NoteFilter filter;
+    if (!parse_note_filter(options.difficulty, filter)) {
+        fmt::print(stderr, "unknown difficulty {}\n", options.difficulty);
+        return 2;
+    }
+
+    Notechart chart;
+    if (!import_chart(chart_path, chart)) {
+        fmt::print(stderr, "{}: cannot import\n", chart_path);
+        return 1;
+    }
+    TempoMap tempo_map(options.bpm);
+    tempo_map.build(chart);
+
+    MixdownOptions mixdown_options;
+    HitsoundSet hitsounds = default_hitsounds(mixdown_options.channels,
+                                              mixdown_options.sample_rate);
+    if (!options.hitsound_dir.empty()) {
+        size_t loaded = load_hitsounds(options.hitsound_dir,
+                                       mixdown_options.channels,
+                                       mixdown_options.sample_rate, hitsounds);
+        fmt::print("{} hitsound(s) loaded from {}\n", loaded,
+                   options.hitsound_dir);
+    }
+
+    std::vector<Hit> hits =
+        chart_hits(chart, tempo_map, options.offset, filter);
+
+    ThreadPool pool(options.thread_count);
+    MixdownStats stats;
+    std::chrono::time_point<std::chrono::steady_clock> start =
+        std::chrono::steady_clock::now();
+    if (!mixdown(song_path, hits, hitsounds, options.output, mixdown_options,
+                 pool, stats)) {
+        fmt::print(stderr, "cannot render {} into {}\n", song_path,
+                   options.output);
+        return 1;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double seconds = (double)stats.frames / mixdown_options.sample_rate;
+    fmt::print("{}: {:.1f}s with {} hits in {:.2f}s ({:.0f}x real time)\n",
+               options.output, seconds, stats.hits, elapsed.count(),
+               seconds / elapsed.count());
+    if (stats.clipped_samples > 0) {
+        fmt::print("  {} samples clipped\n", stats.clipped_samples);
+    }
+    return 0;
+}
+
+// Mirror the editor's chart over the live preview link until it closes
+static int run_subscribe(const Options &options) {
+    std::string socket_path = options.socket_path.empty()
+                                  ? default_preview_socket()
+                                  : options.socket_path;
+    LivePreviewClient client;
+    if (!client.connect(socket_path)) {
+        fmt::print(stderr, "{}: no editor is listening\n", socket_path);
+        return 1;
+    }
+
+    size_t packets = 0;
+    while (client.poll(1000)) {
+        if (client.packets == packets) continue;
+        fmt::print("#{} ({} frame(s)) {} notes (+{} -{} ~{}), {:.2f} BPM, "
+                   "offset {:.3f}s, tick {:.1f}{}\n",
+                   client.sequence, client.packets - packets,
+                   client.notes.size(), client.inserts,
+                   client.deletes, client.updates, client.transport.bpm,
+                   client.transport.offset, client.transport.tick,
+                   client.transport.is_playing ? " playing" : "");
+        packets = client.packets;
+    }
+    fmt::print("link closed after {} packets\n", client.packets);
+
+    if (!options.output.empty()) {
+        std::vector<Note> notes;
+        for (const auto &[id, note] : client.notes) {
+            notes.push_back(note);
+        }
+        Notechart chart;
+        chart.add_notes(notes);
+        if (!export_chart(options.output, chart)) {
+            fmt::print(stderr, "{}: cannot write\n", options.output);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Simulate every charted difficulty (or the one asked for) of each chart
+static int run_playtest(const Options &options) {
+    std::vector<Difficulty> difficulties;
+    for (size_t i = 0; i < difficulty_text.size(); i++) {
+        if (options.difficulty.empty() ||
+            options.difficulty == difficulty_text[i]) {
+            difficulties.push_back((Difficulty)i);
+        }
+    }
+    if (difficulties.empty()) {
+        fmt::print(stderr, "unknown difficulty {}\n", options.difficulty);
+        return 2;
+    }
+
+    JudgementWindows windows;
+    PlayerModel player;
+    player.timing_sigma = options.sigma_ms / 1000.0;
+    player.timing_bias = options.bias_ms / 1000.0;
+
+    ThreadPool pool(options.thread_count);
+
+    int status = 0;
+    for (const std::string &file_path : options.files) {
+        Notechart chart;
+        if (!import_chart(file_path, chart)) {
+            fmt::print(stderr, "{}: cannot import\n", file_path);
+            status = 1;
+            continue;
+        }
+
+        TempoMap tempo_map;
+        tempo_map.build(chart);
+
+        fmt::print("{}:\n", file_path);
+        for (Difficulty difficulty : difficulties) {
+            PlaytestReport report =
+                playtest(chart, difficulty, tempo_map, windows, player,
+                         options.runs, options.seed, pool);
+            if (report.notes == 0) continue;
+
+            long judged = report.notes * (long)report.runs;
+            fmt::print(
+                "  {}: {} notes, {} runs in {:.3f}s ({:.0f}x real time)\n"
+                "    accuracy {:.2f}% +- {:.2f}, full combo {:.1f}%\n"
+                "    perfect/great/good/miss: "
+                "{:.1f}/{:.1f}/{:.1f}/{:.1f}%\n",
+                difficulty_text[difficulty], report.notes, report.runs,
+                report.elapsed_seconds,
+                report.simulated_seconds / std::max(report.elapsed_seconds, 1e-9),
+                report.mean_accuracy * 100.0, report.accuracy_stddev * 100.0,
+                report.full_combo_rate * 100.0,
+                report.judgements[JUDGE_PERFECT] * 100.0 / judged,
+                report.judgements[JUDGE_GREAT] * 100.0 / judged,
+                report.judgements[JUDGE_GOOD] * 100.0 / judged,
+                report.judgements[JUDGE_MISS] * 100.0 / judged);
+
+            for (const MeasureReport &measure : report.hotspots(5)) {
+                fmt::print("    #{:03d}: {:.1f}% missed of {} notes, mostly "
+                           "{}\n",
+                           measure.measure,
+                           measure.miss_rate(report.runs) * 100.0,
+                           measure.notes,
+                           miss_reason_text[measure.main_miss_reason()]);
+            }
+        }
+    }
+    return status;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    if (options.command == "merge") {
+        return run_merge(options);
+    }
+    if (options.command == "diff") {
+        return run_diff(options);
+    }
+    if (options.command == "stretch-bench") {
+        return run_stretch_bench(options);
+    }
+    if (options.command == "transform-bench") {
+        return run_transform_bench(options);
+    }
+    if (options.command == "tempo") {
+        return run_tempo(options);
+    }
+    if (options.command == "playtest") {
+        return run_playtest(options);
+    }
+    if (options.command == "mixdown") {
+        return run_mixdown(options);
+    }
+    if (options.command == "subscribe") {
+        return run_subscribe(options);
+    }
+
+    if (options.command != "validate" && options.command != "normalize" &&
+        options.command != "convert" && options.command != "stats") {
+        print_usage();
+        return 2;
+    }
+    if (options.command == "convert" && options.output.empty()) {
+        fmt::print(stderr, "convert requires -o DIR\n");
+        return 2;
+    }
+    if (!options.output.empty()) {
+        std::filesystem::create_directories(options.output);
+    }
+
+    if (!options.trace_path.empty()) {
+        Tracer::start();
+    }
+
+    std::vector<std::string> reports(options.files.size());
+    std::vector<char> results(options.files.size(), false);
+    {
+        ThreadPool pool(options.thread_count);
+        pool.parallel_for(0, options.files.size(), 1, [&](size_t i) {
+            results[i] = process_file(options, options.files[i], reports[i]);
+        });
+    }
+
+    // Reports come out in input order regardless of completion order
+    size_t failures = 0;
+    for (size_t i = 0; i < options.files.size(); i++) {
+        fmt::print("{}", reports[i]);
+        failures += !results[i];
+    }
+
+    if (!options.trace_path.empty()) {
+        Tracer::stop();
+        Tracer::dump(options.trace_path);
+    }
+
+    if (options.files.size() > 1) {
+        fmt::print("{} file(s), {} failed\n", options.files.size(), failures);
+    }
+    return failures == 0 ? 0 : 1;
+}
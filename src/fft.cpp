@@ -0,0 +1,96 @@
+#include "../include/fft.hpp"
+
+#include <cmath>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+FFT::FFT(size_t _size) : length(_size) {
+    size_t bits = 0;
+    while (((size_t)1 << bits) < _size) bits++;
+
+    this->bit_reverse.resize(_size);
+    for (size_t i = 0; i < _size; i++) {
+        uint32_t reversed = 0;
+        for (size_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        this->bit_reverse[i] = reversed;
+    }
+
+    for (size_t half = 1; half < _size; half *= 2) {
+        for (size_t k = 0; k < half; k++) {
+            double angle = -M_PI * k / half;
+            this->twiddle_re.push_back((float)std::cos(angle));
+            this->twiddle_im.push_back((float)std::sin(angle));
+        }
+    }
+
+    this->window.resize(_size);
+    for (size_t i = 0; i < _size; i++) {
+        this->window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / _size));
+    }
+}
+
+void FFT::forward(float *re, float *im) const {
+    for (size_t i = 0; i < this->length; i++) {
+        size_t j = this->bit_reverse[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    size_t stage_offset = 0;
+    for (size_t half = 1; half < this->length; half *= 2) {
+        const float *wr = &this->twiddle_re[stage_offset];
+        const float *wi = &this->twiddle_im[stage_offset];
+
+        for (size_t block = 0; block < this->length; block += 2 * half) {
+            float *ar = re + block, *ai = im + block;
+            float *br = ar + half, *bi = ai + half;
+
+            size_t k = 0;
+#ifdef __SSE2__
+            // Four butterflies at a time once the stage is wide enough
+            for (; k + 4 <= half; k += 4) {
+                __m128 twr = _mm_loadu_ps(wr + k), twi = _mm_loadu_ps(wi + k);
+                __m128 xr = _mm_loadu_ps(br + k), xi = _mm_loadu_ps(bi + k);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, twr), _mm_mul_ps(xi, twi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, twi), _mm_mul_ps(xi, twr));
+                __m128 yr = _mm_loadu_ps(ar + k), yi = _mm_loadu_ps(ai + k);
+                _mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+                _mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+            }
+#endif
+            for (; k < half; k++) {
+                float tr = br[k] * wr[k] - bi[k] * wi[k];
+                float ti = br[k] * wi[k] + bi[k] * wr[k];
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+
+        stage_offset += half;
+    }
+}
+
+void FFT::magnitudes(const float *frame, float *magnitudes, float *re,
+                     float *im) const {
+    for (size_t i = 0; i < this->length; i++) {
+        re[i] = frame[i] * this->window[i];
+        im[i] = 0.0f;
+    }
+
+    this->forward(re, im);
+
+    for (size_t k = 0; k <= this->length / 2; k++) {
+        magnitudes[k] = std::sqrt(re[k] * re[k] + im[k] * im[k]);
+    }
+}
@@ -0,0 +1,29 @@
+#include "../include/frame_stats.hpp"
+
+#include <algorithm>
+
+void FrameStats::begin_frame() { this->counters = FrameCounters(); }
+
+void FrameStats::end_frame(double frame_time) {
+    this->latest = this->counters;
+
+    this->frame_times[this->cursor] = frame_time;
+    this->cursor = (this->cursor + 1) % WINDOW_SIZE;
+    this->count = std::min(this->count + 1, WINDOW_SIZE);
+}
+
+void FrameStats::percentiles(double &p50, double &p95, double &p99) const {
+    if (this->count == 0) {
+        p50 = p95 = p99 = 0.0;
+        return;
+    }
+
+    // The window is small, so sorting a copy is cheaper than keeping a
+    // running order statistic up to date every frame
+    std::array<double, WINDOW_SIZE> sorted = this->frame_times;
+    std::sort(sorted.begin(), sorted.begin() + this->count);
+
+    p50 = sorted[(this->count - 1) * 50 / 100];
+    p95 = sorted[(this->count - 1) * 95 / 100];
+    p99 = sorted[(this->count - 1) * 99 / 100];
+}
@@ -0,0 +1,126 @@
+#include "../include/label_cache.hpp"
+
+#include <wx/dcmemory.h>
+
+#include <algorithm>
+#include <cmath>
+
+LabelCache::LabelCache(size_t _memory_budget) : memory_budget(_memory_budget) {}
+
+size_t LabelCache::KeyHash::operator()(const Key &key) const {
+    size_t hash = std::hash<std::string>()(key.text);
+    for (unsigned long value :
+         {(unsigned long)key.point_size, (unsigned long)key.weight,
+          (unsigned long)key.angle, key.colour}) {
+        hash ^= std::hash<unsigned long>()(value) + 0x9e3779b9 + (hash << 6) +
+                (hash >> 2);
+    }
+    return hash;
+}
+
+const LabelCache::Label &LabelCache::get(const std::string &text,
+                                         const wxFont &font,
+                                         const wxColour &colour,
+                                         double angle) {
+    Key key{text, font.GetPointSize(), font.GetWeight(), (int)std::lround(angle),
+            ((unsigned long)colour.Red() << 16) |
+                ((unsigned long)colour.Green() << 8) | colour.Blue()};
+
+    auto it = this->index.find(key);
+    if (it != this->index.end()) {
+        this->hits++;
+        this->entries.splice(this->entries.begin(), this->entries, it->second);
+        return it->second->second;
+    }
+
+    this->misses++;
+    Label label = this->render(text, font, colour, angle);
+    this->used_bytes += label.bytes;
+    this->entries.emplace_front(key, std::move(label));
+    this->index[key] = this->entries.begin();
+
+    // Evict from the cold end, but never the label just created
+    while (this->used_bytes > this->memory_budget && this->entries.size() > 1) {
+        this->used_bytes -= this->entries.back().second.bytes;
+        this->index.erase(this->entries.back().first);
+        this->entries.pop_back();
+    }
+
+    return this->entries.front().second;
+}
+
+void LabelCache::clear() {
+    this->entries.clear();
+    this->index.clear();
+    this->used_bytes = 0;
+}
+
+LabelCache::Label LabelCache::render(const std::string &text,
+                                     const wxFont &font, const wxColour &colour,
+                                     double angle) {
+    wxString label_text = wxString::FromUTF8(text.c_str());
+
+    wxMemoryDC measure_dc;
+    measure_dc.SetFont(font);
+    wxCoord text_width, text_height;
+    measure_dc.GetTextExtent(label_text, &text_width, &text_height);
+
+    // Bounding box of the text rotated counter-clockwise around its origin
+    double radians = angle * M_PI / 180.0;
+    double c = std::cos(radians), s = std::sin(radians);
+    double xs[4] = {0.0, text_width * c, text_height * s,
+                    text_width * c + text_height * s};
+    double ys[4] = {0.0, -text_width * s, text_height * c,
+                    -text_width * s + text_height * c};
+    wxCoord min_x = (wxCoord)std::floor(*std::min_element(xs, xs + 4));
+    wxCoord min_y = (wxCoord)std::floor(*std::min_element(ys, ys + 4));
+    wxCoord max_x = (wxCoord)std::ceil(*std::max_element(xs, xs + 4));
+    wxCoord max_y = (wxCoord)std::ceil(*std::max_element(ys, ys + 4));
+    wxCoord width = std::max(max_x - min_x, 1);
+    wxCoord height = std::max(max_y - min_y, 1);
+
+    // Draw white-on-black to get the glyph coverage
+    wxBitmap coverage_bitmap(width, height, 24);
+    {
+        wxMemoryDC dc(coverage_bitmap);
+        dc.SetBackground(*wxBLACK_BRUSH);
+        dc.Clear();
+        dc.SetFont(font);
+        dc.SetTextForeground(*wxWHITE);
+        if (angle == 0.0) {
+            dc.DrawText(label_text, -min_x, -min_y);
+        } else {
+            dc.DrawRotatedText(label_text, -min_x, -min_y, angle);
+        }
+    }
+    wxImage coverage = coverage_bitmap.ConvertToImage();
+
+    // Solid colour with the coverage as alpha
+    std::shared_ptr<RasterMask> mask = std::make_shared<RasterMask>();
+    mask->width = width;
+    mask->height = height;
+    mask->colour = 0xff000000 | ((uint32_t)colour.Red() << 16) |
+                   ((uint32_t)colour.Green() << 8) | colour.Blue();
+    mask->alpha.resize((size_t)width * height);
+
+    wxImage image(width, height, false);
+    image.InitAlpha();
+    unsigned char *rgb = image.GetData();
+    unsigned char *alpha = image.GetAlpha();
+    const unsigned char *source = coverage.GetData();
+    for (int i = 0; i < width * height; i++) {
+        rgb[i * 3 + 0] = colour.Red();
+        rgb[i * 3 + 1] = colour.Green();
+        rgb[i * 3 + 2] = colour.Blue();
+        alpha[i] = source[i * 3];
+        mask->alpha[i] = source[i * 3];
+    }
+
+    Label label;
+    label.bitmap = wxBitmap(image, 32);
+    label.offset_x = min_x;
+    label.offset_y = min_y;
+    label.mask = std::move(mask);
+    label.bytes = (size_t)width * height * 5;
+    return label;
+}
@@ -0,0 +1,566 @@
+#include "../include/live_preview.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define THAPSTEAK_LIVE_PREVIEW 1
+#endif
+
+#include "../include/trace.hpp"
+
+// A subscriber further behind than this is dropped rather than buffered for
+static constexpr size_t MAX_BACKLOG = 4 << 20;
+
+namespace {
+
+// Fields are written in host order; every host we build for is
+// little-endian
+template <typename T>
+void put(std::vector<uint8_t> &out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void put_id(std::vector<uint8_t> &out, NoteHandle id) {
+    put<uint32_t>(out, id.index);
+    put<uint32_t>(out, id.generation);
+}
+
+void put_insert(std::vector<uint8_t> &out, const Note &note) {
+    put<uint8_t>(out, PREVIEW_INSERT);
+    put_id(out, note.id);
+    put<int32_t>(out, (int32_t)note.tick);
+    put<uint8_t>(out, (uint8_t)note.lane);
+    put<int16_t>(out, (int16_t)note.direction);
+    put<uint8_t>(out, (uint8_t)note.side);
+    put<uint8_t>(out, note.is_longnote);
+    put<float>(out, note.value);
+}
+
+void put_delete(std::vector<uint8_t> &out, NoteHandle id) {
+    put<uint8_t>(out, PREVIEW_DELETE);
+    put_id(out, id);
+}
+
+// False when nothing differs
+bool put_update(std::vector<uint8_t> &out, const Note &from, const Note &to) {
+    uint8_t mask = (from.tick != to.tick ? PREVIEW_FIELD_TICK : 0) |
+                   (from.lane != to.lane ? PREVIEW_FIELD_LANE : 0) |
+                   (from.direction != to.direction ? PREVIEW_FIELD_DIRECTION
+                                                   : 0) |
+                   (from.side != to.side ? PREVIEW_FIELD_SIDE : 0) |
+                   (from.is_longnote != to.is_longnote
+                        ? PREVIEW_FIELD_LONGNOTE
+                        : 0) |
+                   (from.value != to.value ? PREVIEW_FIELD_VALUE : 0);
+    if (mask == 0) return false;
+
+    put<uint8_t>(out, PREVIEW_UPDATE);
+    put_id(out, to.id);
+    put<uint8_t>(out, mask);
+    if (mask & PREVIEW_FIELD_TICK) put<int32_t>(out, (int32_t)to.tick);
+    if (mask & PREVIEW_FIELD_LANE) put<uint8_t>(out, (uint8_t)to.lane);
+    if (mask & PREVIEW_FIELD_DIRECTION) {
+        put<int16_t>(out, (int16_t)to.direction);
+    }
+    if (mask & PREVIEW_FIELD_SIDE) put<uint8_t>(out, (uint8_t)to.side);
+    if (mask & PREVIEW_FIELD_LONGNOTE) put<uint8_t>(out, to.is_longnote);
+    if (mask & PREVIEW_FIELD_VALUE) put<float>(out, to.value);
+    return true;
+}
+
+void put_tempo(std::vector<uint8_t> &out, const PreviewTransport &transport) {
+    put<uint8_t>(out, PREVIEW_TEMPO);
+    put<double>(out, transport.bpm);
+    put<double>(out, transport.offset);
+}
+
+void put_playhead(std::vector<uint8_t> &out,
+                  const PreviewTransport &transport) {
+    put<uint8_t>(out, PREVIEW_PLAYHEAD);
+    put<double>(out, transport.tick);
+    put<double>(out, transport.song_seconds);
+    put<uint8_t>(out, transport.is_playing);
+}
+
+// Bounds-checked cursor over a received packet
+struct Reader {
+    const uint8_t *data;
+    size_t size;
+
+    template <typename T>
+    bool get(T &value) {
+        if (this->size < sizeof(T)) return false;
+        std::memcpy(&value, this->data, sizeof(T));
+        this->data += sizeof(T);
+        this->size -= sizeof(T);
+        return true;
+    }
+
+    bool get_id(NoteHandle &id) {
+        return this->get(id.index) && this->get(id.generation);
+    }
+};
+
+bool read_tick(Reader &reader, Note &note) {
+    int32_t tick;
+    if (!reader.get(tick)) return false;
+    note.tick = tick;
+    return true;
+}
+
+bool read_lane(Reader &reader, Note &note) {
+    uint8_t lane;
+    if (!reader.get(lane) || lane > LANE_E3) return false;
+    note.lane = (Lane)lane;
+    return true;
+}
+
+bool read_direction(Reader &reader, Note &note) {
+    int16_t direction;
+    if (!reader.get(direction) || !is_direction(direction)) return false;
+    note.direction = (Direction)direction;
+    return true;
+}
+
+bool read_side(Reader &reader, Note &note) {
+    uint8_t side;
+    if (!reader.get(side) || side > SIDE_RIGHT) return false;
+    note.side = (Side)side;
+    return true;
+}
+
+bool read_longnote(Reader &reader, Note &note) {
+    uint8_t is_longnote;
+    if (!reader.get(is_longnote)) return false;
+    note.is_longnote = is_longnote != 0;
+    return true;
+}
+
+}  // namespace
+
+std::string default_preview_socket() {
+    std::error_code error;
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path(error);
+    if (error) directory = "/tmp";
+    return (directory / "thapsteak-preview.sock").string();
+}
+
+size_t encode_chart_delta(const ChartSnapshot *from, const ChartSnapshot &to,
+                          std::vector<uint8_t> &out) {
+    TRACE_SCOPE("live_preview/encode");
+
+    size_t messages = 0;
+    if (!from) {
+        put<uint8_t>(out, PREVIEW_RESET);
+        messages++;
+        to.for_each([&](const Note &note) {
+            put_insert(out, note);
+            messages++;
+        });
+        return messages;
+    }
+
+    // Notes of the measures that differ; a note that moved to another
+    // measure shows up on both sides and becomes an update
+    std::vector<const Note *> old_notes, new_notes;
+    const auto &a = from->measures();
+    const auto &b = to.measures();
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i]->measure < b[j]->measure)) {
+            for (const Note &note : a[i]->notes) old_notes.push_back(&note);
+            i++;
+        } else if (i == a.size() || b[j]->measure < a[i]->measure) {
+            for (const Note &note : b[j]->notes) new_notes.push_back(&note);
+            j++;
+        } else {
+            if (a[i] != b[j]) {
+                for (const Note &note : a[i]->notes) old_notes.push_back(&note);
+                for (const Note &note : b[j]->notes) new_notes.push_back(&note);
+            }
+            i++;
+            j++;
+        }
+    }
+
+    auto by_id = [](const Note *x, const Note *y) { return x->id < y->id; };
+    std::sort(old_notes.begin(), old_notes.end(), by_id);
+    std::sort(new_notes.begin(), new_notes.end(), by_id);
+
+    // Inserts go last, after the notes they may replace are deleted
+    auto old_note = old_notes.begin();
+    auto new_note = new_notes.begin();
+    std::vector<const Note *> inserts;
+    while (old_note != old_notes.end() || new_note != new_notes.end()) {
+        if (new_note == new_notes.end() ||
+            (old_note != old_notes.end() &&
+             (*old_note)->id < (*new_note)->id)) {
+            put_delete(out, (*old_note)->id);
+            messages++;
+            old_note++;
+        } else if (old_note == old_notes.end() ||
+                   (*new_note)->id < (*old_note)->id) {
+            inserts.push_back(*new_note);
+            new_note++;
+        } else {
+            messages += put_update(out, **old_note, **new_note);
+            old_note++;
+            new_note++;
+        }
+    }
+    for (const Note *note : inserts) {
+        put_insert(out, *note);
+        messages++;
+    }
+    return messages;
+}
+
+LivePreviewServer::~LivePreviewServer() { this->stop(); }
+
+#ifdef THAPSTEAK_LIVE_PREVIEW
+
+static bool make_address(const std::string &socket_path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+    return true;
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+bool LivePreviewServer::start(const std::string &socket_path) {
+    this->stop();
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+
+    // Left behind by an editor that did not shut down cleanly
+    unlink(socket_path.c_str());
+    if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, 4) != 0) {
+        ::close(fd);
+        return false;
+    }
+    set_nonblocking(fd);
+
+    this->path = socket_path;
+    this->listen_fd = fd;
+    this->sent_snapshot.reset();
+    this->packet_size = 0;
+    return true;
+}
+
+void LivePreviewServer::stop() {
+    if (this->listen_fd < 0) return;
+
+    for (Subscriber &subscriber : this->subscribers) {
+        ::close(subscriber.fd);
+    }
+    this->subscribers.clear();
+    ::close(this->listen_fd);
+    this->listen_fd = -1;
+    unlink(this->path.c_str());
+}
+
+bool LivePreviewServer::send(Subscriber &subscriber,
+                             const std::vector<uint8_t> &packet) {
+    subscriber.backlog.insert(subscriber.backlog.end(), packet.begin(),
+                              packet.end());
+
+    size_t sent = 0;
+    while (sent < subscriber.backlog.size()) {
+#ifdef MSG_NOSIGNAL
+        ssize_t n = ::send(subscriber.fd, subscriber.backlog.data() + sent,
+                           subscriber.backlog.size() - sent, MSG_NOSIGNAL);
+#else
+        ssize_t n = ::send(subscriber.fd, subscriber.backlog.data() + sent,
+                           subscriber.backlog.size() - sent, 0);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    subscriber.backlog.erase(subscriber.backlog.begin(),
+                             subscriber.backlog.begin() + sent);
+    return subscriber.backlog.size() <= MAX_BACKLOG;
+}
+
+void LivePreviewServer::publish(std::shared_ptr<const ChartSnapshot> snapshot,
+                                const PreviewTransport &transport) {
+    if (this->listen_fd < 0 || !snapshot) return;
+    TRACE_SCOPE("live_preview/publish");
+
+    // Subscribers never write, so a readable socket means it was closed
+    std::erase_if(this->subscribers, [](Subscriber &subscriber) {
+        uint8_t byte;
+        ssize_t n = recv(subscriber.fd, &byte, 1, MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            ::close(subscriber.fd);
+            return true;
+        }
+        return false;
+    });
+
+    size_t new_subscribers = 0;
+    for (;;) {
+        int fd = accept(this->listen_fd, nullptr, nullptr);
+        if (fd < 0) break;
+        set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        this->subscribers.push_back(Subscriber{fd, {}});
+        new_subscribers++;
+    }
+
+    const PreviewTransport &sent = this->sent_transport;
+    bool is_tempo_changed =
+        transport.bpm != sent.bpm || transport.offset != sent.offset;
+    bool is_playhead_changed = transport.tick != sent.tick ||
+                               transport.song_seconds != sent.song_seconds ||
+                               transport.is_playing != sent.is_playing;
+
+    // The delta goes to everyone who already has the previous state
+    std::vector<uint8_t> delta;
+    size_t old_subscribers = this->subscribers.size() - new_subscribers;
+    if (old_subscribers > 0 && this->sent_snapshot) {
+        this->begin_packet(delta);
+        size_t messages = 0;
+        if (snapshot != this->sent_snapshot) {
+            messages += encode_chart_delta(this->sent_snapshot.get(),
+                                           *snapshot, delta);
+        }
+        if (is_tempo_changed) {
+            put_tempo(delta, transport);
+            messages++;
+        }
+        if (is_playhead_changed) {
+            put_playhead(delta, transport);
+            messages++;
+        }
+        if (messages > 0) {
+            this->end_packet(delta, messages);
+            this->packet_size = delta.size();
+        } else {
+            delta.clear();
+        }
+    }
+
+    std::vector<uint8_t> resync;
+    if (new_subscribers > 0) {
+        this->begin_packet(resync);
+        size_t messages = encode_chart_delta(nullptr, *snapshot, resync);
+        put_tempo(resync, transport);
+        put_playhead(resync, transport);
+        this->end_packet(resync, messages + 2);
+    }
+
+    // An empty packet still flushes what an earlier frame could not send
+    for (size_t i = 0; i < this->subscribers.size();) {
+        Subscriber &subscriber = this->subscribers[i];
+        const std::vector<uint8_t> &packet =
+            i < old_subscribers ? delta : resync;
+        if (!this->send(subscriber, packet)) {
+            ::close(subscriber.fd);
+            this->subscribers.erase(this->subscribers.begin() + i);
+            old_subscribers -= i < old_subscribers;
+        } else {
+            i++;
+        }
+    }
+
+    this->sent_snapshot = std::move(snapshot);
+    this->sent_transport = transport;
+}
+
+LivePreviewClient::~LivePreviewClient() { this->close(); }
+
+bool LivePreviewClient::connect(const std::string &socket_path) {
+    this->close();
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (::connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+        ::close(fd);
+        return false;
+    }
+    this->fd = fd;
+    return true;
+}
+
+void LivePreviewClient::close() {
+    if (this->fd < 0) return;
+    ::close(this->fd);
+    this->fd = -1;
+    this->buffer.clear();
+}
+
+bool LivePreviewClient::poll(int timeout_ms) {
+    if (this->fd < 0) return false;
+
+    pollfd descriptor{this->fd, POLLIN, 0};
+    int ready = ::poll(&descriptor, 1, timeout_ms);
+    if (ready < 0) return errno == EINTR;
+    if (ready == 0) return true;
+
+    this->inserts = this->deletes = this->updates = 0;
+
+    uint8_t chunk[65536];
+    ssize_t n = recv(this->fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) return n < 0 && errno == EINTR;
+    this->buffer.insert(this->buffer.end(), chunk, chunk + n);
+
+    size_t offset = 0;
+    while (this->buffer.size() - offset >= sizeof(uint32_t)) {
+        uint32_t length;
+        std::memcpy(&length, this->buffer.data() + offset, sizeof(length));
+        if (this->buffer.size() - offset - sizeof(length) < length) break;
+        if (!this->apply(this->buffer.data() + offset + sizeof(length),
+                         length)) {
+            return false;
+        }
+        offset += sizeof(length) + length;
+    }
+    this->buffer.erase(this->buffer.begin(), this->buffer.begin() + offset);
+    return true;
+}
+
+#else
+
+bool LivePreviewServer::start(const std::string &) { return false; }
+
+void LivePreviewServer::stop() {}
+
+bool LivePreviewServer::send(Subscriber &, const std::vector<uint8_t> &) {
+    return false;
+}
+
+void LivePreviewServer::publish(std::shared_ptr<const ChartSnapshot>,
+                                const PreviewTransport &) {}
+
+LivePreviewClient::~LivePreviewClient() {}
+
+bool LivePreviewClient::connect(const std::string &) { return false; }
+
+void LivePreviewClient::close() {}
+
+bool LivePreviewClient::poll(int) { return false; }
+
+#endif
+
+void LivePreviewServer::begin_packet(std::vector<uint8_t> &packet) {
+    packet.clear();
+    put<uint32_t>(packet, 0);
+    put<uint32_t>(packet, this->sequence++);
+    put<uint16_t>(packet, 0);
+}
+
+void LivePreviewServer::end_packet(std::vector<uint8_t> &packet,
+                                   size_t message_count) {
+    // Larger frames (a resync of a big chart) saturate the count; readers
+    // go by the length
+    uint32_t length = (uint32_t)(packet.size() - sizeof(uint32_t));
+    uint16_t count = (uint16_t)std::min<size_t>(message_count, UINT16_MAX);
+    std::memcpy(packet.data(), &length, sizeof(length));
+    std::memcpy(packet.data() + sizeof(uint32_t) * 2, &count, sizeof(count));
+}
+
+bool LivePreviewClient::apply(const uint8_t *data, size_t size) {
+    Reader reader{data, size};
+    uint16_t count;
+    if (!reader.get(this->sequence) || !reader.get(count)) return false;
+
+    this->packets++;
+    while (reader.size > 0) {
+        uint8_t type;
+        reader.get(type);
+        switch (type) {
+            case PREVIEW_RESET:
+                this->notes.clear();
+                break;
+            case PREVIEW_INSERT: {
+                Note note(0, LANE_BPM, DIR_NONE, SIDE_NONE, false);
+                if (!reader.get_id(note.id) || !read_tick(reader, note) ||
+                    !read_lane(reader, note) ||
+                    !read_direction(reader, note) ||
+                    !read_side(reader, note) || !read_longnote(reader, note) ||
+                    !reader.get(note.value)) {
+                    return false;
+                }
+                this->notes.insert_or_assign(note.id, note);
+                this->inserts++;
+                break;
+            }
+            case PREVIEW_DELETE: {
+                NoteHandle id;
+                if (!reader.get_id(id)) return false;
+                this->notes.erase(id);
+                this->deletes++;
+                break;
+            }
+            case PREVIEW_UPDATE: {
+                NoteHandle id;
+                uint8_t mask;
+                if (!reader.get_id(id) || !reader.get(mask)) return false;
+                auto it = this->notes.find(id);
+                if (it == this->notes.end()) return false;
+                Note &note = it->second;
+                if (((mask & PREVIEW_FIELD_TICK) && !read_tick(reader, note)) ||
+                    ((mask & PREVIEW_FIELD_LANE) && !read_lane(reader, note)) ||
+                    ((mask & PREVIEW_FIELD_DIRECTION) &&
+                     !read_direction(reader, note)) ||
+                    ((mask & PREVIEW_FIELD_SIDE) && !read_side(reader, note)) ||
+                    ((mask & PREVIEW_FIELD_LONGNOTE) &&
+                     !read_longnote(reader, note)) ||
+                    ((mask & PREVIEW_FIELD_VALUE) && !reader.get(note.value))) {
+                    return false;
+                }
+                this->updates++;
+                break;
+            }
+            case PREVIEW_TEMPO:
+                if (!reader.get(this->transport.bpm) ||
+                    !reader.get(this->transport.offset)) {
+                    return false;
+                }
+                break;
+            case PREVIEW_PLAYHEAD: {
+                uint8_t is_playing;
+                if (!reader.get(this->transport.tick) ||
+                    !reader.get(this->transport.song_seconds) ||
+                    !reader.get(is_playing)) {
+                    return false;
+                }
+                this->transport.is_playing = is_playing != 0;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+#include "../include/merge.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <climits>
+
+#include "../include/trace.hpp"
+
+// Resolve one field; returns false if both sides changed it differently
+template <typename T>
+static bool merge_field(const T *base, const T &ours, const T &theirs,
+                        T &result) {
+    if (ours == theirs || (base != nullptr && theirs == *base)) {
+        result = ours;
+        return true;
+    }
+    if (base != nullptr && ours == *base) {
+        result = theirs;
+        return true;
+    }
+    result = ours;
+    return false;
+}
+
+static bool is_same_content(const Note &a, const Note &b) {
+    return a.side == b.side && a.direction == b.direction &&
+           a.is_longnote == b.is_longnote && a.value == b.value;
+}
+
+static void merge_cell(const Note *base, const Note *ours, const Note *theirs,
+                       std::vector<Note> &merged_notes,
+                       std::vector<MergeConflict> &conflicts) {
+    if (ours == nullptr && theirs == nullptr) {
+        // Deleted on both sides, or never there
+        return;
+    }
+
+    if (ours == nullptr || theirs == nullptr) {
+        const Note *kept = (ours != nullptr) ? ours : theirs;
+
+        if (base == nullptr) {
+            // Added on one side only
+            merged_notes.push_back(*kept);
+        } else if (!is_same_content(*base, *kept)) {
+            // Deleted on one side, edited on the other; keep the edit
+            merged_notes.push_back(*kept);
+            conflicts.push_back(MergeConflict{
+                kept->tick, kept->lane,
+                (ours == nullptr) ? "deleted in ours, modified in theirs"
+                                  : "modified in ours, deleted in theirs"});
+        }
+        return;
+    }
+
+    Note result = *ours;
+    std::string reason;
+
+    if (!merge_field(base ? &base->side : nullptr, ours->side, theirs->side,
+                     result.side)) {
+        reason += "side ";
+    }
+    if (!merge_field(base ? &base->direction : nullptr, ours->direction,
+                     theirs->direction, result.direction)) {
+        reason += "direction ";
+    }
+    if (!merge_field(base ? &base->is_longnote : nullptr, ours->is_longnote,
+                     theirs->is_longnote, result.is_longnote)) {
+        reason += "longNote ";
+    }
+    if (!merge_field(base ? &base->value : nullptr, ours->value, theirs->value,
+                     result.value)) {
+        reason += "value ";
+    }
+
+    if (!reason.empty()) {
+        reason.pop_back();
+        conflicts.push_back(MergeConflict{
+            result.tick, result.lane,
+            fmt::format("{} changed on both sides", reason)});
+    }
+
+    merged_notes.push_back(result);
+}
+
+std::vector<MergeConflict> merge_charts(const Notechart &base,
+                                        const Notechart &ours,
+                                        const Notechart &theirs,
+                                        Notechart &merged) {
+    TRACE_SCOPE("merge_charts");
+
+    std::vector<MergeConflict> conflicts;
+    std::vector<Note> merged_notes;
+    merged_notes.reserve(std::max(ours.notes.size(), theirs.notes.size()));
+
+    auto key_of = [](const std::shared_ptr<Note> &note) {
+        return std::make_pair(note->tick, (int)note->lane);
+    };
+
+    size_t b = 0, o = 0, t = 0;
+    while (b < base.notes.size() || o < ours.notes.size() ||
+           t < theirs.notes.size()) {
+        // Smallest (tick, lane) among the three heads
+        std::pair<long, int> key{LONG_MAX, INT_MAX};
+        if (b < base.notes.size()) key = std::min(key, key_of(base.notes[b]));
+        if (o < ours.notes.size()) key = std::min(key, key_of(ours.notes[o]));
+        if (t < theirs.notes.size()) {
+            key = std::min(key, key_of(theirs.notes[t]));
+        }
+
+        const Note *base_note = nullptr, *our_note = nullptr,
+                   *their_note = nullptr;
+        if (b < base.notes.size() && key_of(base.notes[b]) == key) {
+            base_note = base.notes[b++].get();
+        }
+        if (o < ours.notes.size() && key_of(ours.notes[o]) == key) {
+            our_note = ours.notes[o++].get();
+        }
+        if (t < theirs.notes.size() && key_of(theirs.notes[t]) == key) {
+            their_note = theirs.notes[t++].get();
+        }
+
+        merge_cell(base_note, our_note, their_note, merged_notes, conflicts);
+    }
+
+    merged.add_notes(merged_notes);
+    return conflicts;
+}
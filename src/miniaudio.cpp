@@ -0,0 +1,4 @@
+// The one translation unit that compiles miniaudio, shared by the editor and
+// the command-line tool
+#define MINIAUDIO_IMPLEMENTATION
+#include "../third_party/miniaudio.h"
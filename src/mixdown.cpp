@@ -0,0 +1,275 @@
+#include "../include/mixdown.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+
+#include "../include/trace.hpp"
+#include "../third_party/miniaudio.h"
+
+// Decaying sine, `frequency` Hz with a touch of its fifth above
+static PcmBuffer synthesize_tick(uint32_t channels, uint32_t sample_rate,
+                                 double frequency, double decay,
+                                 double seconds) {
+    PcmBuffer pcm;
+    pcm.channels = channels;
+    pcm.sample_rate = sample_rate;
+
+    size_t frames = (size_t)(seconds * sample_rate);
+    pcm.samples.resize(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        double t = (double)i / sample_rate;
+        float value = (float)(0.5 * std::exp(-t * decay) *
+                              (std::sin(2 * M_PI * frequency * t) +
+                               0.3 * std::sin(2 * M_PI * frequency * 1.5 * t)));
+        std::fill_n(pcm.samples.begin() + i * channels, channels, value);
+    }
+    return pcm;
+}
+
+HitsoundSet default_hitsounds(uint32_t channels, uint32_t sample_rate) {
+    HitsoundSet hitsounds;
+    hitsounds.sounds[HITSOUND_HARD] =
+        synthesize_tick(channels, sample_rate, 2200.0, 120.0, 0.04);
+    hitsounds.sounds[HITSOUND_NORMAL] =
+        synthesize_tick(channels, sample_rate, 1500.0, 90.0, 0.05);
+    hitsounds.sounds[HITSOUND_EASY] =
+        synthesize_tick(channels, sample_rate, 900.0, 70.0, 0.06);
+
+    // Flick: differenced white noise (so mostly highs) under a half-sine
+    // swell, from a fixed seed so every render is identical
+    PcmBuffer &flick = hitsounds.sounds[HITSOUND_FLICK];
+    flick.channels = channels;
+    flick.sample_rate = sample_rate;
+    size_t frames = (size_t)(0.08 * sample_rate);
+    flick.samples.resize(frames * channels);
+    uint32_t state = 0x2545f491u;
+    float previous = 0.0f;
+    for (size_t i = 0; i < frames; i++) {
+        state = state * 1664525u + 1013904223u;
+        float noise = (float)(state >> 8) / (float)(1u << 24) * 2.0f - 1.0f;
+        float value = (float)(0.4 * std::sin(M_PI * i / frames)) *
+                      (noise - previous) * 0.5f;
+        previous = noise;
+        std::fill_n(flick.samples.begin() + i * channels, channels, value);
+    }
+    return hitsounds;
+}
+
+size_t load_hitsounds(const std::string &directory, uint32_t channels,
+                      uint32_t sample_rate, HitsoundSet &hitsounds) {
+    size_t loaded = 0;
+    for (int kind = 0; kind < HITSOUND_KIND_COUNT; kind++) {
+        for (const char *extension : {".wav", ".mp3", ".flac"}) {
+            std::filesystem::path file_path =
+                std::filesystem::path(directory) /
+                (hitsound_text[kind] + extension);
+            PcmBuffer pcm;
+            if (std::filesystem::exists(file_path) &&
+                decode_audio(file_path.string(), channels, sample_rate, pcm)) {
+                hitsounds.sounds[kind] = std::move(pcm);
+                loaded++;
+                break;
+            }
+        }
+    }
+    return loaded;
+}
+
+std::vector<Hit> chart_hits(Notechart &chart, const TempoMap &tempo_map,
+                            double offset, const NoteFilter &filter) {
+    std::vector<Hit> hits;
+    for (NoteHandle id : chart.query(filter)) {
+        std::shared_ptr<Note> note = chart.find_note(id);
+        if (!note || note->lane == LANE_BPM) continue;
+
+        HitsoundKind kind = HITSOUND_EASY;
+        if (note->direction != DIR_NONE) {
+            kind = HITSOUND_FLICK;
+        } else if (note->lane >= LANE_H1 && note->lane <= LANE_H5) {
+            kind = HITSOUND_HARD;
+        } else if (note->lane >= LANE_N1 && note->lane <= LANE_N4) {
+            kind = HITSOUND_NORMAL;
+        }
+        hits.push_back(
+            Hit{tempo_map.seconds_at((double)note->tick) - offset, kind});
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+        return a.seconds < b.seconds;
+    });
+    return hits;
+}
+
+namespace {
+
+// A stretch of the timeline between decoding and writing
+struct MixChunk {
+    long long start;
+    size_t frames;
+    std::vector<float> mix;
+    std::vector<int16_t> pcm;
+    size_t clipped{0};
+    std::promise<void> done;
+};
+
+struct PlacedHit {
+    long long frame;
+    HitsoundKind kind;
+};
+
+}  // namespace
+
+bool mixdown(const std::string &song_path, const std::vector<Hit> &hits,
+             const HitsoundSet &hitsounds, const std::string &output_path,
+             const MixdownOptions &options, ThreadPool &pool,
+             MixdownStats &stats) {
+    TRACE_SCOPE("mixdown");
+
+    const uint32_t channels = options.channels;
+
+    ma_decoder_config decoder_config =
+        ma_decoder_config_init(ma_format_f32, channels, options.sample_rate);
+    ma_decoder decoder;
+    if (ma_decoder_init_file(song_path.c_str(), &decoder_config, &decoder) !=
+        MA_SUCCESS) {
+        return false;
+    }
+
+    ma_encoder_config encoder_config = ma_encoder_config_init(
+        ma_encoding_format_wav, ma_format_s16, channels, options.sample_rate);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(output_path.c_str(), &encoder_config,
+                             &encoder) != MA_SUCCESS) {
+        ma_decoder_uninit(&decoder);
+        return false;
+    }
+
+    // Hits in frames, and the frame where the last hitsound dies out
+    std::vector<PlacedHit> placed;
+    placed.reserve(hits.size());
+    size_t longest = 0;
+    long long hits_end = 0;
+    for (const Hit &hit : hits) {
+        const PcmBuffer &sound = hitsounds.sounds[hit.kind];
+        long long frame = std::llround(hit.seconds * options.sample_rate);
+        placed.push_back(PlacedHit{frame, hit.kind});
+        longest = std::max(longest, sound.frames());
+        hits_end = std::max(hits_end, frame + (long long)sound.frames());
+    }
+    // Chunks look their hits up by frame; chart_hits() already returns them
+    // in order, but callers may not
+    std::stable_sort(placed.begin(), placed.end(),
+                     [](const PlacedHit &a, const PlacedHit &b) {
+                         return a.frame < b.frame;
+                     });
+
+    auto mix_chunk = [&](MixChunk &chunk) {
+        TRACE_SCOPE("mixdown/chunk");
+
+        long long chunk_end = chunk.start + (long long)chunk.frames;
+        for (float &sample : chunk.mix) {
+            sample *= options.song_gain;
+        }
+
+        // Every hit starting less than the longest sound before the chunk
+        // may still be ringing into it
+        auto first = std::lower_bound(
+            placed.begin(), placed.end(), chunk.start - (long long)longest,
+            [](const PlacedHit &hit, long long frame) {
+                return hit.frame < frame;
+            });
+        for (auto hit = first; hit != placed.end() && hit->frame < chunk_end;
+             hit++) {
+            const PcmBuffer &sound = hitsounds.sounds[hit->kind];
+            long long begin = std::max(hit->frame, chunk.start);
+            long long end =
+                std::min(hit->frame + (long long)sound.frames(), chunk_end);
+            for (long long frame = begin; frame < end; frame++) {
+                const float *source =
+                    sound.samples.data() + (frame - hit->frame) * channels;
+                float *target =
+                    chunk.mix.data() + (frame - chunk.start) * channels;
+                for (uint32_t channel = 0; channel < channels; channel++) {
+                    target[channel] += source[channel] * options.hitsound_gain;
+                }
+            }
+        }
+
+        chunk.pcm.resize(chunk.mix.size());
+        for (size_t i = 0; i < chunk.mix.size(); i++) {
+            float sample = chunk.mix[i];
+            if (sample > 1.0f || sample < -1.0f) {
+                chunk.clipped++;
+                sample = std::clamp(sample, -1.0f, 1.0f);
+            }
+            chunk.pcm[i] = (int16_t)std::lrint(sample * 32767.0f);
+        }
+        chunk.mix = std::vector<float>();
+    };
+
+    bool is_written = true;
+    auto write_chunk = [&](MixChunk &chunk) {
+        chunk.done.get_future().wait();
+        ma_uint64 frames_written = 0;
+        if (ma_encoder_write_pcm_frames(&encoder, chunk.pcm.data(),
+                                        chunk.frames,
+                                        &frames_written) != MA_SUCCESS ||
+            frames_written != chunk.frames) {
+            is_written = false;
+        }
+        stats.frames += chunk.frames;
+        stats.clipped_samples += chunk.clipped;
+    };
+
+    // Enough chunks in flight to keep every worker busy while the oldest is
+    // written
+    const size_t window = pool.size() * 2 + 1;
+    std::deque<std::shared_ptr<MixChunk>> in_flight;
+
+    bool is_song_over = false;
+    for (long long start = 0;; start += (long long)options.chunk_frames) {
+        std::shared_ptr<MixChunk> chunk = std::make_shared<MixChunk>();
+        chunk->start = start;
+        chunk->mix.assign(options.chunk_frames * channels, 0.0f);
+
+        ma_uint64 frames_read = 0;
+        if (!is_song_over) {
+            ma_decoder_read_pcm_frames(&decoder, chunk->mix.data(),
+                                       options.chunk_frames, &frames_read);
+            is_song_over = frames_read < options.chunk_frames;
+        }
+
+        // Past the song, keep going while hitsounds still ring
+        long long tail = std::clamp(hits_end - start, 0LL,
+                                    (long long)options.chunk_frames);
+        chunk->frames = std::max((size_t)frames_read, (size_t)tail);
+        if (chunk->frames == 0) {
+            break;
+        }
+        chunk->mix.resize(chunk->frames * channels);
+
+        pool.submit([chunk, &mix_chunk]() {
+            mix_chunk(*chunk);
+            chunk->done.set_value();
+        });
+        in_flight.push_back(std::move(chunk));
+
+        if (in_flight.size() >= window) {
+            write_chunk(*in_flight.front());
+            in_flight.pop_front();
+        }
+    }
+    for (std::shared_ptr<MixChunk> &chunk : in_flight) {
+        write_chunk(*chunk);
+    }
+
+    stats.hits = hits.size();
+
+    ma_encoder_uninit(&encoder);
+    ma_decoder_uninit(&decoder);
+    return is_written;
+}
@@ -1,8 +1,13 @@
 #include "../include/notechart.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <nlohmann/json.hpp>
 
+#include "../include/chart_snapshot.hpp"
+#include "../include/trace.hpp"
+
 using json = nlohmann::json;
 
 Note::Note(long _tick, Lane _lane, Direction _direction, Side _side,
@@ -13,9 +18,9 @@ Note::Note(long _tick, Lane _lane, Direction _direction, Side _side,
       side(_side),
       is_longnote(_is_longnote) {}
 
-std::string Note::to_string() {
+std::string Note::to_string() const {
     json j;
-    j["id"] = std::to_string(this->id);
+    j["id"] = std::to_string(this->id.index);
     j["row"] = this->tick;
     j["channel"] = lane_text[this->lane];
     j["side"] = side_text[this->side];
@@ -29,11 +34,45 @@ std::string Note::to_string() {
     return j.dump();
 }
 
-bool Notechart::is_updated() { return this->updated; }
+bool Notechart::is_updated() { return this->digest() != this->saved_digest; }
+
+void Notechart::update() { this->saved_digest = this->digest(); }
+
+void Notechart::modify() { this->current_version++; }
+
+size_t Notechart::lower_bound_tick(long tick) {
+    return std::lower_bound(this->notes.begin(), this->notes.end(), tick,
+                            [](const std::shared_ptr<Note> &note, long tick) {
+                                return note->tick < tick;
+                            }) -
+           this->notes.begin();
+}
+
+long Notechart::version() { return this->current_version; }
+
+uint64_t Notechart::digest() { return this->measure_hashes.root(); }
+
+const std::vector<std::vector<size_t>> &Notechart::connector_chains() {
+    if (this->chains_version == this->current_version) {
+        return this->chains;
+    }
 
-void Notechart::update() { this->updated = false; }
+    // Three lane groups (hard, normal, easy) times three sides
+    this->chains.assign(9, std::vector<size_t>());
+    for (size_t idx = 0; idx < this->notes.size(); idx++) {
+        Lane lane = this->notes[idx]->lane;
+        int group = (lane >= LANE_H1 && lane <= LANE_H5)   ? 0
+                    : (lane >= LANE_N1 && lane <= LANE_N4) ? 1
+                    : (lane >= LANE_E1 && lane <= LANE_E3) ? 2
+                                                           : -1;
+        if (group >= 0) {
+            this->chains[group * 3 + this->notes[idx]->side].push_back(idx);
+        }
+    }
 
-void Notechart::modify() { this->updated = true; }
+    this->chains_version = this->current_version;
+    return this->chains;
+}
 
 bool Notechart::is_same_lane_group(std::shared_ptr<Note> a,
                                    std::shared_ptr<Note> b) {
@@ -53,6 +92,8 @@ bool Notechart::is_same_lane_group(std::shared_ptr<Note> a,
 }
 
 void Notechart::add_note(Note note) {
+    TRACE_SCOPE("Notechart::add_note");
+
     // Deduplicate
     if (std::find_if(this->notes.begin(), this->notes.end(),
                      [note](const std::shared_ptr<Note> &n) {
@@ -63,18 +104,553 @@ void Notechart::add_note(Note note) {
         this->modify();
 
         // Assign note ID
-        note.id = current_sequence++;
-        // Index the note
-        this->note_index[note.id] = std::make_shared<Note>(note);
+        std::shared_ptr<Note> ptr_to_note = std::make_shared<Note>(note);
+        ptr_to_note->id = this->note_slots.insert(ptr_to_note);
+        this->index_note(*ptr_to_note);
 
         // Add and organize new note
-        this->notes.push_back(this->note_index[note.id]);
-        std::sort(this->notes.begin(), this->notes.end(),
-                  [](const std::shared_ptr<Note> &lhs,
-                     const std::shared_ptr<Note> &rhs) {
-                      return lhs->tick < rhs->tick;
+        this->notes.push_back(ptr_to_note);
+        this->organize();
+    }
+}
+
+void Notechart::add_notes(const std::vector<Note> &new_notes) {
+    TRACE_SCOPE("Notechart::add_notes");
+
+    if (new_notes.empty()) return;
+
+    // Append everything first and organize once; organize() keeps the
+    // earliest note of a duplicated cell just like add_note() does
+    this->notes.reserve(this->notes.size() + new_notes.size());
+    for (const Note &note : new_notes) {
+        std::shared_ptr<Note> ptr_to_note = std::make_shared<Note>(note);
+        ptr_to_note->id = this->note_slots.insert(ptr_to_note);
+        this->index_note(*ptr_to_note);
+        this->notes.push_back(std::move(ptr_to_note));
+    }
+    this->organize();
+
+    this->modify();
+}
+
+void Notechart::normalize() {
+    this->organize();
+
+    this->note_slots.clear();
+    for (std::shared_ptr<Note> &note : this->notes) {
+        note->id = this->note_slots.insert(note);
+    }
+    this->reindex();
+    this->is_all_dirty = true;
+
+    this->modify();
+}
+
+void Notechart::remove_notes(const std::set<NoteHandle> &ids) {
+    TRACE_SCOPE("Notechart::remove_notes");
+
+    // Free the slots first; stale IDs are skipped
+    size_t erased = 0;
+    for (NoteHandle note_id : ids) {
+        if (std::shared_ptr<Note> *slot = this->note_slots.get(note_id)) {
+            this->unindex_note(**slot);
+            erased += this->note_slots.erase(note_id);
+        }
+    }
+    if (erased == 0) return;
+
+    // A note is gone once its ID no longer resolves
+    this->notes.erase(std::remove_if(this->notes.begin(), this->notes.end(),
+                                     [this](const std::shared_ptr<Note> &n) {
+                                         return this->note_slots.get(n->id) ==
+                                                nullptr;
+                                     }),
+                      this->notes.end());
+
+    this->modify();
+}
+
+std::shared_ptr<Note> Notechart::find_note(NoteHandle id) {
+    std::shared_ptr<Note> *slot = this->note_slots.get(id);
+    return slot != nullptr ? *slot : nullptr;
+}
+
+std::vector<std::shared_ptr<Note>> Notechart::collect(
+    const std::set<NoteHandle> &ids) {
+    std::vector<std::shared_ptr<Note>> selected;
+    selected.reserve(ids.size());
+    for (NoteHandle note_id : ids) {
+        if (std::shared_ptr<Note> *slot = this->note_slots.get(note_id)) {
+            selected.push_back(*slot);
+        }
+    }
+    return selected;
+}
+
+bool Notechart::can_move(const std::set<NoteHandle> &ids,
+                         const std::vector<long> &ticks,
+                         const std::vector<int> &lanes) {
+    std::vector<std::pair<long, int>> cells(ticks.size());
+    for (size_t i = 0; i < ticks.size(); i++) {
+        if (ticks[i] < 0) return false;
+        cells[i] = {ticks[i], lanes[i]};
+    }
+    std::sort(cells.begin(), cells.end());
+    if (std::adjacent_find(cells.begin(), cells.end()) != cells.end()) {
+        return false;
+    }
+
+    // A selected note in the way moves out of it
+    for (auto &[tick, lane] : cells) {
+        for (size_t idx = this->lower_bound_tick(tick);
+             idx < this->notes.size() && this->notes[idx]->tick == tick;
+             idx++) {
+            if (this->notes[idx]->lane == lane &&
+                !ids.contains(this->notes[idx]->id)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Notechart::organize() {
+    // Order by (tick, lane) so that every tick lists its lanes left to right
+    auto is_before = [](const std::shared_ptr<Note> &lhs,
+                        const std::shared_ptr<Note> &rhs) {
+        if (lhs->tick != rhs->tick) {
+            return lhs->tick < rhs->tick;
+        }
+        return lhs->lane < rhs->lane;
+    };
+    // Bulk loads and merges usually arrive sorted already
+    if (!std::is_sorted(this->notes.begin(), this->notes.end(), is_before)) {
+        std::stable_sort(this->notes.begin(), this->notes.end(), is_before);
+    }
+
+    // A file or a bulk load may hold two notes on the same cell; keep the
+    // first one and release the slot of the other (transforms check first)
+    size_t kept = 0;
+    for (size_t idx = 0; idx < this->notes.size(); idx++) {
+        if (kept > 0 && this->notes[kept - 1]->tick == this->notes[idx]->tick &&
+            this->notes[kept - 1]->lane == this->notes[idx]->lane) {
+            this->unindex_note(*this->notes[idx]);
+            this->note_slots.erase(this->notes[idx]->id);
+            continue;
+        }
+        if (kept != idx) {
+            this->notes[kept] = std::move(this->notes[idx]);
+        }
+        kept++;
+    }
+    this->notes.resize(kept);
+}
+
+bool Notechart::shift_notes(const std::set<NoteHandle> &ids, long delta) {
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty() || delta == 0) return true;
+
+    // Gather the ticks into a flat array so the update loop vectorizes
+    std::vector<long> ticks(selected.size());
+    std::vector<int> lanes(selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        ticks[i] = selected[i]->tick;
+        lanes[i] = selected[i]->lane;
+    }
+    for (size_t i = 0; i < ticks.size(); i++) {
+        ticks[i] += delta;
+    }
+    if (!this->can_move(ids, ticks, lanes)) return false;
+
+    for (size_t i = 0; i < selected.size(); i++) {
+        this->uncount_note(*selected[i]);
+        selected[i]->tick = ticks[i];
+        this->count_note(*selected[i]);
+    }
+
+    this->organize();
+    this->modify();
+    return true;
+}
+
+bool Notechart::mirror_notes(const std::set<NoteHandle> &ids) {
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return true;
+
+    std::vector<long> ticks(selected.size());
+    std::vector<int> lanes(selected.size());
+    std::vector<int> directions(selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        ticks[i] = selected[i]->tick;
+        lanes[i] = selected[i]->lane;
+        directions[i] = selected[i]->direction;
+    }
+
+    // Reflect each lane around the center of its lane group (H1-H5, N1-N4,
+    // E1-E3) and flip flick directions horizontally; other lanes stay put
+    for (size_t i = 0; i < lanes.size(); i++) {
+        int lane = lanes[i];
+        int axis = (lane >= LANE_H1 && lane <= LANE_H5)   ? LANE_H1 + LANE_H5
+                   : (lane >= LANE_N1 && lane <= LANE_N4) ? LANE_N1 + LANE_N4
+                   : (lane >= LANE_E1 && lane <= LANE_E3) ? LANE_E1 + LANE_E3
+                                                          : lane * 2;
+        lanes[i] = axis - lane;
+        directions[i] =
+            (directions[i] == DIR_NONE) ? DIR_NONE : DIR_LEFT - directions[i];
+    }
+    if (!this->can_move(ids, ticks, lanes)) return false;
+
+    for (size_t i = 0; i < selected.size(); i++) {
+        this->unindex_note(*selected[i]);
+        selected[i]->lane = (Lane)lanes[i];
+        selected[i]->direction = (Direction)directions[i];
+        this->index_note(*selected[i]);
+    }
+
+    this->organize();
+    this->modify();
+    return true;
+}
+
+void Notechart::swap_sides(const std::set<NoteHandle> &ids) {
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return;
+
+    for (std::shared_ptr<Note> &note : selected) {
+        this->unindex_note(*note);
+        if (note->side == SIDE_LEFT) {
+            note->side = SIDE_RIGHT;
+        } else if (note->side == SIDE_RIGHT) {
+            note->side = SIDE_LEFT;
+        }
+        this->index_note(*note);
+    }
+
+    this->modify();
+}
+
+bool Notechart::quantize_notes(const std::set<NoteHandle> &ids,
+                               long cell_range_in_ticks) {
+    if (cell_range_in_ticks <= 0) return false;
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return true;
+
+    std::vector<long> ticks(selected.size());
+    std::vector<int> lanes(selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        ticks[i] = selected[i]->tick;
+        lanes[i] = selected[i]->lane;
+    }
+    // Round to the nearest cell (ticks are never negative)
+    for (size_t i = 0; i < ticks.size(); i++) {
+        ticks[i] = ((ticks[i] + cell_range_in_ticks / 2) / cell_range_in_ticks) *
+                   cell_range_in_ticks;
+    }
+    if (!this->can_move(ids, ticks, lanes)) return false;
+
+    for (size_t i = 0; i < selected.size(); i++) {
+        this->uncount_note(*selected[i]);
+        selected[i]->tick = ticks[i];
+        this->count_note(*selected[i]);
+    }
+
+    this->organize();
+    this->modify();
+    return true;
+}
+
+bool Notechart::scale_notes(const std::set<NoteHandle> &ids, double factor) {
+    if (!(factor > 0.0) || !std::isfinite(factor)) return false;
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return true;
+
+    std::vector<long> ticks(selected.size());
+    std::vector<int> lanes(selected.size());
+    for (size_t i = 0; i < selected.size(); i++) {
+        ticks[i] = selected[i]->tick;
+        lanes[i] = selected[i]->lane;
+    }
+
+    // Stretch around the earliest selected note
+    long pivot = *std::min_element(ticks.begin(), ticks.end());
+    for (size_t i = 0; i < ticks.size(); i++) {
+        ticks[i] = pivot + std::lround((ticks[i] - pivot) * factor);
+    }
+    if (!this->can_move(ids, ticks, lanes)) return false;
+
+    for (size_t i = 0; i < selected.size(); i++) {
+        this->uncount_note(*selected[i]);
+        selected[i]->tick = ticks[i];
+        this->count_note(*selected[i]);
+    }
+
+    this->organize();
+    this->modify();
+    return true;
+}
+
+void Notechart::set_direction(const std::set<NoteHandle> &ids,
+                              Direction direction) {
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return;
+
+    for (std::shared_ptr<Note> &note : selected) {
+        this->unindex_note(*note);
+        note->direction = direction;
+        this->index_note(*note);
+    }
+
+    this->modify();
+}
+
+void Notechart::set_side(const std::set<NoteHandle> &ids, Side side) {
+    std::vector<std::shared_ptr<Note>> selected = this->collect(ids);
+    if (selected.empty()) return;
+
+    for (std::shared_ptr<Note> &note : selected) {
+        this->unindex_note(*note);
+        note->side = side;
+        this->index_note(*note);
+    }
+
+    this->modify();
+}
+
+// Files are checked when parsed, so an angle outside the enum can only come
+// from a cast; it is indexed with the unflicked notes rather than past the
+// end of direction_index
+static size_t direction_slot(Direction direction) {
+    if (!is_direction(direction) || direction == DIR_NONE) return 0;
+    return direction / 45 + 1;
+}
+
+// Measure a note is hashed and snapshotted under. Ticks below 0 only come
+// from damaged files; like ChartDigest, they count toward measure 0.
+static long measure_of(long tick) { return std::max(tick, 0L) / 192; }
+
+void Notechart::count_note(const Note &note) {
+    this->dirty_measures.insert(measure_of(note.tick));
+    this->measure_hashes.add(measure_of(note.tick), note_hash(note));
+}
+
+void Notechart::uncount_note(const Note &note) {
+    this->dirty_measures.insert(measure_of(note.tick));
+    this->measure_hashes.remove(measure_of(note.tick), note_hash(note));
+}
+
+// Every field edit, insertion and removal passes through the two functions
+// below, so they also keep the measure hashes and the next snapshot current
+void Notechart::index_note(const Note &note) {
+    this->count_note(note);
+    uint32_t slot = note.id.index;
+    this->lane_index[note.lane].add(slot);
+    this->side_index[note.side].add(slot);
+    this->direction_index[direction_slot(note.direction)].add(slot);
+    if (note.is_longnote) {
+        this->longnote_index.add(slot);
+    }
+}
+
+void Notechart::unindex_note(const Note &note) {
+    this->uncount_note(note);
+    uint32_t slot = note.id.index;
+    this->lane_index[note.lane].remove(slot);
+    this->side_index[note.side].remove(slot);
+    this->direction_index[direction_slot(note.direction)].remove(slot);
+    this->longnote_index.remove(slot);
+}
+
+std::shared_ptr<const ChartSnapshot> Notechart::snapshot() {
+    if (this->latest_snapshot && !this->is_all_dirty &&
+        this->dirty_measures.empty()) {
+        return this->latest_snapshot;
+    }
+
+    TRACE_SCOPE("Notechart::snapshot");
+
+    // Copy notes[begin, end), which all belong to `measure`
+    auto copy_notes = [this](long measure, size_t begin, size_t end) {
+        std::shared_ptr<MeasureNotes> copy = std::make_shared<MeasureNotes>();
+        copy->measure = measure;
+        for (size_t idx = begin; idx < end; idx++) {
+            copy->notes.push_back(*this->notes[idx]);
+            copy->lane_counts[this->notes[idx]->lane]++;
+        }
+        copy->hash = this->measure_hashes.measure_hash(measure);
+        return copy;
+    };
+    auto copy_measure = [this, &copy_notes](long measure) {
+        size_t begin = measure == 0 ? 0 : this->lower_bound_tick(measure * 192);
+        return copy_notes(measure, begin,
+                          this->lower_bound_tick((measure + 1) * 192));
+    };
+
+    std::vector<std::shared_ptr<const MeasureNotes>> measures;
+    if (!this->latest_snapshot || this->is_all_dirty) {
+        // The notes are sorted by tick, so each measure is one run of them
+        for (size_t begin = 0; begin < this->notes.size();) {
+            long measure = measure_of(this->notes[begin]->tick);
+            size_t end = begin + 1;
+            while (end < this->notes.size() &&
+                   measure_of(this->notes[end]->tick) == measure) {
+                end++;
+            }
+            measures.push_back(copy_notes(measure, begin, end));
+            begin = end;
+        }
+    } else {
+        // Reuse every clean measure and merge in fresh copies of the dirty
+        // ones, keeping the list ordered by measure
+        const std::vector<std::shared_ptr<const MeasureNotes>> &previous =
+            this->latest_snapshot->measures();
+        measures.reserve(previous.size() + this->dirty_measures.size());
+        auto dirty = this->dirty_measures.begin();
+        for (const std::shared_ptr<const MeasureNotes> &clean : previous) {
+            for (; dirty != this->dirty_measures.end() &&
+                   *dirty <= clean->measure;
+                 dirty++) {
+                std::shared_ptr<MeasureNotes> copy = copy_measure(*dirty);
+                if (!copy->notes.empty()) {
+                    measures.push_back(std::move(copy));
+                }
+            }
+            if (!this->dirty_measures.contains(clean->measure)) {
+                measures.push_back(clean);
+            }
+        }
+        for (; dirty != this->dirty_measures.end(); dirty++) {
+            std::shared_ptr<MeasureNotes> copy = copy_measure(*dirty);
+            if (!copy->notes.empty()) {
+                measures.push_back(std::move(copy));
+            }
+        }
+    }
+
+    this->latest_snapshot = std::make_shared<const ChartSnapshot>(
+        this->current_version, this->digest(), std::move(measures));
+    this->dirty_measures.clear();
+    this->is_all_dirty = false;
+    return this->latest_snapshot;
+}
+
+void Notechart::reindex() {
+    for (RoaringBitmap &bitmap : this->lane_index) bitmap.clear();
+    for (RoaringBitmap &bitmap : this->side_index) bitmap.clear();
+    for (RoaringBitmap &bitmap : this->direction_index) bitmap.clear();
+    this->longnote_index.clear();
+    this->measure_hashes.clear();
+
+    for (std::shared_ptr<Note> &note : this->notes) {
+        this->index_note(*note);
+    }
+}
+
+RoaringBitmap Notechart::match(const NoteFilter &filter) {
+    TRACE_SCOPE("Notechart::match");
+
+    // Union within an attribute, intersection across attributes
+    auto any_of = [](const auto &values, auto &&bitmap_of) {
+        RoaringBitmap result;
+        for (const auto &value : values) {
+            result |= bitmap_of(value);
+        }
+        return result;
+    };
+
+    std::vector<RoaringBitmap> terms;
+    if (!filter.lanes.empty()) {
+        terms.push_back(any_of(filter.lanes, [this](Lane lane) {
+            return this->lane_index[lane];
+        }));
+    }
+    if (!filter.sides.empty()) {
+        terms.push_back(any_of(filter.sides, [this](Side side) {
+            return this->side_index[side];
+        }));
+    }
+    if (!filter.directions.empty()) {
+        terms.push_back(any_of(filter.directions, [this](Direction direction) {
+            return this->direction_index[direction_slot(direction)];
+        }));
+    }
+
+    RoaringBitmap result;
+    if (terms.empty()) {
+        // No attribute asked for: every note, which every note has a lane of
+        for (RoaringBitmap &bitmap : this->lane_index) {
+            result |= bitmap;
+        }
+    } else {
+        // Smallest first keeps the intermediate results small
+        std::sort(terms.begin(), terms.end(),
+                  [](const RoaringBitmap &a, const RoaringBitmap &b) {
+                      return a.cardinality() < b.cardinality();
                   });
+        result = std::move(terms[0]);
+        for (size_t i = 1; i < terms.size() && !result.empty(); i++) {
+            result &= terms[i];
+        }
     }
+
+    if (filter.is_longnote == 1) {
+        result &= this->longnote_index;
+    } else if (filter.is_longnote == 0) {
+        result -= this->longnote_index;
+    }
+    return result;
+}
+
+std::vector<NoteHandle> Notechart::query(const NoteFilter &filter) {
+    TRACE_SCOPE("Notechart::query");
+
+    RoaringBitmap matches = this->match(filter);
+    size_t begin = this->lower_bound_tick(filter.tick_begin);
+    size_t end = filter.tick_end == LONG_MAX
+                     ? this->notes.size()
+                     : this->lower_bound_tick(filter.tick_end);
+
+    std::vector<NoteHandle> result;
+    if (begin >= end || matches.empty()) {
+        return result;
+    }
+
+    if (end - begin <= matches.cardinality()) {
+        // Narrow range: probe the bitmap for every note in it
+        for (size_t idx = begin; idx < end; idx++) {
+            if (matches.contains(this->notes[idx]->id.index)) {
+                result.push_back(this->notes[idx]->id);
+            }
+        }
+    } else {
+        // Few matches: look each one up and check its tick
+        matches.for_each([this, &filter, &result](uint32_t slot) {
+            std::shared_ptr<Note> *note = this->note_slots.at(slot);
+            if (note && (*note)->tick >= filter.tick_begin &&
+                (*note)->tick < filter.tick_end) {
+                result.push_back((*note)->id);
+            }
+        });
+    }
+    return result;
+}
+
+size_t Notechart::memory_usage() {
+    // Every note lives in a shared control block
+    size_t per_note = sizeof(Note) + 2 * sizeof(long);
+    size_t index_bytes = this->longnote_index.memory_usage();
+    for (RoaringBitmap &bitmap : this->lane_index) {
+        index_bytes += bitmap.memory_usage();
+    }
+    for (RoaringBitmap &bitmap : this->side_index) {
+        index_bytes += bitmap.memory_usage();
+    }
+    for (RoaringBitmap &bitmap : this->direction_index) {
+        index_bytes += bitmap.memory_usage();
+    }
+    return this->notes.capacity() * sizeof(std::shared_ptr<Note>) +
+           this->note_slots.size() * per_note +
+           this->note_slots.memory_usage() + index_bytes +
+           this->measure_hashes.memory_usage();
 }
 
 std::string Notechart::to_string() {
@@ -84,7 +660,9 @@ std::string Notechart::to_string() {
         buffer += note->to_string();
         buffer += ",";
     }
-    buffer.resize(buffer.size() - 1);
+    if (!this->notes.empty()) {
+        buffer.resize(buffer.size() - 1);
+    }
     buffer += "]}";
 
     return buffer;
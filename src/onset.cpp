@@ -0,0 +1,163 @@
+#include "../include/onset.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../include/fft.hpp"
+#include "../include/trace.hpp"
+
+// Frames per parallel chunk
+constexpr size_t CHUNK_FRAMES = 256;
+
+std::vector<float> onset_envelope(const PcmBuffer &mono, ThreadPool &pool,
+                                  const OnsetOptions &options,
+                                  std::vector<float> *brightness) {
+    TRACE_SCOPE("onset_envelope");
+
+    size_t sample_count = mono.frames();
+    if (sample_count == 0 || mono.channels != 1) return {};
+
+    size_t frame_count = (sample_count + options.hop_size - 1) / options.hop_size;
+    size_t bin_count = options.fft_size / 2 + 1;
+    FFT fft(options.fft_size);
+
+    std::vector<float> flux(frame_count, 0.0f);
+    std::vector<float> spectral_position(frame_count, 0.0f);
+
+    // Log-frequency position of every bin, for the brightness estimate
+    std::vector<float> bin_position(bin_count);
+    for (size_t k = 0; k < bin_count; k++) {
+        bin_position[k] = (float)(std::log2(1.0 + k) / std::log2((double)bin_count));
+    }
+
+    size_t chunk_count = (frame_count + CHUNK_FRAMES - 1) / CHUNK_FRAMES;
+    pool.parallel_for(0, chunk_count, 1, [&](size_t chunk) {
+        TRACE_SCOPE("detect_onsets/chunk");
+
+        std::vector<float> frame(options.fft_size), re(options.fft_size),
+            im(options.fft_size);
+        std::vector<float> previous(bin_count, 0.0f), current(bin_count);
+
+        // Spectrum of a frame centered on t * hop, zero-padded at the ends
+        auto spectrum = [&](size_t t, std::vector<float> &magnitudes) {
+            long long start =
+                (long long)(t * options.hop_size) - (long long)options.fft_size / 2;
+            for (size_t i = 0; i < options.fft_size; i++) {
+                long long s = start + (long long)i;
+                frame[i] = (s >= 0 && s < (long long)sample_count)
+                               ? mono.samples[s]
+                               : 0.0f;
+            }
+            fft.magnitudes(frame.data(), magnitudes.data(), re.data(),
+                           im.data());
+            // Log compression evens out loud and quiet passages
+            for (float &magnitude : magnitudes) {
+                magnitude = std::log1p(100.0f * magnitude);
+            }
+        };
+
+        size_t begin = chunk * CHUNK_FRAMES;
+        size_t end = std::min(begin + CHUNK_FRAMES, frame_count);
+        if (begin > 0) {
+            spectrum(begin - 1, previous);
+        }
+
+        for (size_t t = begin; t < end; t++) {
+            spectrum(t, current);
+
+            float rise = 0.0f, weighted = 0.0f;
+            for (size_t k = 0; k < bin_count; k++) {
+                float difference = std::max(current[k] - previous[k], 0.0f);
+                rise += difference;
+                weighted += difference * bin_position[k];
+            }
+            flux[t] = rise;
+            spectral_position[t] = rise > 0.0f ? weighted / rise : 0.0f;
+
+            std::swap(previous, current);
+        }
+    });
+
+    // The first frame rises from silence by construction
+    flux[0] = 0.0f;
+
+    float peak = *std::max_element(flux.begin(), flux.end());
+    if (peak > 0.0f) {
+        for (float &value : flux) {
+            value /= peak;
+        }
+    }
+
+    if (brightness != nullptr) {
+        *brightness = std::move(spectral_position);
+    }
+    return flux;
+}
+
+std::vector<Onset> detect_onsets(const PcmBuffer &mono, ThreadPool &pool,
+                                 const OnsetOptions &options) {
+    TRACE_SCOPE("detect_onsets");
+
+    std::vector<float> brightness;
+    std::vector<float> flux = onset_envelope(mono, pool, options, &brightness);
+    size_t frame_count = flux.size();
+    if (frame_count == 0) return {};
+
+    // Local maxima above the adaptive threshold, at least min_interval apart
+    std::vector<Onset> onsets;
+    double seconds_per_frame = (double)options.hop_size / mono.sample_rate;
+    double last_seconds = -1e9;
+    for (size_t t = 0; t < frame_count; t++) {
+        size_t lo = t >= options.mean_radius ? t - options.mean_radius : 0;
+        size_t hi = std::min(t + options.mean_radius + 1, frame_count);
+        float mean = 0.0f;
+        for (size_t i = lo; i < hi; i++) {
+            mean += flux[i];
+        }
+        mean /= (float)(hi - lo);
+        if (flux[t] < mean + options.threshold) continue;
+
+        lo = t >= options.peak_radius ? t - options.peak_radius : 0;
+        hi = std::min(t + options.peak_radius + 1, frame_count);
+        if (*std::max_element(flux.begin() + lo, flux.begin() + hi) > flux[t]) {
+            continue;
+        }
+
+        double seconds = t * seconds_per_frame;
+        if (seconds - last_seconds < options.min_interval) continue;
+
+        onsets.push_back(Onset{seconds, flux[t], brightness[t]});
+        last_seconds = seconds;
+    }
+
+    return onsets;
+}
+
+std::vector<Note> onsets_to_notes(const std::vector<Onset> &onsets,
+                                  const TempoMap &tempo, double offset,
+                                  long cell_ticks) {
+    std::vector<Note> notes;
+    if (cell_ticks <= 0) return notes;
+
+    // Brightness is spread unevenly; stretch the observed range over lanes
+    float darkest = 1.0f, brightest = 0.0f;
+    for (const Onset &onset : onsets) {
+        darkest = std::min(darkest, onset.brightness);
+        brightest = std::max(brightest, onset.brightness);
+    }
+    float range = std::max(brightest - darkest, 1e-6f);
+
+    for (const Onset &onset : onsets) {
+        double tick = tempo.tick_at(onset.seconds + offset);
+        long snapped = std::lround(tick / cell_ticks) * cell_ticks;
+        if (snapped < 0) continue;
+        if (!notes.empty() && notes.back().tick == snapped) continue;
+
+        int lane = LANE_H1 + std::min(
+                                 (int)((onset.brightness - darkest) / range * 5),
+                                 LANE_H5 - LANE_H1);
+        notes.push_back(Note(snapped, (Lane)lane, DIR_NONE, SIDE_NONE, false));
+    }
+
+    return notes;
+}
@@ -0,0 +1,43 @@
+#include "../include/pcm.hpp"
+
+#include "../include/trace.hpp"
+#include "../third_party/miniaudio.h"
+
+bool decode_audio(const std::string &file_path, uint32_t channels,
+                  uint32_t sample_rate, PcmBuffer &pcm) {
+    TRACE_SCOPE("decode_audio");
+
+    ma_decoder_config config =
+        ma_decoder_config_init(ma_format_f32, channels, sample_rate);
+    ma_decoder decoder;
+    if (ma_decoder_init_file(file_path.c_str(), &config, &decoder) !=
+        MA_SUCCESS) {
+        return false;
+    }
+
+    pcm.channels = channels;
+    pcm.sample_rate = sample_rate;
+    pcm.samples.clear();
+
+    // Reserve up front when the length is cheap to know (not for MP3 VBR)
+    ma_uint64 length = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&decoder, &length) == MA_SUCCESS &&
+        length > 0) {
+        pcm.samples.reserve(length * channels);
+    }
+
+    constexpr ma_uint64 CHUNK_FRAMES = 16384;
+    ma_uint64 frames_read = 0;
+    do {
+        size_t previous_size = pcm.samples.size();
+        pcm.samples.resize(previous_size + CHUNK_FRAMES * channels);
+        frames_read = 0;
+        ma_decoder_read_pcm_frames(&decoder,
+                                   pcm.samples.data() + previous_size,
+                                   CHUNK_FRAMES, &frames_read);
+        pcm.samples.resize(previous_size + frames_read * channels);
+    } while (frames_read == CHUNK_FRAMES);
+
+    ma_decoder_uninit(&decoder);
+    return true;
+}
@@ -0,0 +1,146 @@
+#include "../include/pcm_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define THAPSTEAK_PCM_SPILL 1
+#endif
+
+#include "../include/trace.hpp"
+
+PcmCache::PcmCache(size_t _memory_budget) : memory_budget(_memory_budget) {}
+
+PcmCache::~PcmCache() { this->close(); }
+
+bool PcmCache::open(const std::string &file_path, uint32_t _channels,
+                    uint32_t _sample_rate) {
+    this->close();
+
+    // Decode straight to 16-bit, half the footprint of f32 and plenty for
+    // listening back
+    ma_decoder_config config =
+        ma_decoder_config_init(ma_format_s16, _channels, _sample_rate);
+    if (ma_decoder_init_file(file_path.c_str(), &config, &this->decoder) !=
+        MA_SUCCESS) {
+        return false;
+    }
+
+    this->channels = _channels;
+    this->sample_rate = _sample_rate;
+    this->blocks = std::make_unique<const int16_t *[]>(MAX_BLOCKS);
+    this->is_stopping = false;
+    this->worker = std::thread(&PcmCache::decode, this);
+    return true;
+}
+
+void PcmCache::close() {
+    if (!this->worker.joinable()) return;
+
+    this->is_stopping = true;
+    this->worker.join();
+    ma_decoder_uninit(&this->decoder);
+
+    this->ready_frames.store(0, std::memory_order_release);
+    this->is_decoded.store(false, std::memory_order_release);
+    this->blocks.reset();
+    this->heap_blocks.clear();
+    this->heap_bytes = 0;
+
+#ifdef THAPSTEAK_PCM_SPILL
+    for (auto &[address, bytes] : this->mappings) {
+        munmap(address, bytes);
+    }
+#endif
+    this->mappings.clear();
+    if (this->spill_file) {
+        std::fclose(this->spill_file);
+        this->spill_file = nullptr;
+    }
+    this->file_bytes = 0;
+}
+
+const int16_t *PcmCache::store_block(const int16_t *samples, size_t bytes) {
+#ifdef THAPSTEAK_PCM_SPILL
+    if (this->heap_bytes + bytes > this->memory_budget) {
+        // tmpfile() is already unlinked, so it goes away with the process
+        if (!this->spill_file) {
+            this->spill_file = std::tmpfile();
+        }
+
+        // Whole blocks are a multiple of the page size, so every mapping
+        // starts on a page boundary
+        off_t offset = (off_t)this->file_bytes.load();
+        int descriptor = this->spill_file ? fileno(this->spill_file) : -1;
+        if (descriptor >= 0 &&
+            pwrite(descriptor, samples, bytes, offset) == (ssize_t)bytes) {
+            void *address =
+                mmap(nullptr, bytes, PROT_READ, MAP_SHARED, descriptor, offset);
+            if (address != MAP_FAILED) {
+                this->mappings.emplace_back(address, bytes);
+                this->file_bytes += bytes;
+                return (const int16_t *)address;
+            }
+        }
+        // Without a usable temp file, fall back to the heap
+    }
+#endif
+
+    std::unique_ptr<int16_t[]> block =
+        std::make_unique<int16_t[]>(bytes / sizeof(int16_t));
+    std::memcpy(block.get(), samples, bytes);
+    this->heap_blocks.push_back(std::move(block));
+    this->heap_bytes += bytes;
+    return this->heap_blocks.back().get();
+}
+
+void PcmCache::decode() {
+    TRACE_SCOPE("PcmCache::decode");
+
+    std::vector<int16_t> staging(BLOCK_FRAMES * this->channels);
+    size_t frames = 0;
+
+    for (size_t block = 0; block < MAX_BLOCKS && !this->is_stopping; block++) {
+        ma_uint64 frames_read = 0;
+        ma_decoder_read_pcm_frames(&this->decoder, staging.data(), BLOCK_FRAMES,
+                                   &frames_read);
+        if (frames_read == 0) {
+            break;
+        }
+
+        this->blocks[block] = this->store_block(
+            staging.data(), frames_read * this->channels * sizeof(int16_t));
+        frames += frames_read;
+        this->ready_frames.store(frames, std::memory_order_release);
+
+        if (frames_read < BLOCK_FRAMES) {
+            break;
+        }
+    }
+
+    this->is_decoded.store(true, std::memory_order_release);
+}
+
+size_t PcmCache::read(size_t frame, float *frames, size_t frame_count) const {
+    size_t available = this->ready_frames.load(std::memory_order_acquire);
+    if (frame >= available) return 0;
+    frame_count = std::min(frame_count, available - frame);
+
+    constexpr float SCALE = 1.0f / 32768.0f;
+    size_t done = 0;
+    while (done < frame_count) {
+        size_t block = (frame + done) / BLOCK_FRAMES;
+        size_t offset = (frame + done) % BLOCK_FRAMES;
+        size_t count = std::min(frame_count - done, BLOCK_FRAMES - offset);
+
+        const int16_t *source = this->blocks[block] + offset * this->channels;
+        float *destination = frames + done * this->channels;
+        for (size_t i = 0; i < count * this->channels; i++) {
+            destination[i] = source[i] * SCALE;
+        }
+        done += count;
+    }
+    return done;
+}
@@ -0,0 +1,288 @@
+#include "../include/playback.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Length of one scrub snippet
+constexpr double SCRUB_SECONDS = 0.06;
+
+ma_data_source_vtable Playback::source_vtable = {
+    Playback::source_read,
+    Playback::source_seek,
+    Playback::source_get_data_format,
+    Playback::source_get_cursor,
+    NULL,
+    NULL,
+    0};
+
+ma_data_source_vtable Playback::scrub_vtable = {
+    Playback::scrub_read,
+    NULL,
+    Playback::source_get_data_format,
+    NULL,
+    NULL,
+    NULL,
+    0};
+
+Playback::~Playback() {
+    this->close();
+    if (this->is_engine_initialized) {
+        ma_engine_uninit(&this->engine);
+    }
+}
+
+bool Playback::open(const std::string &file_path) {
+    this->close();
+
+    if (!this->is_engine_initialized) {
+        if (ma_engine_init(NULL, &this->engine) != MA_SUCCESS) {
+            return false;
+        }
+        this->is_engine_initialized = true;
+    }
+
+    // Decode straight to the engine's format so the stretch stage is the
+    // only processing in the callback
+    ma_uint32 sample_rate = ma_engine_get_sample_rate(&this->engine);
+    ma_decoder_config decoder_config =
+        ma_decoder_config_init(ma_format_f32, 2, sample_rate);
+    if (ma_decoder_init_file(file_path.c_str(), &decoder_config,
+                             &this->decoder) != MA_SUCCESS) {
+        return false;
+    }
+
+    if (!this->cache.open(file_path, 2, sample_rate)) {
+        ma_decoder_uninit(&this->decoder);
+        return false;
+    }
+
+    this->stretch.configure(2, sample_rate);
+    this->stretch.set_rate(this->pending_rate.load());
+    this->pending_seek.store(-1);
+    this->pending_scrub.store(-1);
+    this->cursor_frames.store(0.0);
+    this->song_frame = 0;
+    this->decoder_frame = 0;
+    this->scrub_remaining = 0;
+
+    ma_data_source_config source_config = ma_data_source_config_init();
+    source_config.vtable = &Playback::source_vtable;
+    this->source.owner = this;
+    ma_data_source_config scrub_config = ma_data_source_config_init();
+    scrub_config.vtable = &Playback::scrub_vtable;
+    this->scrub_source.owner = this;
+
+    ma_uint32 flags = MA_SOUND_FLAG_NO_PITCH | MA_SOUND_FLAG_NO_SPATIALIZATION;
+    if (ma_data_source_init(&source_config, &this->source.base) != MA_SUCCESS) {
+        this->cache.close();
+        ma_decoder_uninit(&this->decoder);
+        return false;
+    }
+    if (ma_sound_init_from_data_source(&this->engine, &this->source.base,
+                                       flags, NULL,
+                                       &this->sound) != MA_SUCCESS) {
+        ma_data_source_uninit(&this->source.base);
+        this->cache.close();
+        ma_decoder_uninit(&this->decoder);
+        return false;
+    }
+
+    // The scrub voice runs for as long as the song is open and is silent
+    // between snippets
+    if (ma_data_source_init(&scrub_config, &this->scrub_source.base) !=
+        MA_SUCCESS) {
+        ma_sound_uninit(&this->sound);
+        ma_data_source_uninit(&this->source.base);
+        this->cache.close();
+        ma_decoder_uninit(&this->decoder);
+        return false;
+    }
+    if (ma_sound_init_from_data_source(&this->engine, &this->scrub_source.base,
+                                       flags, NULL,
+                                       &this->scrub_sound) != MA_SUCCESS) {
+        ma_data_source_uninit(&this->scrub_source.base);
+        ma_sound_uninit(&this->sound);
+        ma_data_source_uninit(&this->source.base);
+        this->cache.close();
+        ma_decoder_uninit(&this->decoder);
+        return false;
+    }
+    ma_sound_start(&this->scrub_sound);
+
+    this->is_opened = true;
+    return true;
+}
+
+void Playback::close() {
+    if (!this->is_opened) return;
+
+    ma_sound_uninit(&this->scrub_sound);
+    ma_data_source_uninit(&this->scrub_source.base);
+    ma_sound_uninit(&this->sound);
+    ma_data_source_uninit(&this->source.base);
+    this->cache.close();
+    ma_decoder_uninit(&this->decoder);
+    this->is_opened = false;
+}
+
+void Playback::start() {
+    if (this->is_opened) {
+        ma_sound_start(&this->sound);
+    }
+}
+
+void Playback::stop() {
+    if (this->is_opened) {
+        ma_sound_stop(&this->sound);
+    }
+}
+
+bool Playback::is_playing() const {
+    return this->is_opened && ma_sound_is_playing(&this->sound);
+}
+
+void Playback::seek(double seconds) {
+    if (!this->is_opened) return;
+
+    long long frame =
+        (long long)(std::max(seconds, 0.0) * this->stretch.get_sample_rate());
+    this->pending_seek.store(frame);
+    this->cursor_frames.store((double)frame);
+}
+
+void Playback::scrub(double seconds) {
+    if (!this->is_opened) return;
+
+    this->pending_scrub.store(
+        (long long)(std::max(seconds, 0.0) * this->stretch.get_sample_rate()));
+}
+
+double Playback::position() const {
+    if (!this->is_opened) return 0.0;
+    return this->cursor_frames.load() / this->stretch.get_sample_rate();
+}
+
+void Playback::set_rate(double rate) {
+    this->pending_rate.store(std::clamp(rate, TimeStretch::MIN_RATE,
+                                        TimeStretch::MAX_RATE));
+}
+
+double Playback::get_rate() const { return this->pending_rate.load(); }
+
+// Audio thread
+size_t Playback::read_song(void *user_data, float *frames,
+                           size_t frame_count) {
+    Playback *playback = (Playback *)user_data;
+
+    size_t cached = playback->cache.read((size_t)playback->song_frame, frames,
+                                         frame_count);
+    playback->song_frame += cached;
+    if (cached == frame_count || playback->cache.is_complete()) {
+        return cached;
+    }
+
+    // Not decoded yet: stream the rest, seeking only when the decoder is
+    // somewhere else
+    if (playback->decoder_frame != playback->song_frame) {
+        ma_decoder_seek_to_pcm_frame(&playback->decoder,
+                                     (ma_uint64)playback->song_frame);
+        playback->decoder_frame = playback->song_frame;
+    }
+    ma_uint64 frames_read = 0;
+    ma_decoder_read_pcm_frames(&playback->decoder,
+                               frames + cached * playback->cache.get_channels(),
+                               frame_count - cached, &frames_read);
+    playback->song_frame += (long long)frames_read;
+    playback->decoder_frame += (long long)frames_read;
+    return cached + (size_t)frames_read;
+}
+
+// Audio thread
+ma_result Playback::source_read(ma_data_source *data_source, void *frames,
+                                ma_uint64 frame_count,
+                                ma_uint64 *frames_read) {
+    Playback *playback = ((Source *)data_source)->owner;
+
+    long long seek_frame = playback->pending_seek.exchange(-1);
+    if (seek_frame >= 0) {
+        playback->song_frame = seek_frame;
+        playback->stretch.reset(seek_frame);
+    }
+    playback->stretch.set_rate(playback->pending_rate.load());
+
+    size_t written = playback->stretch.process(
+        (float *)frames, (size_t)frame_count, Playback::read_song, playback);
+    playback->cursor_frames.store(playback->stretch.source_position());
+
+    *frames_read = written;
+    return written == 0 ? MA_AT_END : MA_SUCCESS;
+}
+
+// Audio thread
+ma_result Playback::scrub_read(ma_data_source *data_source, void *frames,
+                               ma_uint64 frame_count, ma_uint64 *frames_read) {
+    Playback *playback = ((Source *)data_source)->owner;
+    uint32_t channels = playback->cache.get_channels();
+    size_t snippet_frames =
+        (size_t)(SCRUB_SECONDS * playback->cache.get_sample_rate());
+
+    long long scrub_frame = playback->pending_scrub.exchange(-1);
+    if (scrub_frame >= 0) {
+        playback->scrub_frame = scrub_frame;
+        playback->scrub_remaining = snippet_frames;
+    }
+
+    float *output = (float *)frames;
+    std::fill(output, output + frame_count * channels, 0.0f);
+
+    size_t count = std::min((size_t)frame_count, playback->scrub_remaining);
+    if (count > 0) {
+        size_t cached = playback->cache.read((size_t)playback->scrub_frame,
+                                             output, count);
+
+        // Sine envelope over the snippet so it starts and stops without a
+        // click
+        size_t position = snippet_frames - playback->scrub_remaining;
+        for (size_t i = 0; i < cached; i++) {
+            float gain = (float)std::sin(M_PI * (position + i) / snippet_frames);
+            for (uint32_t channel = 0; channel < channels; channel++) {
+                output[i * channels + channel] *= gain;
+            }
+        }
+
+        playback->scrub_frame += count;
+        playback->scrub_remaining -= count;
+    }
+
+    *frames_read = frame_count;
+    return MA_SUCCESS;
+}
+
+ma_result Playback::source_seek(ma_data_source *data_source,
+                                ma_uint64 frame_index) {
+    Playback *playback = ((Source *)data_source)->owner;
+    playback->pending_seek.store((long long)frame_index);
+    return MA_SUCCESS;
+}
+
+ma_result Playback::source_get_data_format(ma_data_source *data_source,
+                                           ma_format *format,
+                                           ma_uint32 *channels,
+                                           ma_uint32 *sample_rate,
+                                           ma_channel *channel_map,
+                                           size_t channel_map_capacity) {
+    Playback *playback = ((Source *)data_source)->owner;
+    *format = ma_format_f32;
+    *channels = playback->stretch.get_channels();
+    *sample_rate = playback->stretch.get_sample_rate();
+    ma_channel_map_init_standard(ma_standard_channel_map_default, channel_map,
+                                 channel_map_capacity, *channels);
+    return MA_SUCCESS;
+}
+
+ma_result Playback::source_get_cursor(ma_data_source *data_source,
+                                      ma_uint64 *cursor) {
+    Playback *playback = ((Source *)data_source)->owner;
+    *cursor = (ma_uint64)playback->cursor_frames.load();
+    return MA_SUCCESS;
+}
@@ -0,0 +1,289 @@
+#include "../include/playtest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "../include/trace.hpp"
+
+constexpr double JUDGEMENT_WEIGHTS[JUDGEMENT_COUNT] = {1.0, 0.7, 0.3, 0.0};
+
+// A note as the simulator sees it, prepared once and shared by every run
+struct PlayNote {
+    double seconds;
+    // Index into PlaytestReport::measures
+    size_t measure;
+    Side side;
+    Direction direction;
+    // Ends the hold that the previous note of its side started
+    bool ends_hold;
+    // The next note of its side is a long note, so the hand keeps holding
+    bool starts_hold;
+    // Deterministic part of the timing error
+    double scripted_error;
+};
+
+// Counts of one batch of runs
+struct RunTotals {
+    std::vector<long> judgements;
+    std::vector<long> misses;
+    double accuracy_sum{0.0};
+    double accuracy_square_sum{0.0};
+    size_t full_combos{0};
+};
+
+static bool in_difficulty(Lane lane, Difficulty difficulty) {
+    switch (difficulty) {
+        case DIFFICULTY_HARD:
+            return lane >= LANE_H1 && lane <= LANE_H5;
+        case DIFFICULTY_NORMAL:
+            return lane >= LANE_N1 && lane <= LANE_N4;
+        case DIFFICULTY_EASY:
+            return lane >= LANE_E1 && lane <= LANE_E3;
+    }
+    return false;
+}
+
+static Judgement judge(double error, const JudgementWindows &windows) {
+    error = std::abs(error);
+    if (error <= windows.perfect) return JUDGE_PERFECT;
+    if (error <= windows.great) return JUDGE_GREAT;
+    if (error <= windows.good) return JUDGE_GOOD;
+    return JUDGE_MISS;
+}
+
+double MeasureReport::miss_rate(size_t runs) const {
+    if (this->notes == 0 || runs == 0) return 0.0;
+    return (double)this->judgements[JUDGE_MISS] / ((double)this->notes * runs);
+}
+
+MissReason MeasureReport::main_miss_reason() const {
+    return (MissReason)(std::max_element(this->misses,
+                                         this->misses + MISS_REASON_COUNT) -
+                        this->misses);
+}
+
+std::vector<MeasureReport> PlaytestReport::hotspots(size_t count) const {
+    std::vector<MeasureReport> sorted;
+    for (const MeasureReport &measure : this->measures) {
+        if (measure.judgements[JUDGE_MISS] > 0) {
+            sorted.push_back(measure);
+        }
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [this](const MeasureReport &a, const MeasureReport &b) {
+                         return a.miss_rate(this->runs) > b.miss_rate(this->runs);
+                     });
+    if (sorted.size() > count) {
+        sorted.resize(count);
+    }
+    return sorted;
+}
+
+// One simulated run; judgements and misses are indexed [measure * COUNT + k]
+static void simulate(const std::vector<PlayNote> &notes,
+                     const JudgementWindows &windows, const PlayerModel &player,
+                     std::mt19937_64 &rng, RunTotals &totals) {
+    std::normal_distribution<double> timing(player.timing_bias,
+                                            player.timing_sigma);
+    std::normal_distribution<double> angle(0.0, player.flick_sigma_degrees);
+    std::normal_distribution<double> release(player.timing_bias,
+                                             player.release_sigma);
+
+    // Per hand: earliest next tap, whether it holds a long note and whether
+    // that hold is still intact
+    double free_at[2] = {-std::numeric_limits<double>::infinity(),
+                         -std::numeric_limits<double>::infinity()};
+    bool is_holding[2] = {false, false};
+    bool is_hold_intact[2] = {false, false};
+
+    double score = 0.0;
+    bool is_full_combo = true;
+
+    for (const PlayNote &note : notes) {
+        Judgement judgement = JUDGE_MISS;
+        MissReason reason = MISS_TIMING;
+
+        if (note.ends_hold) {
+            int hand = note.side == SIDE_LEFT ? 0 : 1;
+            double error = release(rng);
+            if (!is_hold_intact[hand]) {
+                reason = MISS_HOLD;
+            } else if (std::abs(error) > windows.release) {
+                reason = MISS_HOLD;
+                is_hold_intact[hand] = false;
+            } else {
+                judgement = JUDGE_PERFECT;
+            }
+
+            is_holding[hand] = note.starts_hold;
+            // Letting go frees the hand for the next tap
+            if (!note.starts_hold) {
+                free_at[hand] = std::max(free_at[hand],
+                                         note.seconds + error +
+                                             player.min_hand_interval);
+            }
+        } else {
+            int hand;
+            if (note.side == SIDE_LEFT) {
+                hand = 0;
+            } else if (note.side == SIDE_RIGHT) {
+                hand = 1;
+            } else if (is_holding[0] != is_holding[1]) {
+                hand = is_holding[0] ? 1 : 0;
+            } else {
+                hand = free_at[0] <= free_at[1] ? 0 : 1;
+            }
+
+            if (is_holding[hand]) {
+                reason = MISS_HAND_BUSY;
+            } else {
+                // A hand that is not ready yet taps as soon as it is
+                double tap = std::max(note.seconds + note.scripted_error +
+                                          timing(rng),
+                                      free_at[hand]);
+                free_at[hand] = tap + player.min_hand_interval;
+
+                judgement = judge(tap - note.seconds, windows);
+                if (judgement != JUDGE_MISS && note.direction != DIR_NONE &&
+                    std::abs(angle(rng)) > windows.flick_tolerance_degrees) {
+                    judgement = JUDGE_MISS;
+                    reason = MISS_FLICK;
+                }
+
+                if (note.starts_hold) {
+                    is_holding[hand] = true;
+                    is_hold_intact[hand] = judgement != JUDGE_MISS;
+                }
+            }
+        }
+
+        totals.judgements[note.measure * JUDGEMENT_COUNT + judgement]++;
+        if (judgement == JUDGE_MISS) {
+            totals.misses[note.measure * MISS_REASON_COUNT + reason]++;
+            is_full_combo = false;
+        }
+        score += JUDGEMENT_WEIGHTS[judgement];
+    }
+
+    double accuracy = notes.empty() ? 1.0 : score / notes.size();
+    totals.accuracy_sum += accuracy;
+    totals.accuracy_square_sum += accuracy * accuracy;
+    totals.full_combos += is_full_combo;
+}
+
+PlaytestReport playtest(Notechart &chart, Difficulty difficulty,
+                        const TempoMap &tempo_map,
+                        const JudgementWindows &windows,
+                        const PlayerModel &player, size_t runs, uint64_t seed,
+                        ThreadPool &pool) {
+    TRACE_SCOPE("playtest");
+
+    std::chrono::time_point<std::chrono::steady_clock> start =
+        std::chrono::steady_clock::now();
+
+    PlaytestReport report;
+    report.difficulty = difficulty;
+    report.runs = runs;
+
+    // Notes of the difficulty in chart order, split by side to find holds
+    std::vector<PlayNote> notes;
+    std::vector<size_t> last_of_side(3, SIZE_MAX);
+    for (std::shared_ptr<Note> &note : chart.notes) {
+        if (!in_difficulty(note->lane, difficulty)) continue;
+
+        long measure = note->tick / 192;
+        if (report.measures.empty() ||
+            report.measures.back().measure != measure) {
+            report.measures.push_back(MeasureReport());
+            report.measures.back().measure = measure;
+        }
+        report.measures.back().notes++;
+
+        double seconds = tempo_map.seconds_at((double)note->tick);
+        PlayNote play_note{seconds,
+                           report.measures.size() - 1,
+                           note->side,
+                           note->direction,
+                           false,
+                           false,
+                           player.timing_script
+                               ? player.timing_script(*note, seconds)
+                               : 0.0};
+
+        // Long notes continue the previous note of their side; without a
+        // side there is nothing to hold, so they play as taps
+        if (note->side != SIDE_NONE) {
+            size_t previous = last_of_side[note->side];
+            if (note->is_longnote && previous != SIZE_MAX) {
+                play_note.ends_hold = true;
+                notes[previous].starts_hold = true;
+            }
+            last_of_side[note->side] = notes.size();
+        }
+
+        notes.push_back(play_note);
+    }
+    report.notes = (long)notes.size();
+
+    // Runs are split into batches that count into their own totals
+    size_t batch_count = std::max<size_t>(std::min(runs, pool.size() * 4), 1);
+    std::vector<RunTotals> batches(batch_count);
+    pool.parallel_for(0, batch_count, 1, [&](size_t batch) {
+        TRACE_SCOPE("playtest/batch");
+
+        RunTotals &totals = batches[batch];
+        totals.judgements.assign(report.measures.size() * JUDGEMENT_COUNT, 0);
+        totals.misses.assign(report.measures.size() * MISS_REASON_COUNT, 0);
+
+        for (size_t run = batch * runs / batch_count;
+             run < (batch + 1) * runs / batch_count; run++) {
+            // Seeded per run, so results do not depend on the batching
+            std::mt19937_64 rng(seed + run);
+            simulate(notes, windows, player, rng, totals);
+        }
+    });
+
+    double accuracy_sum = 0.0, accuracy_square_sum = 0.0;
+    size_t full_combos = 0;
+    for (RunTotals &totals : batches) {
+        for (size_t m = 0; m < report.measures.size(); m++) {
+            MeasureReport &measure = report.measures[m];
+            for (int k = 0; k < JUDGEMENT_COUNT; k++) {
+                measure.judgements[k] += totals.judgements[m * JUDGEMENT_COUNT + k];
+            }
+            for (int k = 0; k < MISS_REASON_COUNT; k++) {
+                measure.misses[k] += totals.misses[m * MISS_REASON_COUNT + k];
+            }
+        }
+        accuracy_sum += totals.accuracy_sum;
+        accuracy_square_sum += totals.accuracy_square_sum;
+        full_combos += totals.full_combos;
+    }
+
+    for (MeasureReport &measure : report.measures) {
+        for (int k = 0; k < JUDGEMENT_COUNT; k++) {
+            report.judgements[k] += measure.judgements[k];
+        }
+    }
+
+    if (runs > 0) {
+        report.mean_accuracy = accuracy_sum / runs;
+        report.accuracy_stddev = std::sqrt(std::max(
+            accuracy_square_sum / runs -
+                report.mean_accuracy * report.mean_accuracy,
+            0.0));
+        report.full_combo_rate = (double)full_combos / runs;
+    }
+    if (!notes.empty()) {
+        report.simulated_seconds = notes.back().seconds * runs;
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    report.elapsed_seconds = elapsed.count();
+    return report;
+}
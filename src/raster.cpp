@@ -0,0 +1,306 @@
+#include "../include/raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../include/trace.hpp"
+
+void DisplayList::fill_rect(int x, int y, int width, int height,
+                            uint32_t colour) {
+    if (width <= 0 || height <= 0 || (colour >> 24) == 0) return;
+
+    RasterCommand command;
+    command.kind = RasterCommand::FILL_RECT;
+    command.colour = colour;
+    command.x = x;
+    command.y = y;
+    command.width = width;
+    command.height = height;
+    command.y_min = y;
+    command.y_max = y + height - 1;
+    this->commands.push_back(std::move(command));
+}
+
+void DisplayList::line(int x0, int y0, int x1, int y1, int thickness,
+                       uint32_t colour) {
+    if ((colour >> 24) == 0) return;
+    thickness = std::max(thickness, 1);
+
+    // Axis-aligned lines are plain rectangles
+    if (y0 == y1) {
+        this->fill_rect(std::min(x0, x1), y0 - thickness / 2,
+                        std::abs(x1 - x0) + 1, thickness, colour);
+        return;
+    }
+    if (x0 == x1) {
+        this->fill_rect(x0 - thickness / 2, std::min(y0, y1), thickness,
+                        std::abs(y1 - y0) + 1, colour);
+        return;
+    }
+
+    // Otherwise a quad around the pixel-center segment
+    float cx0 = x0 + 0.5f, cy0 = y0 + 0.5f, cx1 = x1 + 0.5f, cy1 = y1 + 0.5f;
+    float dx = cx1 - cx0, dy = cy1 - cy0;
+    float length = std::sqrt(dx * dx + dy * dy);
+    float nx = -dy / length * thickness * 0.5f;
+    float ny = dx / length * thickness * 0.5f;
+
+    RasterCommand command;
+    command.kind = RasterCommand::FILL_QUAD;
+    command.colour = colour;
+    command.xs[0] = cx0 + nx, command.ys[0] = cy0 + ny;
+    command.xs[1] = cx1 + nx, command.ys[1] = cy1 + ny;
+    command.xs[2] = cx1 - nx, command.ys[2] = cy1 - ny;
+    command.xs[3] = cx0 - nx, command.ys[3] = cy0 - ny;
+    command.y_min = (int)std::floor(*std::min_element(command.ys, command.ys + 4));
+    command.y_max = (int)std::ceil(*std::max_element(command.ys, command.ys + 4));
+    this->commands.push_back(std::move(command));
+}
+
+void DisplayList::mask(int x, int y, std::shared_ptr<const RasterMask> mask) {
+    if (!mask || mask->width <= 0 || mask->height <= 0) return;
+
+    RasterCommand command;
+    command.kind = RasterCommand::MASK;
+    command.x = x;
+    command.y = y;
+    command.width = mask->width;
+    command.height = mask->height;
+    command.y_min = y;
+    command.y_max = y + mask->height - 1;
+    command.mask = std::move(mask);
+    this->commands.push_back(std::move(command));
+}
+
+void DisplayList::image(int x, int y, int width, int height,
+                        std::shared_ptr<const RasterImage> image) {
+    if (!image || image->width <= 0 || image->height <= 0 || width <= 0 ||
+        height <= 0)
+        return;
+
+    RasterCommand command;
+    command.kind = RasterCommand::IMAGE;
+    command.x = x;
+    command.y = y;
+    command.width = width;
+    command.height = height;
+    command.y_min = y;
+    command.y_max = y + height - 1;
+    command.image = std::move(image);
+    this->commands.push_back(std::move(command));
+}
+
+void Framebuffer::resize(int _width, int _height) {
+    this->width = _width;
+    this->height = _height;
+    this->pixels.resize((size_t)_width * _height);
+}
+
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src,
+                                   uint32_t alpha) {
+    uint32_t inverse = 255 - alpha;
+    uint32_t rb = (src & 0xff00ff) * alpha + (dst & 0xff00ff) * inverse;
+    uint32_t g = (src & 0x00ff00) * alpha + (dst & 0x00ff00) * inverse;
+    // Divide by 255 with rounding
+    rb = ((rb + 0x800080 + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+    g = ((g + 0x008000 + ((g >> 8) & 0x00ff00)) >> 8) & 0x00ff00;
+    return 0xff000000 | rb | g;
+}
+
+static void fill_span(uint32_t *dst, int count, uint32_t colour) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i value = _mm_set1_epi32((int)colour);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(dst + i), value);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = colour;
+    }
+}
+
+static void blend_span(uint32_t *dst, int count, uint32_t colour) {
+    uint32_t alpha = colour >> 24;
+    int i = 0;
+#ifdef __SSE2__
+    // Four pixels at a time in 16-bit lanes: (src * a + dst * (255 - a)) / 255
+    __m128i zero = _mm_setzero_si128();
+    __m128i source = _mm_unpacklo_epi8(_mm_set1_epi32((int)colour), zero);
+    __m128i weight = _mm_set1_epi16((short)alpha);
+    __m128i inverse = _mm_set1_epi16((short)(255 - alpha));
+    __m128i premultiplied =
+        _mm_add_epi16(_mm_mullo_epi16(source, weight), _mm_set1_epi16(128));
+    __m128i opaque = _mm_set1_epi32((int)0xff000000);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((__m128i *)(dst + i));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, inverse), premultiplied);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, inverse), premultiplied);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = blend_pixel(dst[i], colour, alpha);
+    }
+}
+
+static void span(uint32_t *row, int x_begin, int x_end, int width,
+                 uint32_t colour) {
+    x_begin = std::max(x_begin, 0);
+    x_end = std::min(x_end, width);
+    if (x_begin >= x_end) return;
+
+    if ((colour >> 24) == 255) {
+        fill_span(row + x_begin, x_end - x_begin, colour);
+    } else {
+        blend_span(row + x_begin, x_end - x_begin, colour);
+    }
+}
+
+TiledRasterizer::TiledRasterizer(ThreadPool &_pool, int _tile_height)
+    : pool(_pool), tile_height(std::max(_tile_height, 1)) {}
+
+void TiledRasterizer::render(const DisplayList &list,
+                             Framebuffer &framebuffer) {
+    TRACE_SCOPE("TiledRasterizer::render");
+
+    size_t tile_count =
+        (framebuffer.height + this->tile_height - 1) / this->tile_height;
+    this->bins.resize(tile_count);
+    for (std::vector<uint32_t> &bin : this->bins) {
+        bin.clear();
+    }
+
+    // Bin every command into the tiles its rows overlap
+    for (size_t i = 0; i < list.commands.size(); i++) {
+        const RasterCommand &command = list.commands[i];
+        int y_min = std::max(command.y_min, 0);
+        int y_max = std::min(command.y_max, framebuffer.height - 1);
+        for (int tile = y_min / this->tile_height;
+             tile <= y_max / this->tile_height && y_min <= y_max; tile++) {
+            this->bins[tile].push_back((uint32_t)i);
+        }
+    }
+
+    this->pool.parallel_for(0, tile_count, 1, [&](size_t tile) {
+        this->render_tile(list, framebuffer, tile);
+    });
+}
+
+void TiledRasterizer::render_tile(const DisplayList &list,
+                                  Framebuffer &framebuffer, size_t tile) {
+    int tile_begin = (int)tile * this->tile_height;
+    int tile_end = std::min(tile_begin + this->tile_height, framebuffer.height);
+    int width = framebuffer.width;
+
+    for (uint32_t index : this->bins[tile]) {
+        const RasterCommand &command = list.commands[index];
+        int y_begin = std::max(command.y_min, tile_begin);
+        int y_end = std::min(command.y_max + 1, tile_end);
+
+        switch (command.kind) {
+            case RasterCommand::FILL_RECT: {
+                for (int y = y_begin; y < y_end; y++) {
+                    span(&framebuffer.pixels[(size_t)y * width], command.x,
+                         command.x + command.width, width, command.colour);
+                }
+                break;
+            }
+            case RasterCommand::FILL_QUAD: {
+                // Scanline through the pixel centers of a convex polygon
+                for (int y = y_begin; y < y_end; y++) {
+                    float center = y + 0.5f;
+                    float x_min = INFINITY, x_max = -INFINITY;
+                    for (int edge = 0; edge < 4; edge++) {
+                        float xa = command.xs[edge], ya = command.ys[edge];
+                        float xb = command.xs[(edge + 1) % 4];
+                        float yb = command.ys[(edge + 1) % 4];
+                        if ((ya <= center && center < yb) ||
+                            (yb <= center && center < ya)) {
+                            float x = xa + (center - ya) * (xb - xa) / (yb - ya);
+                            x_min = std::min(x_min, x);
+                            x_max = std::max(x_max, x);
+                        }
+                    }
+                    if (x_min <= x_max) {
+                        span(&framebuffer.pixels[(size_t)y * width],
+                             (int)std::ceil(x_min - 0.5f),
+                             (int)std::ceil(x_max - 0.5f), width,
+                             command.colour);
+                    }
+                }
+                break;
+            }
+            case RasterCommand::MASK: {
+                const RasterMask &mask = *command.mask;
+                uint32_t colour_alpha = mask.colour >> 24;
+                int x_begin = std::max(command.x, 0);
+                int x_end = std::min(command.x + mask.width, width);
+
+                for (int y = y_begin; y < y_end; y++) {
+                    uint32_t *row = &framebuffer.pixels[(size_t)y * width];
+                    const uint8_t *coverage =
+                        &mask.alpha[(size_t)(y - command.y) * mask.width];
+                    for (int x = x_begin; x < x_end; x++) {
+                        uint32_t alpha =
+                            coverage[x - command.x] * colour_alpha / 255;
+                        if (alpha != 0) {
+                            row[x] = blend_pixel(row[x], mask.colour, alpha);
+                        }
+                    }
+                }
+                break;
+            }
+            case RasterCommand::IMAGE: {
+                const RasterImage &image = *command.image;
+                int x_begin = std::max(command.x, 0);
+                int x_end = std::min(command.x + command.width, width);
+
+                for (int y = y_begin; y < y_end; y++) {
+                    uint32_t *row = &framebuffer.pixels[(size_t)y * width];
+                    const uint32_t *source =
+                        &image.pixels[(size_t)((long long)(y - command.y) *
+                                               image.height / command.height) *
+                                      image.width];
+                    for (int x = x_begin; x < x_end; x++) {
+                        row[x] = 0xff000000 |
+                                 source[(long long)(x - command.x) *
+                                        image.width / command.width];
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+void TiledRasterizer::to_rgb(const Framebuffer &framebuffer, uint8_t *rgb) {
+    TRACE_SCOPE("TiledRasterizer::to_rgb");
+
+    size_t tile_count =
+        (framebuffer.height + this->tile_height - 1) / this->tile_height;
+    this->pool.parallel_for(0, tile_count, 1, [&](size_t tile) {
+        size_t begin = tile * this->tile_height * framebuffer.width;
+        size_t end =
+            std::min<size_t>((tile + 1) * this->tile_height, framebuffer.height) *
+            framebuffer.width;
+        for (size_t i = begin; i < end; i++) {
+            uint32_t pixel = framebuffer.pixels[i];
+            rgb[i * 3 + 0] = (pixel >> 16) & 0xff;
+            rgb[i * 3 + 1] = (pixel >> 8) & 0xff;
+            rgb[i * 3 + 2] = pixel & 0xff;
+        }
+    });
+}
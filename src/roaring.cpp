@@ -0,0 +1,315 @@
+#include "../include/roaring.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+bool RoaringBitmap::Container::contains(uint16_t low) const {
+    if (this->is_bitset()) {
+        return (this->bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(this->array.begin(), this->array.end(), low);
+}
+
+void RoaringBitmap::Container::to_bitset() {
+    this->bits.assign(BITSET_WORDS, 0);
+    for (uint16_t low : this->array) {
+        this->bits[low >> 6] |= 1ull << (low & 63);
+    }
+    this->array.clear();
+    this->array.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::to_array() {
+    this->array.clear();
+    this->array.reserve(this->cardinality);
+    for (size_t word = 0; word < this->bits.size(); word++) {
+        uint64_t bits = this->bits[word];
+        while (bits != 0) {
+            this->array.push_back((uint16_t)(word * 64 + __builtin_ctzll(bits)));
+            bits &= bits - 1;
+        }
+    }
+    this->bits.clear();
+    this->bits.shrink_to_fit();
+}
+
+size_t RoaringBitmap::find(uint16_t key) const {
+    return std::lower_bound(this->containers.begin(), this->containers.end(),
+                            key,
+                            [](const Container &container, uint16_t key) {
+                                return container.key < key;
+                            }) -
+           this->containers.begin();
+}
+
+void RoaringBitmap::add(uint32_t value) {
+    uint16_t key = value >> 16, low = value & 0xffff;
+
+    size_t idx = this->find(key);
+    if (idx == this->containers.size() || this->containers[idx].key != key) {
+        Container container;
+        container.key = key;
+        this->containers.insert(this->containers.begin() + idx,
+                                std::move(container));
+    }
+
+    Container &container = this->containers[idx];
+    if (container.is_bitset()) {
+        uint64_t &word = container.bits[low >> 6];
+        uint64_t mask = 1ull << (low & 63);
+        if (!(word & mask)) {
+            word |= mask;
+            container.cardinality++;
+        }
+        return;
+    }
+
+    auto it = std::lower_bound(container.array.begin(), container.array.end(),
+                               low);
+    if (it != container.array.end() && *it == low) return;
+    container.array.insert(it, low);
+    container.cardinality++;
+    if (container.cardinality > ARRAY_LIMIT) {
+        container.to_bitset();
+    }
+}
+
+bool RoaringBitmap::remove(uint32_t value) {
+    uint16_t key = value >> 16, low = value & 0xffff;
+
+    size_t idx = this->find(key);
+    if (idx == this->containers.size() || this->containers[idx].key != key) {
+        return false;
+    }
+
+    Container &container = this->containers[idx];
+    if (container.is_bitset()) {
+        uint64_t &word = container.bits[low >> 6];
+        uint64_t mask = 1ull << (low & 63);
+        if (!(word & mask)) return false;
+        word &= ~mask;
+        container.cardinality--;
+        if (container.cardinality <= ARRAY_LIMIT) {
+            container.to_array();
+        }
+    } else {
+        auto it = std::lower_bound(container.array.begin(),
+                                   container.array.end(), low);
+        if (it == container.array.end() || *it != low) return false;
+        container.array.erase(it);
+        container.cardinality--;
+    }
+
+    if (container.cardinality == 0) {
+        this->containers.erase(this->containers.begin() + idx);
+    }
+    return true;
+}
+
+bool RoaringBitmap::contains(uint32_t value) const {
+    uint16_t key = value >> 16;
+    size_t idx = this->find(key);
+    return idx < this->containers.size() && this->containers[idx].key == key &&
+           this->containers[idx].contains(value & 0xffff);
+}
+
+size_t RoaringBitmap::cardinality() const {
+    size_t total = 0;
+    for (const Container &container : this->containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container &a,
+                                                  const Container &b) {
+    Container result;
+    result.key = a.key;
+
+    if (a.is_bitset() && b.is_bitset()) {
+        result.bits.resize(BITSET_WORDS);
+        for (size_t word = 0; word < BITSET_WORDS; word++) {
+            result.bits[word] = a.bits[word] & b.bits[word];
+            result.cardinality += __builtin_popcountll(result.bits[word]);
+        }
+        if (result.cardinality <= ARRAY_LIMIT) {
+            result.to_array();
+        }
+    } else if (a.is_bitset() || b.is_bitset()) {
+        // Probe the bitset with every element of the array
+        const Container &array = a.is_bitset() ? b : a;
+        const Container &bitset = a.is_bitset() ? a : b;
+        for (uint16_t low : array.array) {
+            if (bitset.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.cardinality = (uint32_t)result.array.size();
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(),
+                              b.array.end(), std::back_inserter(result.array));
+        result.cardinality = (uint32_t)result.array.size();
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container &a,
+                                              const Container &b) {
+    Container result;
+    result.key = a.key;
+
+    if (!a.is_bitset() && !b.is_bitset()) {
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(),
+                       b.array.end(), std::back_inserter(result.array));
+        result.cardinality = (uint32_t)result.array.size();
+        if (result.cardinality > ARRAY_LIMIT) {
+            result.to_bitset();
+        }
+        return result;
+    }
+
+    result.bits.assign(BITSET_WORDS, 0);
+    for (const Container *side : {&a, &b}) {
+        if (side->is_bitset()) {
+            for (size_t word = 0; word < BITSET_WORDS; word++) {
+                result.bits[word] |= side->bits[word];
+            }
+        } else {
+            for (uint16_t low : side->array) {
+                result.bits[low >> 6] |= 1ull << (low & 63);
+            }
+        }
+    }
+    for (uint64_t word : result.bits) {
+        result.cardinality += __builtin_popcountll(word);
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container &a,
+                                                 const Container &b) {
+    Container result;
+    result.key = a.key;
+
+    if (a.is_bitset()) {
+        result.bits = a.bits;
+        if (b.is_bitset()) {
+            for (size_t word = 0; word < BITSET_WORDS; word++) {
+                result.bits[word] &= ~b.bits[word];
+            }
+        } else {
+            for (uint16_t low : b.array) {
+                result.bits[low >> 6] &= ~(1ull << (low & 63));
+            }
+        }
+        for (uint64_t word : result.bits) {
+            result.cardinality += __builtin_popcountll(word);
+        }
+        if (result.cardinality <= ARRAY_LIMIT) {
+            result.to_array();
+        }
+    } else if (b.is_bitset()) {
+        for (uint16_t low : a.array) {
+            if (!b.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.cardinality = (uint32_t)result.array.size();
+    } else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(),
+                            b.array.end(), std::back_inserter(result.array));
+        result.cardinality = (uint32_t)result.array.size();
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap &other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < this->containers.size() && j < other.containers.size()) {
+        const Container &a = this->containers[i];
+        const Container &b = other.containers[j];
+        if (a.key < b.key) {
+            i++;
+        } else if (b.key < a.key) {
+            j++;
+        } else {
+            Container container = intersect(a, b);
+            if (container.cardinality > 0) {
+                result.containers.push_back(std::move(container));
+            }
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap &other) const {
+    RoaringBitmap result;
+    size_t i = 0, j = 0;
+    while (i < this->containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() ||
+            (i < this->containers.size() &&
+             this->containers[i].key < other.containers[j].key)) {
+            result.containers.push_back(this->containers[i++]);
+        } else if (i == this->containers.size() ||
+                   other.containers[j].key < this->containers[i].key) {
+            result.containers.push_back(other.containers[j++]);
+        } else {
+            result.containers.push_back(
+                unite(this->containers[i++], other.containers[j++]));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator-(const RoaringBitmap &other) const {
+    RoaringBitmap result;
+    size_t j = 0;
+    for (const Container &a : this->containers) {
+        while (j < other.containers.size() && other.containers[j].key < a.key) {
+            j++;
+        }
+        if (j == other.containers.size() || other.containers[j].key != a.key) {
+            result.containers.push_back(a);
+            continue;
+        }
+        Container container = subtract(a, other.containers[j]);
+        if (container.cardinality > 0) {
+            result.containers.push_back(std::move(container));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap &RoaringBitmap::operator&=(const RoaringBitmap &other) {
+    *this = *this & other;
+    return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator|=(const RoaringBitmap &other) {
+    *this = *this | other;
+    return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator-=(const RoaringBitmap &other) {
+    *this = *this - other;
+    return *this;
+}
+
+std::vector<uint32_t> RoaringBitmap::to_vector() const {
+    std::vector<uint32_t> values;
+    values.reserve(this->cardinality());
+    this->for_each([&values](uint32_t value) { values.push_back(value); });
+    return values;
+}
+
+size_t RoaringBitmap::memory_usage() const {
+    size_t bytes = this->containers.capacity() * sizeof(Container);
+    for (const Container &container : this->containers) {
+        bytes += container.array.capacity() * sizeof(uint16_t) +
+                 container.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
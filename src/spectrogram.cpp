@@ -0,0 +1,268 @@
+#include "../include/spectrogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../include/fft.hpp"
+#include "../include/trace.hpp"
+
+constexpr uint32_t SAMPLE_RATE = 22050;
+constexpr size_t FFT_SIZE = 2048;
+constexpr double MIN_FREQUENCY = 40.0;
+constexpr double MAX_FREQUENCY = 10000.0;
+constexpr float FLOOR_DB = -80.0f;
+
+// White through orange to a deep purple, so silence blends into the lanes
+static uint32_t heat_colour(float intensity) {
+    static const float stops[3][3] = {
+        {255.0f, 255.0f, 255.0f}, {255.0f, 160.0f, 64.0f}, {48.0f, 16.0f, 96.0f}};
+
+    float position = std::clamp(intensity, 0.0f, 1.0f) * 2.0f;
+    int stop = std::min((int)position, 1);
+    float t = position - stop;
+
+    uint32_t colour = 0xff000000;
+    for (int channel = 0; channel < 3; channel++) {
+        float value = stops[stop][channel] +
+                      (stops[stop + 1][channel] - stops[stop][channel]) * t;
+        colour |= (uint32_t)std::lround(value) << (16 - channel * 8);
+    }
+    return colour;
+}
+
+SpectrogramCache::SpectrogramCache(size_t _memory_budget, size_t thread_count)
+    : memory_budget(_memory_budget),
+      pool(std::make_unique<ThreadPool>(thread_count)) {}
+
+SpectrogramCache::~SpectrogramCache() {
+    // Let the queued tiles fall through before the pool joins its workers
+    this->close();
+    this->pool.reset();
+}
+
+void SpectrogramCache::open(const std::string &file_path) {
+    this->close();
+
+    long generation;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        generation = this->generation;
+    }
+
+    this->pool->submit([this, file_path, generation] {
+        std::shared_ptr<PcmBuffer> pcm = std::make_shared<PcmBuffer>();
+        if (!decode_audio(file_path, 1, SAMPLE_RATE, *pcm)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->generation == generation) {
+            this->pcm = std::move(pcm);
+        }
+    });
+}
+
+void SpectrogramCache::close() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->pcm.reset();
+    }
+    this->invalidate();
+}
+
+bool SpectrogramCache::is_open() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->pcm != nullptr;
+}
+
+void SpectrogramCache::invalidate() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->generation++;
+        this->scheduled.clear();
+        this->finished.clear();
+    }
+    this->wanted_first = 0;
+    this->wanted_last = -1;
+
+    this->entries.clear();
+    this->index.clear();
+    this->used_bytes = 0;
+    this->current_revision++;
+}
+
+void SpectrogramCache::request(long first, long last, const TempoMap &tempo_map,
+                               double offset) {
+    first = std::max(first, 0L);
+    this->wanted_first = first;
+    this->wanted_last = last;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->pcm) {
+        return;
+    }
+
+    for (long measure = first; measure <= last; measure++) {
+        if (this->index.contains(measure) ||
+            this->scheduled.contains(measure)) {
+            continue;
+        }
+
+        // Song time at the middle of every tick, from the top row down; the
+        // tempo map stays on the UI thread
+        std::vector<double> row_seconds(SpectrogramTile::ROWS);
+        for (int row = 0; row < SpectrogramTile::ROWS; row++) {
+            double tick = (double)(measure + 1) * SpectrogramTile::ROWS - row - 0.5;
+            row_seconds[row] = tempo_map.seconds_at(tick) - offset;
+        }
+
+        this->scheduled.insert(measure);
+        this->pool->submit([this, measure, row_seconds = std::move(row_seconds),
+                            generation = this->generation]() mutable {
+            this->compute(measure, std::move(row_seconds), generation);
+        });
+    }
+}
+
+void SpectrogramCache::compute(long measure, std::vector<double> row_seconds,
+                               long generation) {
+    std::shared_ptr<const PcmBuffer> pcm;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->generation != generation) {
+            return;
+        }
+        // Scrolled away while queued: forget it so it can be asked again
+        if (measure < this->wanted_first - 1 || measure > this->wanted_last + 1) {
+            this->scheduled.erase(measure);
+            return;
+        }
+        pcm = this->pcm;
+    }
+    if (!pcm) {
+        return;
+    }
+
+    TRACE_SCOPE("SpectrogramCache::compute");
+
+    // FFT bins covered by every column, at least one
+    static const FFT fft(FFT_SIZE);
+    static const std::vector<std::pair<size_t, size_t>> columns = [] {
+        std::vector<std::pair<size_t, size_t>> ranges(SpectrogramTile::BINS);
+        double bin_hz = (double)SAMPLE_RATE / FFT_SIZE;
+        for (int column = 0; column < SpectrogramTile::BINS; column++) {
+            double lo = MIN_FREQUENCY *
+                        std::pow(MAX_FREQUENCY / MIN_FREQUENCY,
+                                 (double)column / SpectrogramTile::BINS);
+            double hi = MIN_FREQUENCY *
+                        std::pow(MAX_FREQUENCY / MIN_FREQUENCY,
+                                 (double)(column + 1) / SpectrogramTile::BINS);
+            size_t begin = (size_t)std::lround(lo / bin_hz);
+            size_t end = std::max((size_t)std::lround(hi / bin_hz), begin + 1);
+            ranges[column] = {begin, std::min(end, FFT_SIZE / 2 + 1)};
+        }
+        return ranges;
+    }();
+
+    std::vector<float> frame(FFT_SIZE), re(FFT_SIZE), im(FFT_SIZE);
+    std::vector<float> magnitudes(FFT_SIZE / 2 + 1);
+
+    std::shared_ptr<RasterImage> image = std::make_shared<RasterImage>();
+    image->width = SpectrogramTile::BINS;
+    image->height = SpectrogramTile::ROWS;
+    image->pixels.resize((size_t)image->width * image->height);
+
+    // Full scale for a Hann-windowed sine
+    float reference = FFT_SIZE / 4.0f;
+    long long sample_count = (long long)pcm->frames();
+
+    for (int row = 0; row < SpectrogramTile::ROWS; row++) {
+        long long start = std::llround(row_seconds[row] * SAMPLE_RATE) -
+                          (long long)FFT_SIZE / 2;
+        uint32_t *pixels = &image->pixels[(size_t)row * image->width];
+
+        if (start + (long long)FFT_SIZE <= 0 || start >= sample_count) {
+            std::fill(pixels, pixels + image->width, heat_colour(0.0f));
+            continue;
+        }
+
+        for (size_t i = 0; i < FFT_SIZE; i++) {
+            long long s = start + (long long)i;
+            frame[i] = (s >= 0 && s < sample_count) ? pcm->samples[s] : 0.0f;
+        }
+        fft.magnitudes(frame.data(), magnitudes.data(), re.data(), im.data());
+
+        for (int column = 0; column < SpectrogramTile::BINS; column++) {
+            float peak = 0.0f;
+            for (size_t k = columns[column].first; k < columns[column].second;
+                 k++) {
+                peak = std::max(peak, magnitudes[k]);
+            }
+            float db = 20.0f * std::log10(peak / reference + 1e-9f);
+            pixels[column] = heat_colour(1.0f - db / FLOOR_DB);
+        }
+    }
+
+    std::shared_ptr<SpectrogramTile> tile = std::make_shared<SpectrogramTile>();
+    tile->measure = measure;
+    tile->image = std::move(image);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->generation == generation) {
+        this->finished.push_back(std::move(tile));
+    }
+}
+
+bool SpectrogramCache::collect() {
+    std::vector<Entry> tiles;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        tiles.swap(this->finished);
+        for (const Entry &tile : tiles) {
+            this->scheduled.erase(tile->measure);
+        }
+    }
+
+    for (Entry &tile : tiles) {
+        this->insert(std::move(tile));
+    }
+    return !tiles.empty();
+}
+
+void SpectrogramCache::insert(Entry tile) {
+    size_t bytes = tile->image->pixels.size() * sizeof(uint32_t);
+
+    auto it = this->index.find(tile->measure);
+    if (it != this->index.end()) {
+        this->used_bytes -= (*it->second)->image->pixels.size() * sizeof(uint32_t);
+        this->entries.erase(it->second);
+    }
+
+    this->entries.push_front(std::move(tile));
+    this->index[this->entries.front()->measure] = this->entries.begin();
+    this->used_bytes += bytes;
+    this->current_revision++;
+
+    // Evict from the cold end, but never the tile just added
+    while (this->used_bytes > this->memory_budget && this->entries.size() > 1) {
+        this->used_bytes -=
+            this->entries.back()->image->pixels.size() * sizeof(uint32_t);
+        this->index.erase(this->entries.back()->measure);
+        this->entries.pop_back();
+    }
+}
+
+std::shared_ptr<const SpectrogramTile> SpectrogramCache::get(long measure) {
+    auto it = this->index.find(measure);
+    if (it == this->index.end()) {
+        return nullptr;
+    }
+
+    this->entries.splice(this->entries.begin(), this->entries, it->second);
+    return *it->second;
+}
+
+size_t SpectrogramCache::pending() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->scheduled.size();
+}
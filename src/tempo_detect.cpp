@@ -0,0 +1,285 @@
+#include "../include/tempo_detect.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../include/trace.hpp"
+
+// Tightness of the beat tracker: how strongly it sticks to the local period
+constexpr double BEAT_TIGHTNESS = 100.0;
+// Width in octaves of the log-normal tempo prior
+constexpr double GLOBAL_PRIOR_WIDTH = 1.0;
+constexpr double LOCAL_PRIOR_WIDTH = 0.3;
+
+// Autocorrelation of `envelope[begin, end)` for every lag in [lag_lo, lag_hi]
+static std::vector<double> autocorrelate(const std::vector<float> &envelope,
+                                         size_t begin, size_t end,
+                                         size_t lag_lo, size_t lag_hi) {
+    std::vector<double> correlation(lag_hi + 1, 0.0);
+    for (size_t lag = lag_lo; lag <= lag_hi; lag++) {
+        double sum = 0.0;
+        for (size_t t = begin; t + lag < end; t++) {
+            sum += envelope[t] * envelope[t + lag];
+        }
+        correlation[lag] = sum;
+    }
+    return correlation;
+}
+
+// Best tempo of a correlation under a log-normal prior around `center`
+static double pick_tempo(const std::vector<double> &correlation,
+                         size_t lag_lo, size_t lag_hi, double frame_rate,
+                         double center, double width) {
+    size_t best = lag_lo;
+    double best_score = -1.0;
+    for (size_t lag = lag_lo; lag <= lag_hi; lag++) {
+        double bpm = 60.0 * frame_rate / lag;
+        double octaves = std::log2(bpm / center) / width;
+        double score = correlation[lag] * std::exp(-0.5 * octaves * octaves);
+        if (score > best_score) {
+            best = lag;
+            best_score = score;
+        }
+    }
+
+    // Parabolic interpolation between neighbouring lags
+    double lag = (double)best;
+    if (best > lag_lo && best < lag_hi) {
+        double a = correlation[best - 1], b = correlation[best],
+               c = correlation[best + 1];
+        double denominator = a - 2.0 * b + c;
+        if (denominator < 0.0) {
+            lag += 0.5 * (a - c) / denominator;
+        }
+    }
+    return 60.0 * frame_rate / lag;
+}
+
+static double round_bpm(double bpm) {
+    double whole = std::round(bpm);
+    if (std::abs(bpm - whole) < 0.05) return whole;
+    return std::round(bpm * 100.0) / 100.0;
+}
+
+TempoEstimate detect_tempo(const PcmBuffer &mono, ThreadPool &pool,
+                           const TempoOptions &options,
+                           const OnsetOptions &onset_options) {
+    TRACE_SCOPE("detect_tempo");
+
+    TempoEstimate estimate;
+    std::vector<float> envelope = onset_envelope(mono, pool, onset_options);
+    size_t frame_count = envelope.size();
+    double frame_rate = (double)mono.sample_rate / onset_options.hop_size;
+    if (frame_count < (size_t)(frame_rate * 4.0)) return estimate;
+
+    // Keep only the rises above the local average, scaled to unit deviation
+    {
+        size_t radius = (size_t)(frame_rate * 0.25);
+        std::vector<double> prefix(frame_count + 1, 0.0);
+        for (size_t t = 0; t < frame_count; t++) {
+            prefix[t + 1] = prefix[t] + envelope[t];
+        }
+        std::vector<float> rectified(frame_count);
+        double energy = 0.0;
+        for (size_t t = 0; t < frame_count; t++) {
+            size_t lo = t >= radius ? t - radius : 0;
+            size_t hi = std::min(t + radius + 1, frame_count);
+            double mean = (prefix[hi] - prefix[lo]) / (hi - lo);
+            rectified[t] = (float)std::max(envelope[t] - mean, 0.0);
+            energy += rectified[t] * rectified[t];
+        }
+        float deviation = (float)std::sqrt(energy / frame_count) + 1e-9f;
+        for (float &value : rectified) {
+            value /= deviation;
+        }
+        envelope = std::move(rectified);
+    }
+
+    size_t lag_lo = (size_t)std::floor(60.0 * frame_rate / options.max_bpm);
+    size_t lag_hi = (size_t)std::ceil(60.0 * frame_rate / options.min_bpm);
+
+    // Local correlations in parallel; their sum is the global one
+    size_t window = (size_t)(options.window_seconds * frame_rate);
+    size_t step = std::max((size_t)(options.step_seconds * frame_rate), (size_t)1);
+    size_t window_count =
+        frame_count > window ? (frame_count - window) / step + 1 : 1;
+    std::vector<std::vector<double>> correlations(window_count);
+    pool.parallel_for(0, window_count, 1, [&](size_t w) {
+        size_t begin = w * step;
+        correlations[w] = autocorrelate(envelope, begin,
+                                        std::min(begin + window, frame_count),
+                                        lag_lo, lag_hi);
+    });
+
+    std::vector<double> global(lag_hi + 1, 0.0);
+    for (std::vector<double> &correlation : correlations) {
+        for (size_t lag = lag_lo; lag <= lag_hi; lag++) {
+            global[lag] += correlation[lag];
+        }
+    }
+    double global_bpm = pick_tempo(global, lag_lo, lag_hi, frame_rate, 120.0,
+                                   GLOBAL_PRIOR_WIDTH);
+
+    // Local tempo near the global one, median-filtered against outliers
+    std::vector<double> local_bpm(window_count);
+    for (size_t w = 0; w < window_count; w++) {
+        local_bpm[w] = pick_tempo(correlations[w], lag_lo, lag_hi, frame_rate,
+                                  global_bpm, LOCAL_PRIOR_WIDTH);
+    }
+    std::vector<double> smoothed(window_count);
+    for (size_t w = 0; w < window_count; w++) {
+        size_t lo = w >= 2 ? w - 2 : 0;
+        size_t hi = std::min(w + 3, window_count);
+        std::vector<double> neighbourhood(local_bpm.begin() + lo,
+                                          local_bpm.begin() + hi);
+        std::nth_element(neighbourhood.begin(),
+                         neighbourhood.begin() + neighbourhood.size() / 2,
+                         neighbourhood.end());
+        smoothed[w] = neighbourhood[neighbourhood.size() / 2];
+    }
+
+    // Beat tracking: best chain of onsets spaced about one local period apart
+    std::vector<double> score(frame_count);
+    std::vector<long> backlink(frame_count, -1);
+    for (size_t t = 0; t < frame_count; t++) {
+        size_t w = std::min(t > window / 2 ? (t - window / 2) / step : 0,
+                            window_count - 1);
+        double period = 60.0 * frame_rate / smoothed[w];
+
+        long lo = (long)t - (long)std::round(2.0 * period);
+        long hi = (long)t - (long)std::round(0.5 * period);
+        double best = 0.0;
+        for (long tau = std::max(lo, 0L); tau <= hi; tau++) {
+            double gap = std::log((t - tau) / period);
+            double candidate = score[tau] - BEAT_TIGHTNESS * gap * gap;
+            if (backlink[t] < 0 || candidate > best) {
+                best = candidate;
+                backlink[t] = tau;
+            }
+        }
+        score[t] = envelope[t] + (backlink[t] >= 0 ? best : 0.0);
+    }
+
+    // Backtrace from the best-scoring frame within the last period
+    size_t last_period = (size_t)(60.0 * frame_rate / smoothed.back());
+    size_t tail_begin = frame_count > last_period ? frame_count - last_period : 0;
+    long frame = (long)(std::max_element(score.begin() + tail_begin, score.end()) -
+                        score.begin());
+    std::vector<long> beat_frames;
+    while (frame >= 0) {
+        beat_frames.push_back(frame);
+        frame = backlink[frame];
+    }
+    std::reverse(beat_frames.begin(), beat_frames.end());
+
+    // The tracker's inertia lags behind tempo changes; pull every beat onto
+    // the strongest onset within a tenth of a period
+    for (long &beat_frame : beat_frames) {
+        size_t w = std::min(
+            (size_t)beat_frame > window / 2 ? (beat_frame - window / 2) / step : 0,
+            window_count - 1);
+        long reach = (long)(6.0 * frame_rate / smoothed[w]);
+        long lo = std::max(beat_frame - reach, 0L);
+        long hi = std::min(beat_frame + reach + 1, (long)frame_count);
+        beat_frame = (long)(std::max_element(envelope.begin() + lo,
+                                             envelope.begin() + hi) -
+                            envelope.begin());
+    }
+
+    // Leading beats the tracker placed in the silence before the music
+    std::vector<float> strengths;
+    for (long beat_frame : beat_frames) {
+        strengths.push_back(envelope[beat_frame]);
+    }
+    std::nth_element(strengths.begin(), strengths.begin() + strengths.size() / 2,
+                     strengths.end());
+    float silence = 0.2f * strengths[strengths.size() / 2];
+    size_t first_beat = 0;
+    while (first_beat + 1 < beat_frames.size() &&
+           envelope[beat_frames[first_beat]] < silence) {
+        first_beat++;
+    }
+    beat_frames.erase(beat_frames.begin(), beat_frames.begin() + first_beat);
+
+    for (long beat_frame : beat_frames) {
+        estimate.beats.push_back(beat_frame / frame_rate);
+    }
+    if (estimate.beats.size() < 2) return estimate;
+
+    estimate.offset = -estimate.beats.front();
+
+    // Split where the median beat interval leaves the current segment's
+    // tempo for a few beats in a row
+    const std::vector<double> &beats = estimate.beats;
+    size_t interval_count = beats.size() - 1;
+    std::vector<double> beat_bpm(interval_count);
+    for (size_t i = 0; i < interval_count; i++) {
+        size_t lo = i >= 4 ? i - 4 : 0;
+        size_t hi = std::min(i + 4, interval_count);
+        std::vector<double> intervals;
+        for (size_t j = lo; j < hi; j++) {
+            intervals.push_back(beats[j + 1] - beats[j]);
+        }
+        std::nth_element(intervals.begin(),
+                         intervals.begin() + intervals.size() / 2,
+                         intervals.end());
+        beat_bpm[i] = 60.0 / intervals[intervals.size() / 2];
+    }
+
+    std::vector<size_t> starts{0};
+    constexpr size_t PERSISTENCE = 4;
+    for (size_t i = 1; i + PERSISTENCE <= interval_count; i++) {
+        // Judge against the tempo a little into the segment, where the
+        // median no longer mixes in the previous one
+        double current = beat_bpm[std::min(starts.back() + PERSISTENCE,
+                                           interval_count - 1)];
+        bool is_change = true;
+        for (size_t j = i; j < i + PERSISTENCE; j++) {
+            if (std::abs(beat_bpm[j] - current) / current <=
+                options.change_tolerance) {
+                is_change = false;
+                break;
+            }
+        }
+        if (is_change && i - starts.back() >= PERSISTENCE) {
+            // The median lags behind; move back to the first interval that
+            // is closer to the new tempo than to the old one
+            double old_interval = 60.0 / current;
+            double new_interval = 60.0 / beat_bpm[i + PERSISTENCE - 1];
+            size_t start = i;
+            while (start > starts.back() + 1) {
+                double interval = beats[start] - beats[start - 1];
+                if (std::abs(interval - new_interval) >=
+                    std::abs(interval - old_interval)) {
+                    break;
+                }
+                start--;
+            }
+            starts.push_back(start);
+            i = start + PERSISTENCE - 1;
+        }
+    }
+
+    for (size_t s = 0; s < starts.size(); s++) {
+        size_t begin = starts[s];
+        size_t end = s + 1 < starts.size() ? starts[s + 1] : interval_count;
+        double bpm = round_bpm(60.0 * (end - begin) / (beats[end] - beats[begin]));
+        if (!estimate.segments.empty() && estimate.segments.back().bpm == bpm) {
+            continue;
+        }
+        estimate.segments.push_back(
+            TempoSegment{(long)begin * 48, beats[begin], bpm});
+    }
+
+    return estimate;
+}
+
+std::vector<Note> tempo_to_notes(const TempoEstimate &estimate) {
+    std::vector<Note> notes;
+    for (const TempoSegment &segment : estimate.segments) {
+        Note note(segment.tick, LANE_BPM, DIR_NONE, SIDE_NONE, false);
+        note.value = (float)segment.bpm;
+        notes.push_back(note);
+    }
+    return notes;
+}
@@ -0,0 +1,60 @@
+#include "../include/tempo_map.hpp"
+
+#include <algorithm>
+
+constexpr double TICKS_PER_BEAT = 48.0;
+
+TempoMap::TempoMap(double _default_bpm) : default_bpm(_default_bpm) {
+    this->segments.push_back(Segment{0.0, _default_bpm, 0.0});
+}
+
+void TempoMap::build(Notechart &chart) {
+    this->segments.clear();
+    this->segments.push_back(Segment{0.0, this->default_bpm, 0.0});
+
+    for (std::shared_ptr<Note> &note : chart.notes) {
+        if (note->lane != LANE_BPM || note->value <= 0.0) continue;
+
+        Segment &last = this->segments.back();
+        if (note->tick <= last.tick) {
+            last.bpm = note->value;
+            continue;
+        }
+
+        double seconds = last.seconds +
+                         (note->tick - last.tick) * 60.0 /
+                             (last.bpm * TICKS_PER_BEAT);
+        this->segments.push_back(Segment{(double)note->tick, note->value,
+                                         seconds});
+    }
+}
+
+double TempoMap::seconds_at(double tick) const {
+    auto it = std::upper_bound(
+        this->segments.begin(), this->segments.end(), tick,
+        [](double tick, const Segment &segment) { return tick < segment.tick; });
+    const Segment &segment =
+        it == this->segments.begin() ? this->segments.front() : *(it - 1);
+    return segment.seconds +
+           (tick - segment.tick) * 60.0 / (segment.bpm * TICKS_PER_BEAT);
+}
+
+double TempoMap::tick_at(double seconds) const {
+    auto it = std::upper_bound(this->segments.begin(), this->segments.end(),
+                               seconds,
+                               [](double seconds, const Segment &segment) {
+                                   return seconds < segment.seconds;
+                               });
+    const Segment &segment =
+        it == this->segments.begin() ? this->segments.front() : *(it - 1);
+    return segment.tick +
+           (seconds - segment.seconds) * segment.bpm * TICKS_PER_BEAT / 60.0;
+}
+
+double TempoMap::bpm_at(double tick) const {
+    auto it = std::upper_bound(
+        this->segments.begin(), this->segments.end(), tick,
+        [](double tick, const Segment &segment) { return tick < segment.tick; });
+    return it == this->segments.begin() ? this->segments.front().bpm
+                                        : (it - 1)->bpm;
+}
@@ -0,0 +1,166 @@
+#include "../include/thread_pool.hpp"
+
+#include <algorithm>
+#include <latch>
+
+// Pool and worker index of the current thread when it is a pool worker
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        this->workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        this->threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->state_mutex);
+        this->is_stopping = true;
+    }
+    this->wake_condition.notify_all();
+
+    for (std::thread &thread : this->threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t index = (current_pool == this)
+                       ? current_worker
+                       : this->next_worker.fetch_add(1) % this->workers.size();
+
+    {
+        std::lock_guard<std::mutex> lock(this->workers[index]->mutex);
+        this->workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->state_mutex);
+        this->queued++;
+        this->pending++;
+    }
+    this->wake_condition.notify_one();
+}
+
+void ThreadPool::wait() {
+    // A worker waiting on its own pool helps instead of blocking
+    if (current_pool == this) {
+        std::function<void()> task;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(this->state_mutex);
+                if (this->pending == 0) return;
+            }
+            if (this->pop_task(current_worker, task)) {
+                this->run_task(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(this->state_mutex);
+    this->idle_condition.wait(lock, [this] { return this->pending == 0; });
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain,
+                              const std::function<void(size_t)> &body) {
+    grain = std::max<size_t>(grain, 1);
+    if (begin >= end) return;
+
+    // Only this call's chunks are waited for, so work other threads keep
+    // submitting meanwhile does not hold it up
+    std::latch batch((std::ptrdiff_t)((end - begin + grain - 1) / grain));
+    for (size_t chunk = begin; chunk < end; chunk += grain) {
+        size_t chunk_end = std::min(chunk + grain, end);
+        this->submit([&body, &batch, chunk, chunk_end] {
+            for (size_t i = chunk; i < chunk_end; i++) {
+                body(i);
+            }
+            batch.count_down();
+        });
+    }
+
+    // From a worker of this pool, run queued tasks until the chunks are
+    // done rather than blocking a thread they may be waiting for
+    if (current_pool == this) {
+        std::function<void()> task;
+        while (!batch.try_wait()) {
+            if (this->pop_task(current_worker, task)) {
+                this->run_task(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+    batch.wait();
+}
+
+bool ThreadPool::pop_task(size_t index, std::function<void()> &task) {
+    // Own deque first, newest task first for cache locality
+    {
+        Worker &own = *this->workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            std::lock_guard<std::mutex> state_lock(this->state_mutex);
+            this->queued--;
+            return true;
+        }
+    }
+
+    // Then steal the oldest task from a sibling
+    for (size_t offset = 1; offset < this->workers.size(); offset++) {
+        Worker &victim = *this->workers[(index + offset) % this->workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            std::lock_guard<std::mutex> state_lock(this->state_mutex);
+            this->queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run_task(std::function<void()> &task) {
+    task();
+    task = nullptr;
+
+    std::lock_guard<std::mutex> lock(this->state_mutex);
+    if (--this->pending == 0) {
+        this->idle_condition.notify_all();
+    }
+}
+
+void ThreadPool::run(size_t index) {
+    current_pool = this;
+    current_worker = index;
+
+    std::function<void()> task;
+    while (true) {
+        if (this->pop_task(index, task)) {
+            this->run_task(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->state_mutex);
+        this->wake_condition.wait(lock, [this] {
+            return this->is_stopping || this->queued > 0;
+        });
+        if (this->is_stopping && this->queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,211 @@
+#include "../include/time_stretch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Correlation is computed on a decimated mono mix; candidates are scanned
+// coarsely first and then refined around the best match
+constexpr size_t CORRELATION_STRIDE = 4;
+constexpr long long COARSE_STEP = 4;
+
+void TimeStretch::configure(uint32_t _channels, uint32_t _sample_rate) {
+    this->channels = _channels;
+    this->sample_rate = _sample_rate;
+
+    // 40 ms frames with 50% overlap and a 10 ms search tolerance
+    this->frame_size = (size_t)(_sample_rate * 0.040) & ~(size_t)1;
+    this->hop_size = this->frame_size / 2;
+    this->tolerance = _sample_rate / 100;
+
+    // Periodic Hann: the rising and falling halves sum to exactly one
+    this->window.resize(this->frame_size);
+    for (size_t i = 0; i < this->frame_size; i++) {
+        this->window[i] =
+            (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / this->frame_size));
+    }
+
+    // Enough for the search range of the fastest rate plus a read chunk
+    this->input_capacity = 2 * this->frame_size + 2 * this->tolerance +
+                           (size_t)(MAX_RATE * this->hop_size) + 4096;
+    this->input.assign(this->input_capacity * _channels, 0.0f);
+    this->hop.assign(this->hop_size * _channels, 0.0f);
+
+    this->reset(0);
+}
+
+void TimeStretch::set_rate(double _rate) {
+    this->rate = std::clamp(_rate, MIN_RATE, MAX_RATE);
+}
+
+void TimeStretch::reset(long long source_frame) {
+    this->input_frames = 0;
+    this->input_origin = source_frame;
+    this->stream_start = source_frame;
+    this->source_end = -1;
+    this->nominal_position = (double)source_frame;
+    // A virtual previous frame whose second half starts at the seek point,
+    // so the first hop reproduces the source exactly
+    this->previous_position = source_frame - (long long)this->hop_size;
+    this->hop_offset = 0;
+    this->hop_frames = 0;
+    this->hop_source_position = (double)source_frame;
+    this->hop_rate = this->rate;
+}
+
+double TimeStretch::source_position() const {
+    return this->hop_source_position + this->hop_offset * this->hop_rate;
+}
+
+const float *TimeStretch::frame_at(long long source_frame) const {
+    return &this->input[(source_frame - this->input_origin) * this->channels];
+}
+
+bool TimeStretch::fill_input(long long begin, long long end, Reader reader,
+                             void *user_data) {
+    // Drop what is before `begin`
+    if (begin > this->input_origin) {
+        size_t drop = std::min((size_t)(begin - this->input_origin),
+                               this->input_frames);
+        std::memmove(this->input.data(),
+                     this->input.data() + drop * this->channels,
+                     (this->input_frames - drop) * this->channels *
+                         sizeof(float));
+        this->input_frames -= drop;
+        this->input_origin += drop;
+    }
+
+    long long needed = end - this->input_origin;
+    if (needed > (long long)this->input_capacity) return false;
+
+    while ((long long)this->input_frames < needed) {
+        float *destination =
+            this->input.data() + this->input_frames * this->channels;
+
+        if (this->source_end >= 0) {
+            // Past the end of the source: pad with silence
+            std::fill(destination,
+                      this->input.data() + needed * this->channels, 0.0f);
+            this->input_frames = needed;
+            break;
+        }
+
+        size_t read = reader(user_data, destination,
+                             this->input_capacity - this->input_frames);
+        if (read == 0) {
+            this->source_end = this->input_origin + this->input_frames;
+        }
+        this->input_frames += read;
+    }
+
+    return true;
+}
+
+long long TimeStretch::best_offset(long long target, long long nominal) {
+    long long tolerance = (long long)this->tolerance;
+    long long lowest = std::max(nominal - tolerance, this->input_origin);
+    long long highest = nominal + tolerance;
+
+    const float *reference = this->frame_at(target);
+
+    // Normalized cross-correlation over the overlapping half frame
+    auto score = [&](long long candidate) {
+        const float *frames = this->frame_at(candidate);
+        float correlation = 0.0f, energy = 1e-9f;
+        for (size_t i = 0; i < this->hop_size; i += CORRELATION_STRIDE) {
+            float a = 0.0f, b = 0.0f;
+            for (uint32_t c = 0; c < this->channels; c++) {
+                a += reference[i * this->channels + c];
+                b += frames[i * this->channels + c];
+            }
+            correlation += a * b;
+            energy += b * b;
+        }
+        return correlation / std::sqrt(energy);
+    };
+
+    long long best = std::clamp(nominal, lowest, highest);
+    float best_score = score(best);
+    for (long long candidate = lowest; candidate <= highest;
+         candidate += COARSE_STEP) {
+        float candidate_score = score(candidate);
+        if (candidate_score > best_score) {
+            best = candidate;
+            best_score = candidate_score;
+        }
+    }
+
+    long long coarse = best;
+    for (long long candidate = std::max(coarse - COARSE_STEP + 1, lowest);
+         candidate < std::min(coarse + COARSE_STEP, highest + 1); candidate++) {
+        float candidate_score = score(candidate);
+        if (candidate_score > best_score) {
+            best = candidate;
+            best_score = candidate_score;
+        }
+    }
+
+    return best;
+}
+
+bool TimeStretch::produce_hop(Reader reader, void *user_data) {
+    // The previous frame has been fully played out
+    long long continuation = this->previous_position + this->hop_size;
+    if (this->source_end >= 0 && continuation >= this->source_end) {
+        return false;
+    }
+
+    long long nominal = std::max((long long)std::llround(this->nominal_position),
+                                 this->stream_start);
+    long long tolerance = (long long)this->tolerance;
+    long long begin = std::min(continuation, std::max(nominal - tolerance,
+                                                      this->stream_start));
+    long long end = std::max(continuation + (long long)this->hop_size,
+                             nominal + tolerance + (long long)this->frame_size);
+    if (!this->fill_input(begin, end, reader, user_data)) {
+        return false;
+    }
+
+    long long position = this->best_offset(continuation, nominal);
+
+    // Falling half of the previous frame plus rising half of this one
+    const float *tail = this->frame_at(continuation);
+    const float *head = this->frame_at(position);
+    for (size_t i = 0; i < this->hop_size; i++) {
+        float fall = this->window[i + this->hop_size];
+        float rise = this->window[i];
+        for (uint32_t c = 0; c < this->channels; c++) {
+            size_t k = i * this->channels + c;
+            this->hop[k] = tail[k] * fall + head[k] * rise;
+        }
+    }
+
+    this->hop_source_position = this->nominal_position;
+    this->hop_rate = this->rate;
+    this->hop_offset = 0;
+    this->hop_frames = this->hop_size;
+
+    this->previous_position = position;
+    this->nominal_position += this->hop_size * this->rate;
+    return true;
+}
+
+size_t TimeStretch::process(float *output, size_t frame_count, Reader reader,
+                            void *user_data) {
+    size_t written = 0;
+    while (written < frame_count) {
+        if (this->hop_offset == this->hop_frames &&
+            !this->produce_hop(reader, user_data)) {
+            break;
+        }
+
+        size_t count =
+            std::min(frame_count - written, this->hop_frames - this->hop_offset);
+        std::memcpy(output + written * this->channels,
+                    this->hop.data() + this->hop_offset * this->channels,
+                    count * this->channels * sizeof(float));
+        this->hop_offset += count;
+        written += count;
+    }
+    return written;
+}
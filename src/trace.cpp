@@ -0,0 +1,148 @@
+#include "../include/trace.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char *name;
+    long long begin;
+    long long duration;
+};
+
+// Single-producer buffer owned by one thread. The owner publishes each event
+// by bumping `size` with release ordering, so dump() can read the prefix
+// below `size` from any thread without locking.
+struct TraceBuffer {
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    int tid{0};
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[CAPACITY]};
+    std::atomic<size_t> size{0};
+    std::atomic<unsigned> generation{0};
+    // Whether a live thread owns the buffer; guarded by registry_mutex
+    bool is_owned{true};
+};
+
+std::atomic<bool> Tracer::enabled{false};
+
+static std::atomic<unsigned> current_generation{0};
+static const std::chrono::steady_clock::time_point trace_epoch =
+    std::chrono::steady_clock::now();
+
+// Buffers outlive their thread so that a dump still contains events from
+// finished workers. A new thread takes over the buffer of a finished one
+// and continues its track, so short-lived threads (a pool per analysis job,
+// std::async) do not grow the registry: it holds one buffer per thread ever
+// traced at the same time.
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> registry;
+
+// Hands the buffer back to the registry when its thread exits
+struct BufferLease {
+    std::shared_ptr<TraceBuffer> buffer;
+
+    ~BufferLease() {
+        if (this->buffer) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            this->buffer->is_owned = false;
+        }
+    }
+};
+
+static TraceBuffer &local_buffer() {
+    thread_local BufferLease lease;
+
+    if (!lease.buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (std::shared_ptr<TraceBuffer> &buffer : registry) {
+            if (!buffer->is_owned) {
+                buffer->is_owned = true;
+                lease.buffer = buffer;
+                return *lease.buffer;
+            }
+        }
+
+        lease.buffer = std::make_shared<TraceBuffer>();
+        lease.buffer->tid = (int)registry.size() + 1;
+        registry.push_back(lease.buffer);
+    }
+
+    return *lease.buffer;
+}
+
+void Tracer::start() {
+    current_generation.fetch_add(1, std::memory_order_acq_rel);
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::stop() { enabled.store(false, std::memory_order_relaxed); }
+
+long long Tracer::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - trace_epoch)
+        .count();
+}
+
+void Tracer::record(const char *name, long long begin, long long end) {
+    TraceBuffer &buffer = local_buffer();
+
+    // Lazily discard events left over from a previous session
+    unsigned generation = current_generation.load(std::memory_order_acquire);
+    if (buffer.generation.load(std::memory_order_relaxed) != generation) {
+        buffer.size.store(0, std::memory_order_relaxed);
+        buffer.generation.store(generation, std::memory_order_release);
+    }
+
+    size_t size = buffer.size.load(std::memory_order_relaxed);
+    if (size >= TraceBuffer::CAPACITY) {
+        return;
+    }
+
+    buffer.events[size] = TraceEvent{name, begin, end - begin};
+    buffer.size.store(size + 1, std::memory_order_release);
+}
+
+bool Tracer::dump(const std::string &file_path) {
+    std::FILE *trace_file = std::fopen(file_path.c_str(), "w");
+    if (trace_file == NULL) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffers = registry;
+    }
+
+    unsigned generation = current_generation.load(std::memory_order_acquire);
+
+    std::string content;
+    content += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool is_first = true;
+    for (std::shared_ptr<TraceBuffer> &buffer : buffers) {
+        if (buffer->generation.load(std::memory_order_acquire) != generation) {
+            continue;
+        }
+
+        size_t size = buffer->size.load(std::memory_order_acquire);
+        for (size_t i = 0; i < size; i++) {
+            const TraceEvent &event = buffer->events[i];
+            content += fmt::format(
+                "{}{{\"name\":\"{}\",\"cat\":\"thapsteak\",\"ph\":\"X\","
+                "\"ts\":{},\"dur\":{},\"pid\":1,\"tid\":{}}}",
+                is_first ? "" : ",", event.name, event.begin, event.duration,
+                buffer->tid);
+            is_first = false;
+        }
+    }
+    content += "]}";
+
+    bool is_written = std::fwrite(content.data(), sizeof(char), content.size(),
+                                  trace_file) == content.size();
+    return std::fclose(trace_file) == 0 && is_written;
+}
@@ -0,0 +1,148 @@
+// ChartDigest: roots that depend only on content, and diffs that find
+// exactly the changed measures, also between trees of different heights.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../include/chart_digest.hpp"
+#include "../include/notechart.hpp"
+#include "check.hpp"
+
+// Measures whose hashes differ, by comparing every one of them
+static std::vector<long> brute_force_diff(const ChartDigest &a,
+                                          const ChartDigest &b, long end) {
+    std::vector<long> measures;
+    for (long measure = 0; measure < end; measure++) {
+        if (a.measure_hash(measure) != b.measure_hash(measure)) {
+            measures.push_back(measure);
+        }
+    }
+    return measures;
+}
+
+static void test_heights() {
+    // Six measures fit under one node; measure 300 needs three levels above
+    // the leaves and measure 5000 four
+    ChartDigest low, high;
+    for (long measure = 0; measure < 6; measure++) {
+        low.add(measure, 100 + measure);
+        high.add(measure, 100 + measure);
+    }
+    CHECK_EQ(low.root(), high.root());
+    CHECK(low.diff(high).empty());
+
+    high.add(300, 7);
+    CHECK(low.root() != high.root());
+    CHECK(low.diff(high) == std::vector<long>{300});
+    CHECK(high.diff(low) == std::vector<long>{300});
+
+    // Removing it again leaves a taller tree with the same digest
+    high.remove(300, 7);
+    CHECK_EQ(low.root(), high.root());
+    CHECK(low.diff(high).empty());
+    CHECK(high.diff(low).empty());
+
+    // Changes on both ends of the taller tree
+    high.remove(2, 102);
+    high.add(2, 9);
+    high.add(5000, 11);
+    CHECK(low.diff(high) == (std::vector<long>{2, 5000}));
+    CHECK(high.diff(low) == (std::vector<long>{2, 5000}));
+
+    // Against an empty digest every measure with notes differs
+    ChartDigest empty;
+    CHECK_EQ(empty.root(), (uint64_t)0);
+    CHECK(empty.diff(empty).empty());
+    CHECK(empty.diff(low) == (std::vector<long>{0, 1, 2, 3, 4, 5}));
+    CHECK(high.diff(empty) == (std::vector<long>{0, 1, 2, 3, 4, 5, 5000}));
+
+    // A single measure past the first is its own subtree
+    ChartDigest single;
+    single.add(17, 1);
+    CHECK(single.diff(empty) == std::vector<long>{17});
+    CHECK(empty.diff(single) == std::vector<long>{17});
+}
+
+static void test_random() {
+    std::mt19937 random(9);
+
+    for (int round = 0; round < 200; round++) {
+        // Different sizes make different heights: up to 16, 256 and 4096
+        // measures
+        long spans[] = {16, 256, 4096};
+        long span_a = spans[random() % 3], span_b = spans[random() % 3];
+
+        ChartDigest a, b;
+        std::vector<std::pair<long, uint64_t>> shared;
+        for (int i = 0; i < 40; i++) {
+            long measure = (long)(random() % std::min(span_a, span_b));
+            uint64_t hash = random();
+            shared.emplace_back(measure, hash);
+            a.add(measure, hash);
+        }
+        // Same notes in another order
+        std::shuffle(shared.begin(), shared.end(), random);
+        for (const auto &[measure, hash] : shared) {
+            b.add(measure, hash);
+        }
+        CHECK_EQ(a.root(), b.root());
+        CHECK(a.diff(b).empty());
+
+        // Then a few edits on either side, read back between edits so the
+        // incremental refresh is exercised too
+        for (int edit = 0, edits = (int)(random() % 6); edit < edits; edit++) {
+            ChartDigest &side = random() % 2 ? a : b;
+            long span = &side == &a ? span_a : span_b;
+            if (random() % 3 == 0 && !shared.empty()) {
+                auto [measure, hash] = shared[random() % shared.size()];
+                side.remove(measure, hash);
+            } else {
+                side.add((long)(random() % span), random());
+            }
+            side.root();
+        }
+
+        std::vector<long> expected =
+            brute_force_diff(a, b, std::max(span_a, span_b));
+        CHECK(a.diff(b) == expected);
+        CHECK(b.diff(a) == expected);
+        CHECK_EQ(a.root() == b.root(), expected.empty());
+    }
+}
+
+static void test_chart() {
+    // Same notes, different histories and IDs
+    Notechart a, b;
+    a.add_note(Note(10, LANE_H1, DIR_NONE, SIDE_NONE, false));
+    a.add_note(Note(400, LANE_N2, DIR_UP, SIDE_LEFT, true));
+    a.add_note(Note(192 * 40, LANE_E1, DIR_NONE, SIDE_NONE, false));
+
+    b.add_note(Note(192 * 40, LANE_E1, DIR_NONE, SIDE_NONE, false));
+    b.add_note(Note(999, LANE_H3, DIR_NONE, SIDE_NONE, false));
+    b.add_note(Note(10, LANE_H1, DIR_NONE, SIDE_NONE, false));
+    b.remove_notes({b.notes[1]->id});
+    b.add_note(Note(400, LANE_N2, DIR_UP, SIDE_LEFT, true));
+
+    CHECK_EQ(a.digest(), b.digest());
+    CHECK(a.content_digest().diff(b.content_digest()).empty());
+
+    b.set_side({b.notes[1]->id}, SIDE_RIGHT);
+    CHECK(a.digest() != b.digest());
+    CHECK(a.content_digest().diff(b.content_digest()) == std::vector<long>{2});
+
+    // A chart that grew taller and shrank back
+    b.set_side({b.notes[1]->id}, SIDE_LEFT);
+    b.add_note(Note(192 * 3000, LANE_H1, DIR_NONE, SIDE_NONE, false));
+    CHECK(a.content_digest().diff(b.content_digest()) ==
+          std::vector<long>{3000});
+    b.remove_notes({b.notes.back()->id});
+    CHECK_EQ(a.digest(), b.digest());
+}
+
+int main() {
+    test_heights();
+    test_random();
+    test_chart();
+    return test_result();
+}
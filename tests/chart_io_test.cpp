@@ -0,0 +1,84 @@
+// parse_chart() and import_chart(): valid documents round-trip, and events
+// the chart cannot hold are refused before anything is added.
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include "../include/chart_io.hpp"
+#include "check.hpp"
+
+static bool throws_invalid_argument(const std::string &content) {
+    Notechart chart;
+    try {
+        parse_chart(content, chart);
+    } catch (const std::invalid_argument &) {
+        return chart.notes.empty();
+    }
+    return false;
+}
+
+static void test_parse() {
+    Notechart chart;
+    size_t count = parse_chart(
+        R"({"events":[{"channel":"BPM","row":0,"value":150},)"
+        R"({"channel":"H1","row":48,"angle":90,"side":"left"},)"
+        R"({"channel":"N2","row":96,"longNote":true,"side":"right"},)"
+        R"({"channel":"H1","row":48}]})",
+        chart);
+    CHECK_EQ(count, (size_t)4);
+    // The second H1 note at row 48 is a duplicated cell
+    CHECK_EQ(chart.notes.size(), (size_t)3);
+    CHECK(chart.notes[1]->direction == DIR_UP);
+    CHECK(chart.notes[1]->side == SIDE_LEFT);
+    CHECK(chart.notes[2]->is_longnote);
+    CHECK_EQ(chart.notes[0]->value, 150.0f);
+
+    // Written and read back, the content is the same
+    Notechart copy;
+    parse_chart(chart.to_string(), copy);
+    CHECK_EQ(copy.digest(), chart.digest());
+}
+
+static void test_refused() {
+    CHECK(throws_invalid_argument(
+        R"({"events":[{"channel":"H1","row":0},{"channel":"H2","row":-5}]})"));
+    CHECK(throws_invalid_argument(
+        R"({"events":[{"channel":"H1","row":0,"angle":270}]})"));
+    CHECK(throws_invalid_argument(
+        R"({"events":[{"channel":"H1","row":0,"angle":30}]})"));
+    CHECK(!throws_invalid_argument(
+        R"({"events":[{"channel":"H1","row":0,"angle":-1}]})"));
+}
+
+static void test_import() {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "thapsteak_chart_io_test.json";
+
+    CHECK(write_file(path.string(),
+                     R"({"events":[{"channel":"H1","row":0},)"
+                     R"({"channel":"H1","row":0},{"channel":"H2","row":4}]})"));
+    Notechart chart;
+    size_t dropped = 0;
+    CHECK(import_chart(path.string(), chart, &dropped));
+    CHECK_EQ(dropped, (size_t)1);
+    CHECK_EQ(chart.notes.size(), (size_t)2);
+
+    // A negative row fails the import and leaves the chart as it was
+    CHECK(write_file(path.string(),
+                     R"({"events":[{"channel":"H3","row":8},)"
+                     R"({"channel":"H1","row":-1}]})"));
+    CHECK(!import_chart(path.string(), chart, &dropped));
+    CHECK_EQ(chart.notes.size(), (size_t)2);
+
+    std::filesystem::remove(path);
+    CHECK(!import_chart(path.string(), chart));
+}
+
+int main() {
+    test_parse();
+    test_refused();
+    test_import();
+    return test_result();
+}
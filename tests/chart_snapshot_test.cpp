@@ -0,0 +1,182 @@
+// Notechart::snapshot(): untouched measures are shared with the previous
+// snapshot, touched ones are copied, and older snapshots never change.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/chart_snapshot.hpp"
+#include "../include/notechart.hpp"
+#include "check.hpp"
+
+static Note tap(long tick, Lane lane) {
+    return Note(tick, lane, DIR_NONE, SIDE_NONE, false);
+}
+
+// One note in each of the first `measures` measures
+static void fill(Notechart &chart, long measures) {
+    std::vector<Note> notes;
+    for (long measure = 0; measure < measures; measure++) {
+        notes.push_back(tap(measure * 192 + 48, LANE_H1));
+    }
+    chart.add_notes(notes);
+}
+
+static void test_sharing() {
+    Notechart chart;
+    fill(chart, 10);
+
+    std::shared_ptr<const ChartSnapshot> first = chart.snapshot();
+    std::string first_text = first->to_string();
+    CHECK_EQ(first->size(), (size_t)10);
+    CHECK_EQ(first->measures().size(), (size_t)10);
+    CHECK_EQ(first_text, chart.to_string());
+    CHECK_EQ(first->version(), chart.version());
+    CHECK_EQ(first->digest(), chart.digest());
+
+    // Without edits, the same snapshot comes back
+    CHECK(chart.snapshot() == first);
+
+    // One new note copies only its measure
+    chart.add_note(tap(3 * 192 + 96, LANE_H2));
+    std::shared_ptr<const ChartSnapshot> second = chart.snapshot();
+    CHECK(second != first);
+    CHECK_EQ(second->size(), (size_t)11);
+    CHECK_EQ(second->shared_measures(*first), (size_t)9);
+    CHECK(second->measure(3) != first->measure(3));
+    CHECK(second->measure(4) == first->measure(4));
+    CHECK_EQ(second->measure(3)->notes.size(), (size_t)2);
+    CHECK_EQ(second->measure(3)->lane_counts[LANE_H2], (uint32_t)1);
+    CHECK_EQ(second->measure(3)->hash,
+             chart.content_digest().measure_hash(3));
+    CHECK_EQ(first->to_string(), first_text);
+
+    // Moving a note touches where it left and where it landed
+    NoteHandle moved = chart.notes[1]->id;
+    CHECK(chart.shift_notes({moved}, 5 * 192 + 24));
+    std::shared_ptr<const ChartSnapshot> third = chart.snapshot();
+    CHECK_EQ(third->shared_measures(*second), (size_t)8);
+    CHECK(third->measure(1) != second->measure(1));
+    CHECK(third->measure(6) != second->measure(6));
+    CHECK(third->measure(2) == second->measure(2));
+
+    // A measure that loses its last note leaves the list
+    CHECK(third->measure(1) == nullptr);
+    CHECK_EQ(third->measures().size(), (size_t)9);
+    CHECK_EQ(third->to_string(), chart.to_string());
+
+    // Field edits count as touching the measure too
+    chart.set_side({chart.notes.back()->id}, SIDE_RIGHT);
+    std::shared_ptr<const ChartSnapshot> fourth = chart.snapshot();
+    CHECK_EQ(fourth->shared_measures(*third), (size_t)8);
+    CHECK(fourth->measure(9) != third->measure(9));
+    CHECK(fourth->measure(9)->notes[0].side == SIDE_RIGHT);
+    CHECK(third->measure(9)->notes[0].side == SIDE_NONE);
+
+    // normalize() renumbers every note, so it starts over with fresh copies
+    // of the same content
+    chart.normalize();
+    std::shared_ptr<const ChartSnapshot> fifth = chart.snapshot();
+    CHECK_EQ(fifth->shared_measures(*fourth), (size_t)0);
+    CHECK_EQ(fifth->size(), fourth->size());
+    CHECK_EQ(fifth->digest(), fourth->digest());
+
+    // Nothing published earlier has changed under its readers
+    CHECK_EQ(first->to_string(), first_text);
+    CHECK_EQ(first->size(), (size_t)10);
+}
+
+// Random single-note edits: each snapshot matches the chart and shares
+// every measure the edit did not reach
+static void test_random_edits() {
+    std::mt19937 random(5);
+    Notechart chart;
+    fill(chart, 40);
+
+    std::shared_ptr<const ChartSnapshot> previous = chart.snapshot();
+    std::vector<std::string> texts{previous->to_string()};
+    std::vector<std::shared_ptr<const ChartSnapshot>> history{previous};
+
+    for (int step = 0; step < 300; step++) {
+        long tick = (long)(random() % (40 * 192));
+        Lane lane = (Lane)(LANE_H1 + random() % 5);
+        size_t reached = 1;
+
+        switch (random() % 3) {
+            case 0:
+                chart.add_note(tap(tick, lane));
+                break;
+            case 1:
+                if (!chart.notes.empty()) {
+                    chart.remove_notes(
+                        {chart.notes[random() % chart.notes.size()]->id});
+                }
+                break;
+            case 2:
+                if (!chart.notes.empty()) {
+                    // Source and destination measures
+                    reached = 2;
+                    chart.shift_notes(
+                        {chart.notes[random() % chart.notes.size()]->id},
+                        (long)(random() % 400) - 200);
+                }
+                break;
+        }
+
+        std::shared_ptr<const ChartSnapshot> current = chart.snapshot();
+        CHECK_EQ(current->to_string(), chart.to_string());
+        CHECK_EQ(current->digest(), chart.digest());
+        CHECK(current->shared_measures(*previous) + reached >=
+              previous->measures().size());
+        for (const std::shared_ptr<const MeasureNotes> &measure :
+             current->measures()) {
+            CHECK_EQ(measure->hash,
+                     chart.content_digest().measure_hash(measure->measure));
+        }
+
+        previous = current;
+        history.push_back(current);
+        texts.push_back(current->to_string());
+    }
+
+    for (size_t i = 0; i < history.size(); i++) {
+        CHECK_EQ(history[i]->to_string(), texts[i]);
+    }
+}
+
+// Ticks below 0 only come from damaged files, but must not hang or
+// duplicate notes: they belong to measure 0, as in the digest
+static void test_negative_ticks() {
+    Notechart chart;
+    chart.add_notes({tap(-5, LANE_H1), tap(300, LANE_H2)});
+    std::shared_ptr<const ChartSnapshot> first = chart.snapshot();
+    CHECK_EQ(first->size(), (size_t)2);
+    CHECK_EQ(first->measures().size(), (size_t)2);
+    CHECK_EQ(first->measure(0)->notes.size(), (size_t)1);
+    CHECK_EQ(first->measure(0)->hash, chart.content_digest().measure_hash(0));
+    CHECK_EQ(first->to_string(), chart.to_string());
+
+    Notechart mixed;
+    mixed.add_notes({tap(-5, LANE_H1), tap(10, LANE_H1), tap(300, LANE_H2)});
+    std::shared_ptr<const ChartSnapshot> second = mixed.snapshot();
+    CHECK_EQ(second->size(), (size_t)3);
+    CHECK_EQ(second->measure(0)->notes.size(), (size_t)2);
+    CHECK_EQ(second->to_string(), mixed.to_string());
+
+    // Incremental copies of measure 0 keep the notes before tick 0
+    mixed.add_note(tap(-20, LANE_H3));
+    std::shared_ptr<const ChartSnapshot> third = mixed.snapshot();
+    CHECK_EQ(third->size(), (size_t)4);
+    CHECK_EQ(third->shared_measures(*second), (size_t)1);
+    CHECK_EQ(third->measure(0)->notes.size(), (size_t)3);
+    CHECK_EQ(third->measure(0)->hash, mixed.content_digest().measure_hash(0));
+    CHECK_EQ(third->to_string(), mixed.to_string());
+    CHECK(third->measure(-1) == nullptr);
+}
+
+int main() {
+    test_sharing();
+    test_random_edits();
+    test_negative_ticks();
+    return test_result();
+}
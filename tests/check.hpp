@@ -0,0 +1,40 @@
+#pragma once
+
+#include <fmt/format.h>
+
+// Minimal assertions for the test executables: a failed check is reported
+// and counted, and main() returns test_result() so ctest sees the failure.
+
+inline int &test_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                 \
+    do {                                                                 \
+        if (!(condition)) {                                              \
+            fmt::print(stderr, "{}:{}: CHECK({}) failed\n", __FILE__,    \
+                       __LINE__, #condition);                            \
+            test_failures()++;                                           \
+        }                                                                \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                       \
+    do {                                                                 \
+        auto _actual = (actual);                                         \
+        auto _expected = (expected);                                     \
+        if (!(_actual == _expected)) {                                   \
+            fmt::print(stderr, "{}:{}: {} == {} failed: {} != {}\n",     \
+                       __FILE__, __LINE__, #actual, #expected, _actual,  \
+                       _expected);                                       \
+            test_failures()++;                                           \
+        }                                                                \
+    } while (0)
+
+inline int test_result() {
+    if (test_failures() > 0) {
+        fmt::print(stderr, "{} check(s) failed\n", test_failures());
+        return 1;
+    }
+    return 0;
+}
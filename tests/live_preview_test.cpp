@@ -0,0 +1,165 @@
+// Live preview codec: deltas from encode_chart_delta(), applied by the
+// reference client, must leave it holding exactly the latest snapshot.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../include/live_preview.hpp"
+#include "../include/notechart.hpp"
+#include "check.hpp"
+
+// Frame the delta from `from` to `to` the way the server does, minus the
+// length prefix, and hand it to the client
+static bool deliver(LivePreviewClient &client, uint32_t sequence,
+                    const ChartSnapshot *from, const ChartSnapshot &to,
+                    size_t *size = nullptr) {
+    std::vector<uint8_t> packet(sizeof(uint32_t) + sizeof(uint16_t));
+    std::memcpy(packet.data(), &sequence, sizeof(sequence));
+    uint16_t count =
+        (uint16_t)std::min<size_t>(encode_chart_delta(from, to, packet),
+                                   UINT16_MAX);
+    std::memcpy(packet.data() + sizeof(uint32_t), &count, sizeof(count));
+    if (size) *size = packet.size();
+    return client.apply(packet.data(), packet.size());
+}
+
+static bool matches(const LivePreviewClient &client,
+                    const ChartSnapshot &snapshot) {
+    if (client.notes.size() != snapshot.size()) return false;
+    bool is_same = true;
+    snapshot.for_each([&](const Note &note) {
+        auto it = client.notes.find(note.id);
+        if (it == client.notes.end()) {
+            is_same = false;
+            return;
+        }
+        const Note &copy = it->second;
+        is_same = is_same && copy.tick == note.tick &&
+                  copy.lane == note.lane && copy.direction == note.direction &&
+                  copy.side == note.side &&
+                  copy.is_longnote == note.is_longnote &&
+                  copy.value == note.value;
+    });
+    return is_same;
+}
+
+static void test_round_trip() {
+    std::mt19937 random(3);
+    const Direction directions[] = {DIR_NONE, DIR_RIGHT, DIR_URIGHT,
+                                    DIR_UP,   DIR_ULEFT, DIR_LEFT};
+
+    Notechart chart;
+    std::vector<Note> notes;
+    for (long i = 0; i < 2000; i++) {
+        notes.push_back(Note(i * 24, (Lane)(LANE_H1 + i % 5),
+                             directions[i % 6], (Side)(i % 3), i % 7 == 0));
+    }
+    chart.add_notes(notes);
+
+    LivePreviewClient client;
+    uint32_t sequence = 0;
+    std::shared_ptr<const ChartSnapshot> sent = chart.snapshot();
+    size_t resync_size = 0;
+    CHECK(deliver(client, sequence++, nullptr, *sent, &resync_size));
+    CHECK(matches(client, *sent));
+    CHECK_EQ(client.inserts, (size_t)2000);
+
+    for (int step = 0; step < 400; step++) {
+        // A few edits per frame
+        for (int edit = 0, edits = 1 + random() % 4; edit < edits; edit++) {
+            NoteHandle id = chart.notes[random() % chart.notes.size()]->id;
+            switch (random() % 7) {
+                case 0:
+                    chart.add_note(Note((long)(random() % 60000),
+                                        (Lane)(LANE_H1 + random() % 5),
+                                        DIR_NONE, SIDE_NONE, false));
+                    break;
+                case 1:
+                    chart.remove_notes({id});
+                    break;
+                case 2:
+                    chart.shift_notes({id}, (long)(random() % 800) - 400);
+                    break;
+                case 3:
+                    chart.mirror_notes({id});
+                    break;
+                case 4:
+                    chart.set_direction({id}, directions[random() % 6]);
+                    break;
+                case 5:
+                    chart.set_side({id}, (Side)(random() % 3));
+                    break;
+                case 6:
+                    chart.swap_sides({id});
+                    break;
+            }
+        }
+
+        std::shared_ptr<const ChartSnapshot> next = chart.snapshot();
+        size_t size = 0;
+        CHECK(deliver(client, sequence++, sent.get(), *next, &size));
+        CHECK(matches(client, *next));
+        // A handful of edits costs far less than resending the chart
+        CHECK(size < resync_size / 10);
+        CHECK_EQ(client.sequence, sequence - 1);
+        sent = next;
+    }
+
+    // Renumbered notes arrive as a delta too
+    chart.normalize();
+    std::shared_ptr<const ChartSnapshot> renumbered = chart.snapshot();
+    CHECK(deliver(client, sequence++, sent.get(), *renumbered));
+    CHECK(matches(client, *renumbered));
+
+    // A resync drops whatever the client held before
+    client.notes.emplace(NoteHandle{123456, 7},
+                         Note(5, LANE_H1, DIR_NONE, SIDE_NONE, false));
+    CHECK(deliver(client, sequence++, nullptr, *renumbered));
+    CHECK(matches(client, *renumbered));
+
+    // Emptying the chart empties the client
+    std::set<NoteHandle> all;
+    for (const std::shared_ptr<Note> &note : chart.notes) {
+        all.insert(note->id);
+    }
+    chart.remove_notes(all);
+    std::shared_ptr<const ChartSnapshot> empty = chart.snapshot();
+    CHECK(deliver(client, sequence++, renumbered.get(), *empty));
+    CHECK(client.notes.empty());
+}
+
+static void test_malformed() {
+    Notechart chart;
+    chart.add_note(Note(0, LANE_H1, DIR_UP, SIDE_LEFT, false));
+    std::shared_ptr<const ChartSnapshot> snapshot = chart.snapshot();
+
+    std::vector<uint8_t> packet(sizeof(uint32_t) + sizeof(uint16_t));
+    encode_chart_delta(nullptr, *snapshot, packet);
+
+    LivePreviewClient client;
+    CHECK(client.apply(packet.data(), packet.size()));
+    // Cut anywhere inside the header or a message; only the cuts right
+    // after the header and after RESET leave whole messages
+    size_t header = sizeof(uint32_t) + sizeof(uint16_t);
+    for (size_t size = 0; size < packet.size(); size++) {
+        if (size == header || size == header + 1) continue;
+        LivePreviewClient truncated;
+        CHECK(!truncated.apply(packet.data(), size));
+    }
+
+    // Unknown message type
+    std::vector<uint8_t> unknown = packet;
+    unknown.push_back(0xee);
+    LivePreviewClient garbage;
+    CHECK(!garbage.apply(unknown.data(), unknown.size()));
+}
+
+int main() {
+    test_round_trip();
+    test_malformed();
+    return test_result();
+}
@@ -0,0 +1,136 @@
+// merge_charts() on charts read from files, as the CLI merge command does:
+// clean edits from either side are combined, and cells changed on both sides
+// keep our version and are reported.
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../include/chart_io.hpp"
+#include "../include/merge.hpp"
+#include "check.hpp"
+
+static std::filesystem::path fixture(const std::string &name,
+                                     const std::string &content) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() /
+                                 ("thapsteak_merge_test_" + name + ".json");
+    CHECK(write_file(path.string(), content));
+    return path;
+}
+
+static const Note *find(const Notechart &chart, long tick, Lane lane) {
+    for (const std::shared_ptr<Note> &note : chart.notes) {
+        if (note->tick == tick && note->lane == lane) return note.get();
+    }
+    return nullptr;
+}
+
+static void test_merge() {
+    std::vector<std::filesystem::path> paths{
+        fixture("base", R"({"events":[{"channel":"BPM","row":0,"value":150},)"
+                        R"({"channel":"H1","row":0,"side":"left"},)"
+                        R"({"channel":"H2","row":48},)"
+                        R"({"channel":"H3","row":96,"angle":90},)"
+                        R"({"channel":"N1","row":192,"side":"left"},)"
+                        R"({"channel":"E1","row":384}]})"),
+        // Moves H1 to the right, deletes H2, changes N1's side and adds
+        // notes at 10, 500 and 700
+        fixture("ours", R"({"events":[{"channel":"BPM","row":0,"value":150},)"
+                        R"({"channel":"H1","row":0,"side":"right"},)"
+                        R"({"channel":"H4","row":10},)"
+                        R"({"channel":"H3","row":96,"angle":90},)"
+                        R"({"channel":"N1","row":192,"side":"right"},)"
+                        R"({"channel":"E1","row":384},)"
+                        R"({"channel":"H5","row":500,"side":"left"},)"
+                        R"({"channel":"N4","row":700,"longNote":true}]})"),
+        // Changes the tempo, makes H2 a long note, turns H3, clears N1's
+        // side, deletes E1 and adds the same cells at 500 and 700
+        fixture("theirs",
+                R"({"events":[{"channel":"BPM","row":0,"value":180},)"
+                R"({"channel":"H1","row":0,"side":"left"},)"
+                R"({"channel":"H2","row":48,"longNote":true},)"
+                R"({"channel":"H3","row":96,"angle":45},)"
+                R"({"channel":"N1","row":192},)"
+                R"({"channel":"H5","row":500,"side":"right"},)"
+                R"({"channel":"N4","row":700,"longNote":true}]})"),
+    };
+
+    Notechart charts[3];
+    for (size_t i = 0; i < 3; i++) {
+        CHECK(import_chart(paths[i].string(), charts[i]));
+    }
+    Notechart merged;
+    std::vector<MergeConflict> conflicts =
+        merge_charts(charts[0], charts[1], charts[2], merged);
+
+    // Written and read back like the CLI output
+    std::filesystem::path output = fixture("merged", "");
+    CHECK(export_chart(output.string(), merged));
+    Notechart written;
+    CHECK(import_chart(output.string(), written));
+    CHECK_EQ(written.digest(), merged.digest());
+
+    CHECK_EQ(merged.notes.size(), (size_t)8);
+    const Note *note = find(merged, 0, LANE_BPM);
+    CHECK(note != nullptr && note->value == 180.0f);
+    note = find(merged, 0, LANE_H1);
+    CHECK(note != nullptr && note->side == SIDE_RIGHT);
+    CHECK(find(merged, 10, LANE_H4) != nullptr);
+    note = find(merged, 96, LANE_H3);
+    CHECK(note != nullptr && note->direction == DIR_URIGHT);
+    // Deleted by theirs and unchanged in ours
+    CHECK(find(merged, 384, LANE_E1) == nullptr);
+    note = find(merged, 700, LANE_N4);
+    CHECK(note != nullptr && note->is_longnote);
+
+    // Deleted in ours but modified in theirs: the edit is kept
+    note = find(merged, 48, LANE_H2);
+    CHECK(note != nullptr && note->is_longnote);
+    // The same field changed on both sides, or added differently on both:
+    // ours wins
+    note = find(merged, 192, LANE_N1);
+    CHECK(note != nullptr && note->side == SIDE_RIGHT);
+    note = find(merged, 500, LANE_H5);
+    CHECK(note != nullptr && note->side == SIDE_LEFT);
+
+    CHECK_EQ(conflicts.size(), (size_t)3);
+    if (conflicts.size() == 3) {
+        CHECK_EQ(conflicts[0].tick, 48L);
+        CHECK(conflicts[0].lane == LANE_H2);
+        CHECK_EQ(conflicts[0].reason,
+                 std::string("deleted in ours, modified in theirs"));
+        CHECK_EQ(conflicts[1].tick, 192L);
+        CHECK(conflicts[1].lane == LANE_N1);
+        CHECK_EQ(conflicts[1].reason, std::string("side changed on both sides"));
+        CHECK_EQ(conflicts[2].tick, 500L);
+        CHECK(conflicts[2].lane == LANE_H5);
+        CHECK_EQ(conflicts[2].reason, std::string("side changed on both sides"));
+    }
+
+    // With the sides swapped the conflicts are the same cells, now keeping
+    // theirs, and the delete is reported the other way around
+    Notechart swapped;
+    conflicts = merge_charts(charts[0], charts[2], charts[1], swapped);
+    CHECK_EQ(conflicts.size(), (size_t)3);
+    if (conflicts.size() == 3) {
+        CHECK_EQ(conflicts[0].reason,
+                 std::string("modified in ours, deleted in theirs"));
+    }
+    note = find(swapped, 192, LANE_N1);
+    CHECK(note != nullptr && note->side == SIDE_NONE);
+
+    // Nothing changed on either side merges to the base itself
+    Notechart unchanged;
+    CHECK(merge_charts(charts[0], charts[0], charts[0], unchanged).empty());
+    CHECK_EQ(unchanged.digest(), charts[0].digest());
+
+    paths.push_back(output);
+    for (const std::filesystem::path &path : paths) {
+        std::filesystem::remove(path);
+    }
+}
+
+int main() {
+    test_merge();
+    return test_result();
+}
@@ -0,0 +1,335 @@
+// Pixel tests for the software rasterizer. Rendering the same scenes with a
+// wxDC would need the editor build and a display, so every scene is instead
+// drawn by a deliberately naive reference renderer (per pixel, in double
+// precision, no tiles, no SIMD) and the two images must match exactly. On
+// a mismatch both are written out as PPM files for inspection.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../include/raster.hpp"
+#include "check.hpp"
+
+static constexpr int WIDTH = 67;
+static constexpr int HEIGHT = 45;
+static constexpr uint32_t BACKGROUND = 0xff102030;
+
+struct ReferenceImage {
+    int width, height;
+    std::vector<uint32_t> pixels;
+
+    ReferenceImage(int _width, int _height)
+        : width(_width),
+          height(_height),
+          pixels((size_t)_width * _height, BACKGROUND) {}
+
+    void blend(int x, int y, uint32_t colour, uint32_t alpha) {
+        if (x < 0 || y < 0 || x >= this->width || y >= this->height) return;
+        uint32_t &pixel = this->pixels[(size_t)y * this->width + x];
+        uint32_t result = 0xff000000;
+        for (int shift = 0; shift < 24; shift += 8) {
+            uint32_t src = (colour >> shift) & 0xff;
+            uint32_t dst = (pixel >> shift) & 0xff;
+            // Exact division by 255, rounded to nearest
+            uint32_t value = (src * alpha + dst * (255 - alpha) + 127) / 255;
+            result |= value << shift;
+        }
+        pixel = result;
+    }
+
+    void blend(int x, int y, uint32_t colour) {
+        this->blend(x, y, colour, colour >> 24);
+    }
+
+    void fill_rect(int x, int y, int width, int height, uint32_t colour) {
+        for (int row = y; row < y + height; row++) {
+            for (int column = x; column < x + width; column++) {
+                this->blend(column, row, colour);
+            }
+        }
+    }
+
+    // A pixel belongs to a convex polygon when its center is inside. Line
+    // caps pass through the centers of their end pixels, so centers on the
+    // boundary follow the usual top-left rule: they belong to the quad on a
+    // left edge, or on a horizontal edge with the inside below it.
+    void fill_quad(const float *xs, const float *ys, uint32_t colour) {
+        // Orient the corners so the inside is where the cross product is
+        // positive
+        double area = 0;
+        for (int edge = 0; edge < 4; edge++) {
+            area += (double)xs[edge] * ys[(edge + 1) % 4] -
+                    (double)xs[(edge + 1) % 4] * ys[edge];
+        }
+        double orientation = area > 0 ? 1 : -1;
+
+        for (int row = 0; row < this->height; row++) {
+            for (int column = 0; column < this->width; column++) {
+                double px = column + 0.5, py = row + 0.5;
+                bool is_inside = true;
+                for (int edge = 0; edge < 4 && is_inside; edge++) {
+                    double ax = xs[edge], ay = ys[edge];
+                    double bx = xs[(edge + 1) % 4], by = ys[(edge + 1) % 4];
+                    double dx = (bx - ax) * orientation;
+                    double dy = (by - ay) * orientation;
+                    double cross = dx * (py - ay) - dy * (px - ax);
+                    if (std::abs(cross) < 1e-4 * std::hypot(dx, dy)) {
+                        is_inside = dy < 0 || (dy == 0 && dx > 0);
+                    } else {
+                        is_inside = cross > 0;
+                    }
+                }
+                if (is_inside) {
+                    this->blend(column, row, colour);
+                }
+            }
+        }
+    }
+
+    // Coverage scales the tint's own alpha
+    void draw_mask(int x, int y, const RasterMask &mask) {
+        for (int row = 0; row < mask.height; row++) {
+            for (int column = 0; column < mask.width; column++) {
+                uint32_t coverage = mask.alpha[(size_t)row * mask.width + column];
+                uint32_t alpha = coverage * (mask.colour >> 24) / 255;
+                if (alpha != 0) {
+                    this->blend(x + column, y + row, mask.colour, alpha);
+                }
+            }
+        }
+    }
+
+    // Nearest neighbour: destination pixel i samples source pixel
+    // floor(i * source size / destination size)
+    void draw_image(int x, int y, int width, int height,
+                    const RasterImage &image) {
+        for (int row = 0; row < height; row++) {
+            for (int column = 0; column < width; column++) {
+                int source_row = row * image.height / height;
+                int source_column = column * image.width / width;
+                this->blend(x + column, y + row,
+                            image.pixels[(size_t)source_row * image.width +
+                                         source_column],
+                            255);
+            }
+        }
+    }
+
+    void draw(const DisplayList &list) {
+        for (const RasterCommand &command : list.commands) {
+            if (command.kind == RasterCommand::FILL_RECT) {
+                this->fill_rect(command.x, command.y, command.width,
+                                command.height, command.colour);
+            } else if (command.kind == RasterCommand::FILL_QUAD) {
+                this->fill_quad(command.xs, command.ys, command.colour);
+            } else if (command.kind == RasterCommand::MASK) {
+                this->draw_mask(command.x, command.y, *command.mask);
+            } else {
+                this->draw_image(command.x, command.y, command.width,
+                                 command.height, *command.image);
+            }
+        }
+    }
+};
+
+static void write_ppm(const std::string &path, int width, int height,
+                      const std::vector<uint32_t> &pixels) {
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file) return;
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (uint32_t pixel : pixels) {
+        uint8_t rgb[3] = {(uint8_t)(pixel >> 16), (uint8_t)(pixel >> 8),
+                          (uint8_t)pixel};
+        std::fwrite(rgb, 1, 3, file);
+    }
+    std::fclose(file);
+}
+
+// Render `list` with the given tile height and compare with the reference
+static void check_scene(const std::string &name, const DisplayList &list,
+                        ThreadPool &pool, int tile_height) {
+    ReferenceImage reference(WIDTH, HEIGHT);
+    reference.draw(list);
+
+    Framebuffer framebuffer;
+    framebuffer.resize(WIDTH, HEIGHT);
+    std::fill(framebuffer.pixels.begin(), framebuffer.pixels.end(), BACKGROUND);
+    TiledRasterizer rasterizer(pool, tile_height);
+    rasterizer.render(list, framebuffer);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < framebuffer.pixels.size(); i++) {
+        if (framebuffer.pixels[i] == reference.pixels[i]) continue;
+        if (mismatches++ == 0) {
+            fmt::print(stderr,
+                       "{} (tiles of {}): pixel ({}, {}) is {:08x}, expected "
+                       "{:08x}\n",
+                       name, tile_height, i % WIDTH, i / WIDTH,
+                       framebuffer.pixels[i], reference.pixels[i]);
+        }
+    }
+    CHECK_EQ(mismatches, (size_t)0);
+
+    if (mismatches > 0) {
+        std::string base = fmt::format("{}_{}", name, tile_height);
+        write_ppm(base + "_actual.ppm", WIDTH, HEIGHT, framebuffer.pixels);
+        write_ppm(base + "_expected.ppm", WIDTH, HEIGHT, reference.pixels);
+    }
+
+    // to_rgb keeps the channels in order
+    std::vector<uint8_t> rgb((size_t)WIDTH * HEIGHT * 3);
+    rasterizer.to_rgb(framebuffer, rgb.data());
+    size_t last = framebuffer.pixels.size() - 1;
+    CHECK_EQ((uint32_t)rgb[last * 3] << 16 | (uint32_t)rgb[last * 3 + 1] << 8 |
+                 rgb[last * 3 + 2],
+             framebuffer.pixels[last] & 0xffffff);
+}
+
+// Opaque rectangles, overlapping and clipped on every side
+static DisplayList rect_scene() {
+    DisplayList list;
+    list.fill_rect(3, 2, 20, 10, 0xffff0000);
+    list.fill_rect(15, 8, 9, 30, 0xff00ff00);
+    list.fill_rect(-5, 30, 12, 40, 0xff0000ff);
+    list.fill_rect(60, -3, 20, 7, 0xffffff00);
+    list.fill_rect(30, 20, 1, 1, 0xffffffff);
+    list.fill_rect(40, 10, 0, 10, 0xffffffff);
+    list.fill_rect(40, 10, 10, -1, 0xffffffff);
+    list.fill_rect(0, 0, 10, 10, 0x00ffffff);
+    // Axis-aligned lines become rectangles
+    list.line(2, 40, 50, 40, 1, 0xffff00ff);
+    list.line(55, 5, 55, 44, 3, 0xff00ffff);
+    return list;
+}
+
+// Slanted lines, at several slopes and thicknesses, some leaving the frame
+static DisplayList quad_scene() {
+    DisplayList list;
+    list.line(2, 3, 37, 20, 1, 0xffff0000);
+    list.line(5, 40, 60, 6, 3, 0xff00ff00);
+    list.line(10, 1, 14, 43, 2, 0xff0000ff);
+    list.line(-10, 20, 80, 30, 6, 0xffffff00);
+    list.line(50, -8, 30, 60, 4, 0xff00ffff);
+    list.line(62, 2, 64, 3, 1, 0xffffffff);
+    return list;
+}
+
+// Translucent fills of odd widths, so both the four-pixel path and the
+// per-pixel tail of the blend are exercised, stacked on each other
+static DisplayList alpha_scene() {
+    DisplayList list;
+    const uint32_t alphas[] = {1, 64, 127, 128, 200, 254};
+    int y = 0;
+    for (uint32_t alpha : alphas) {
+        list.fill_rect(1, y, 4, 3, alpha << 24 | 0xff8000);
+        list.fill_rect(6, y, 7, 3, alpha << 24 | 0x00ff80);
+        list.fill_rect(14, y, 13, 3, alpha << 24 | 0x8000ff);
+        list.fill_rect(28, y, 38, 3, alpha << 24 | 0xfedcba);
+        y += 4;
+    }
+    list.fill_rect(0, 0, WIDTH, HEIGHT, 0x80ffffff);
+    list.fill_rect(10, 5, 40, 30, 0x40000000);
+    list.line(3, 44, 66, 25, 5, 0x99ff0000);
+    list.line(0, 12, 66, 33, 2, 0x3300ff00);
+    return list;
+}
+
+// Everything above at once, mostly straddling tile boundaries
+static DisplayList seam_scene() {
+    DisplayList list;
+    for (int y = 0; y < HEIGHT; y += 5) {
+        list.fill_rect(y, y - 2, 11, 5, 0xff000000 | (uint32_t)y * 0x050301);
+        list.fill_rect(WIDTH - y - 9, y + 1, 9, 6, 0x7f00ff00);
+    }
+    list.line(0, 0, WIDTH - 1, HEIGHT - 1, 3, 0xffffffff);
+    list.line(WIDTH - 1, 0, 0, HEIGHT - 1, 1, 0xc0ff0000);
+    list.line(20, 0, 24, HEIGHT - 1, 7, 0x600000ff);
+    list.fill_rect(0, 31, WIDTH, 2, 0xff808080);
+    list.fill_rect(0, 6, WIDTH, 2, 0x80808080);
+    return list;
+}
+
+// Gradient coverage that includes fully clear and fully covered pixels
+static std::shared_ptr<const RasterMask> make_mask(int width, int height,
+                                                   uint32_t colour) {
+    auto mask = std::make_shared<RasterMask>();
+    mask->width = width;
+    mask->height = height;
+    mask->colour = colour;
+    for (int i = 0; i < width * height; i++) {
+        mask->alpha.push_back(i % 7 == 0 ? 255 : (uint8_t)(i * 37));
+    }
+    return mask;
+}
+
+// Labels inside the frame and past each of its edges
+static DisplayList mask_scene() {
+    DisplayList list;
+    list.fill_rect(0, 0, WIDTH, HEIGHT, 0xff404040);
+    list.mask(3, 4, make_mask(20, 9, 0xffffffff));
+    list.mask(30, 2, make_mask(11, 13, 0x80ff8000));
+    list.mask(-6, 20, make_mask(15, 8, 0xff00ff00));
+    list.mask(20, -5, make_mask(17, 10, 0xc00080ff));
+    list.mask(58, 30, make_mask(16, 11, 0xffff00ff));
+    list.mask(40, 38, make_mask(9, 12, 0xff00ffff));
+    list.mask(-3, -2, make_mask(6, 5, 0xffffff00));
+    // Overlapping a translucent label
+    list.mask(35, 6, make_mask(12, 10, 0x60ffffff));
+    return list;
+}
+
+static std::shared_ptr<const RasterImage> make_image(int width, int height) {
+    auto image = std::make_shared<RasterImage>();
+    image->width = width;
+    image->height = height;
+    for (int i = 0; i < width * height; i++) {
+        image->pixels.push_back((uint32_t)i * 0x0b1729 & 0xffffff);
+    }
+    return image;
+}
+
+// Pictures at their own size, stretched and shrunk, partly off the frame
+static DisplayList image_scene() {
+    DisplayList list;
+    list.image(2, 3, 5, 4, make_image(5, 4));
+    list.image(10, 2, 23, 11, make_image(5, 3));
+    list.image(40, 5, 7, 6, make_image(20, 17));
+    list.image(-4, 20, 12, 9, make_image(6, 6));
+    list.image(25, -6, 10, 14, make_image(3, 7));
+    list.image(60, 35, 15, 15, make_image(4, 4));
+    list.image(-5, -5, 8, 8, make_image(8, 8));
+    list.fill_rect(0, 18, WIDTH, 4, 0x80ffffff);
+    list.image(30, 16, 9, 9, make_image(2, 2));
+    return list;
+}
+
+int main() {
+    ThreadPool pool(4);
+
+    struct Scene {
+        const char *name;
+        DisplayList list;
+    };
+    const Scene scenes[] = {{"rects", rect_scene()},
+                            {"quads", quad_scene()},
+                            {"alpha", alpha_scene()},
+                            {"seams", seam_scene()},
+                            {"masks", mask_scene()},
+                            {"images", image_scene()}};
+
+    // One row per tile, tiles that do not divide the height, the editor's
+    // default, and a single tile for the whole frame
+    const int tile_heights[] = {1, 7, 32, HEIGHT};
+
+    for (const Scene &scene : scenes) {
+        for (int tile_height : tile_heights) {
+            check_scene(scene.name, scene.list, pool, tile_height);
+        }
+    }
+
+    return test_result();
+}
@@ -0,0 +1,192 @@
+// RoaringBitmap against std::set, with containers moving between the array
+// and bitset forms, plus the Notechart indexes built on top of it.
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../include/notechart.hpp"
+#include "../include/roaring.hpp"
+#include "check.hpp"
+
+using Model = std::set<uint32_t>;
+
+static bool same(const RoaringBitmap &bitmap, const Model &model) {
+    std::vector<uint32_t> values = bitmap.to_vector();
+    return bitmap.cardinality() == model.size() &&
+           bitmap.empty() == model.empty() &&
+           std::equal(values.begin(), values.end(), model.begin(),
+                      model.end());
+}
+
+// Add `count` distinct random values to the container of `key`
+static void fill(RoaringBitmap &bitmap, Model &model, uint32_t key,
+                 size_t count, std::mt19937 &random) {
+    size_t added = 0;
+    while (added < count) {
+        uint32_t value = key << 16 | (random() & 0xffff);
+        bitmap.add(value);
+        added += model.insert(value).second;
+    }
+}
+
+static void test_add_remove() {
+    RoaringBitmap bitmap;
+    Model model;
+
+    // Up to the array limit and one past it
+    for (uint32_t i = 0; i < 4097; i++) {
+        bitmap.add(i * 3);
+        model.insert(i * 3);
+        CHECK(bitmap.contains(i * 3));
+    }
+    CHECK(same(bitmap, model));
+    CHECK(!bitmap.contains(1));
+
+    // Duplicates change nothing, in either form
+    bitmap.add(0);
+    bitmap.add(4096 * 3);
+    CHECK(same(bitmap, model));
+
+    // Back under the limit, then down to empty
+    for (uint32_t i = 0; i < 4097; i++) {
+        CHECK(bitmap.remove(i * 3));
+        model.erase(i * 3);
+        CHECK(!bitmap.contains(i * 3));
+        CHECK(!bitmap.remove(i * 3));
+        if (i % 512 == 0 || i > 4090) {
+            CHECK(same(bitmap, model));
+        }
+    }
+    CHECK(bitmap.empty());
+    CHECK(!bitmap.remove(5));
+
+    // Values at the edges of their containers
+    for (uint32_t value : {0u, 0xffffu, 0x10000u, 0xffff0000u, 0xffffffffu}) {
+        bitmap.add(value);
+        model.insert(value);
+    }
+    CHECK(same(bitmap, model));
+    CHECK(bitmap.remove(0xffffffffu));
+    model.erase(0xffffffffu);
+    CHECK(same(bitmap, model));
+}
+
+static void test_set_operations() {
+    std::mt19937 random(7);
+
+    // Per container key, how many values each side holds: both sparse, both
+    // dense, mixed, dense sides whose intersection or difference falls back
+    // under the limit, and keys only one side has
+    struct Shape {
+        uint32_t key;
+        size_t a, b;
+    };
+    const Shape shapes[] = {{0, 100, 200},   {1, 9000, 12000}, {2, 9000, 50},
+                            {3, 50, 9000},   {4, 5000, 5000},  {5, 60000, 4500},
+                            {6, 4096, 4097}, {8, 300, 0},      {9, 0, 7000}};
+
+    RoaringBitmap a, b;
+    Model model_a, model_b;
+    for (const Shape &shape : shapes) {
+        fill(a, model_a, shape.key, shape.a, random);
+        fill(b, model_b, shape.key, shape.b, random);
+    }
+    CHECK(same(a, model_a));
+    CHECK(same(b, model_b));
+
+    Model expected;
+    std::set_intersection(model_a.begin(), model_a.end(), model_b.begin(),
+                          model_b.end(), std::inserter(expected, expected.end()));
+    CHECK(same(a & b, expected));
+    CHECK(same(b & a, expected));
+
+    expected.clear();
+    std::set_union(model_a.begin(), model_a.end(), model_b.begin(),
+                   model_b.end(), std::inserter(expected, expected.end()));
+    CHECK(same(a | b, expected));
+
+    expected.clear();
+    std::set_difference(model_a.begin(), model_a.end(), model_b.begin(),
+                        model_b.end(), std::inserter(expected, expected.end()));
+    CHECK(same(a - b, expected));
+
+    expected.clear();
+    std::set_difference(model_b.begin(), model_b.end(), model_a.begin(),
+                        model_a.end(), std::inserter(expected, expected.end()));
+    CHECK(same(b - a, expected));
+
+    CHECK((a - a).empty());
+    CHECK(same(a - RoaringBitmap(), model_a));
+    CHECK((RoaringBitmap() - a).empty());
+
+    // Results must keep working as operands: a dense difference that went
+    // back to an array keeps taking adds past the limit
+    RoaringBitmap rest = a;
+    rest -= b;
+    Model model_rest;
+    std::set_difference(model_a.begin(), model_a.end(), model_b.begin(),
+                        model_b.end(),
+                        std::inserter(model_rest, model_rest.end()));
+    for (uint32_t low = 0; low < 0x10000; low += 7) {
+        rest.add(4u << 16 | low);
+        model_rest.insert(4u << 16 | low);
+    }
+    for (uint32_t low = 0; low < 0x10000; low += 3) {
+        rest.remove(5u << 16 | low);
+        model_rest.erase(5u << 16 | low);
+    }
+    CHECK(same(rest, model_rest));
+
+    RoaringBitmap both = a;
+    both &= b;
+    both |= rest;
+    Model model_both;
+    std::set_intersection(model_a.begin(), model_a.end(), model_b.begin(),
+                          model_b.end(),
+                          std::inserter(model_both, model_both.end()));
+    model_both.insert(model_rest.begin(), model_rest.end());
+    CHECK(same(both, model_both));
+}
+
+static void test_chart_indexes() {
+    std::mt19937 random(11);
+    const Lane lanes[] = {LANE_H1, LANE_H2, LANE_N1, LANE_E3};
+
+    // Enough notes per lane for the indexes to hold bitset containers
+    Notechart chart;
+    std::vector<Note> notes;
+    for (long i = 0; i < 24000; i++) {
+        Note note(i * 4, lanes[i % 4], DIR_NONE, (Side)(random() % 3),
+                  random() % 3 == 0);
+        notes.push_back(note);
+    }
+    chart.add_notes(notes);
+
+    for (int is_longnote = -1; is_longnote <= 1; is_longnote++) {
+        NoteFilter filter;
+        filter.lanes = {LANE_H1, LANE_N1};
+        filter.sides = {SIDE_LEFT};
+        filter.is_longnote = is_longnote;
+
+        Model expected;
+        for (const std::shared_ptr<Note> &note : chart.notes) {
+            if ((note->lane == LANE_H1 || note->lane == LANE_N1) &&
+                note->side == SIDE_LEFT &&
+                (is_longnote < 0 || note->is_longnote == (is_longnote == 1))) {
+                expected.insert(note->id.index);
+            }
+        }
+        CHECK(!expected.empty());
+        CHECK(same(chart.match(filter), expected));
+    }
+}
+
+int main() {
+    test_add_remove();
+    test_set_operations();
+    test_chart_indexes();
+    return test_result();
+}
@@ -0,0 +1,105 @@
+// Generational handles: a handle must stop resolving once its value is
+// erased, even after the slot is handed out again.
+
+#include <set>
+
+#include "../include/notechart.hpp"
+#include "../include/slot_map.hpp"
+#include "check.hpp"
+
+static void test_slot_reuse() {
+    SlotMap<int> map;
+    SlotHandle a = map.insert(1);
+    SlotHandle b = map.insert(2);
+    CHECK_EQ(map.size(), (size_t)2);
+    CHECK_EQ(*map.get(a), 1);
+    CHECK_EQ(*map.get(b), 2);
+
+    CHECK(map.erase(a));
+    CHECK(map.get(a) == nullptr);
+    CHECK(!map.erase(a));
+    CHECK_EQ(map.size(), (size_t)1);
+
+    // The freed slot comes back under a new generation
+    SlotHandle c = map.insert(3);
+    CHECK_EQ(c.index, a.index);
+    CHECK(c.generation != a.generation);
+    CHECK(map.get(a) == nullptr);
+    CHECK(!map.erase(a));
+    CHECK_EQ(*map.get(c), 3);
+    CHECK_EQ(*map.at(a.index), 3);
+
+    // Erasing and reusing many times never revives an old handle
+    std::vector<SlotHandle> stale;
+    for (int i = 0; i < 100; i++) {
+        stale.push_back(c);
+        CHECK(map.erase(c));
+        c = map.insert(i);
+    }
+    for (SlotHandle handle : stale) {
+        CHECK(map.get(handle) == nullptr);
+    }
+    CHECK_EQ(*map.get(c), 99);
+
+    // Handles that were never issued
+    CHECK(map.get(SlotHandle{}) == nullptr);
+    CHECK(map.get(SlotHandle{b.index, b.generation + 1}) == nullptr);
+    CHECK(map.get(SlotHandle{1000, 0}) == nullptr);
+}
+
+static void test_clear() {
+    SlotMap<int> map;
+    SlotHandle a = map.insert(1);
+    SlotHandle b = map.insert(2);
+    map.clear();
+    CHECK_EQ(map.size(), (size_t)0);
+    CHECK(map.get(a) == nullptr);
+    CHECK(map.get(b) == nullptr);
+
+    // Lowest index first after a clear
+    SlotHandle c = map.insert(3);
+    SlotHandle d = map.insert(4);
+    CHECK_EQ(c.index, (uint32_t)0);
+    CHECK_EQ(d.index, (uint32_t)1);
+    CHECK(map.get(a) == nullptr);
+    CHECK(map.get(b) == nullptr);
+    CHECK_EQ(*map.get(c), 3);
+    CHECK_EQ(*map.get(d), 4);
+}
+
+static void test_chart_handles() {
+    Notechart chart;
+    chart.add_note(Note(0, LANE_H1, DIR_NONE, SIDE_NONE, false));
+    chart.add_note(Note(48, LANE_H2, DIR_NONE, SIDE_NONE, false));
+    NoteHandle first = chart.notes[0]->id;
+    NoteHandle second = chart.notes[1]->id;
+
+    chart.remove_notes({first});
+    CHECK(chart.find_note(first) == nullptr);
+
+    // The next note takes the freed slot; the old handle must not reach it
+    chart.add_note(Note(96, LANE_H3, DIR_NONE, SIDE_NONE, false));
+    NoteHandle third = chart.notes[1]->id;
+    CHECK_EQ(third.index, first.index);
+    CHECK(chart.find_note(first) == nullptr);
+    CHECK(chart.find_note(third) != nullptr);
+
+    // Stale handles in a selection are ignored
+    chart.remove_notes({first});
+    CHECK_EQ(chart.notes.size(), (size_t)2);
+    chart.shift_notes({first}, 192);
+    CHECK_EQ(chart.find_note(third)->tick, 96L);
+
+    // normalize() renumbers, so every handle taken before it goes stale
+    chart.normalize();
+    CHECK(chart.find_note(second) == nullptr);
+    CHECK(chart.find_note(third) == nullptr);
+    CHECK(chart.find_note(chart.notes[0]->id) == chart.notes[0]);
+}
+
+int main() {
+    test_slot_reuse();
+    test_clear();
+    test_chart_handles();
+    return test_result();
+}
@@ -0,0 +1,94 @@
+// ThreadPool::parallel_for waits for its own chunks only, and may be called
+// from inside a pool task.
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "../include/thread_pool.hpp"
+#include "check.hpp"
+
+static void test_coverage() {
+    ThreadPool pool(4);
+    for (size_t grain : {1, 3, 64, 1000}) {
+        std::vector<std::atomic<int>> hits(1000);
+        pool.parallel_for(0, hits.size(), grain,
+                          [&](size_t i) { hits[i]++; });
+        int wrong = 0;
+        for (std::atomic<int> &hit : hits) {
+            wrong += hit.load() != 1;
+        }
+        CHECK_EQ(wrong, 0);
+    }
+
+    // Empty and offset ranges
+    std::atomic<size_t> sum{0};
+    pool.parallel_for(5, 5, 1, [&](size_t i) { sum += i; });
+    CHECK_EQ(sum.load(), (size_t)0);
+    pool.parallel_for(10, 20, 4, [&](size_t i) { sum += i; });
+    CHECK_EQ(sum.load(), (size_t)145);
+}
+
+// A task left running by someone else must not hold up a parallel_for
+static void test_unrelated_work() {
+    ThreadPool pool(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> is_blocker_done{false};
+    pool.submit([released, &is_blocker_done] {
+        released.wait();
+        is_blocker_done = true;
+    });
+
+    std::atomic<int> count{0};
+    pool.parallel_for(0, 100, 1, [&](size_t) { count++; });
+    CHECK_EQ(count.load(), 100);
+    CHECK(!is_blocker_done);
+
+    release.set_value();
+    pool.wait();
+    CHECK(is_blocker_done);
+}
+
+// Nested calls from every worker at once would deadlock if the workers
+// blocked instead of helping
+static void test_nested() {
+    ThreadPool pool(2);
+    std::atomic<int> count{0};
+    pool.parallel_for(0, 8, 1, [&](size_t) {
+        pool.parallel_for(0, 50, 1, [&](size_t) { count++; });
+    });
+    CHECK_EQ(count.load(), 8 * 50);
+}
+
+// Several threads sharing the pool each get their own results back
+static void test_concurrent_callers() {
+    ThreadPool pool(3);
+    std::vector<std::thread> callers;
+    std::vector<int> results(4, 0);
+    for (size_t caller = 0; caller < results.size(); caller++) {
+        callers.emplace_back([&pool, &results, caller] {
+            for (int round = 0; round < 50; round++) {
+                std::atomic<int> count{0};
+                pool.parallel_for(0, 37, 2, [&](size_t) { count++; });
+                results[caller] += count.load() == 37;
+            }
+        });
+    }
+    for (std::thread &caller : callers) {
+        caller.join();
+    }
+    for (int result : results) {
+        CHECK_EQ(result, 50);
+    }
+}
+
+int main() {
+    test_coverage();
+    test_unrelated_work();
+    test_nested();
+    test_concurrent_callers();
+    return test_result();
+}
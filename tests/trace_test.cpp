@@ -0,0 +1,74 @@
+// Tracer: events from finished threads survive until the dump, and threads
+// that come and go reuse buffers instead of adding new ones.
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/chart_io.hpp"
+#include "../include/thread_pool.hpp"
+#include "../include/trace.hpp"
+#include "check.hpp"
+
+static size_t count(const std::string &text, const std::string &word) {
+    size_t found = 0;
+    for (size_t at = text.find(word); at != std::string::npos;
+         at = text.find(word, at + word.size())) {
+        found++;
+    }
+    return found;
+}
+
+// Thread IDs that appear in a dump
+static std::set<int> tids(const std::string &text) {
+    std::set<int> ids;
+    const std::string key = "\"tid\":";
+    for (size_t at = text.find(key); at != std::string::npos;
+         at = text.find(key, at + key.size())) {
+        ids.insert(std::stoi(text.substr(at + key.size())));
+    }
+    return ids;
+}
+
+int main() {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "thapsteak_trace_test.json";
+
+    Tracer::start();
+    { TRACE_SCOPE("main"); }
+
+    // One thread at a time, as a fresh pool per analysis job would do
+    for (int i = 0; i < 50; i++) {
+        std::thread([] { TRACE_SCOPE("sequential"); }).join();
+    }
+    for (int i = 0; i < 20; i++) {
+        ThreadPool pool(3);
+        pool.parallel_for(0, 30, 1, [](size_t) { TRACE_SCOPE("pooled"); });
+    }
+    Tracer::stop();
+
+    CHECK(Tracer::dump(path.string()));
+    std::string text;
+    CHECK(read_file(path.string(), text));
+    CHECK_EQ(count(text, "\"main\""), (size_t)1);
+    CHECK_EQ(count(text, "\"sequential\""), (size_t)50);
+    CHECK_EQ(count(text, "\"pooled\""), (size_t)600);
+    // The main thread plus at most one buffer per pool worker alive at once
+    CHECK(tids(text).size() <= 4);
+
+    // A new session starts empty
+    Tracer::start();
+    std::thread([] { TRACE_SCOPE("second"); }).join();
+    Tracer::stop();
+    CHECK(Tracer::dump(path.string()));
+    CHECK(read_file(path.string(), text));
+    CHECK_EQ(count(text, "\"sequential\""), (size_t)0);
+    CHECK_EQ(count(text, "\"second\""), (size_t)1);
+
+    std::filesystem::remove(path);
+    CHECK(!Tracer::dump((path / "missing" / "trace.json").string()));
+
+    return test_result();
+}
@@ -0,0 +1,248 @@
+// Bulk transforms: each one moves exactly the selected notes, refuses moves
+// onto occupied cells or before tick 0 without touching the chart, and
+// leaves the indexes and the digest as a rebuild from scratch would.
+
+#include <cmath>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../include/notechart.hpp"
+#include "check.hpp"
+
+static Note tap(long tick, Lane lane, Direction direction = DIR_NONE,
+                Side side = SIDE_NONE, bool is_longnote = false) {
+    return Note(tick, lane, direction, side, is_longnote);
+}
+
+static std::set<uint32_t> slots(const RoaringBitmap &bitmap) {
+    std::vector<uint32_t> values = bitmap.to_vector();
+    return std::set<uint32_t>(values.begin(), values.end());
+}
+
+// The chart against a fresh chart built from its notes, and its indexes
+// against a scan of the notes
+static bool is_consistent(Notechart &chart) {
+    bool is_ok = true;
+
+    Notechart rebuilt;
+    std::vector<Note> copies;
+    for (const std::shared_ptr<Note> &note : chart.notes) {
+        copies.push_back(*note);
+    }
+    rebuilt.add_notes(copies);
+    is_ok &= rebuilt.notes.size() == chart.notes.size();
+    is_ok &= rebuilt.digest() == chart.digest();
+    is_ok &= chart.content_digest().diff(rebuilt.content_digest()).empty();
+
+    for (size_t i = 1; i < chart.notes.size(); i++) {
+        const Note &a = *chart.notes[i - 1], &b = *chart.notes[i];
+        is_ok &= a.tick < b.tick || (a.tick == b.tick && a.lane < b.lane);
+    }
+
+    auto expected = [&chart](auto &&predicate) {
+        std::set<uint32_t> matching;
+        for (const std::shared_ptr<Note> &note : chart.notes) {
+            if (predicate(*note)) matching.insert(note->id.index);
+        }
+        return matching;
+    };
+    for (Lane lane : {LANE_H1, LANE_H3, LANE_H5, LANE_N1, LANE_N4, LANE_E2}) {
+        NoteFilter filter;
+        filter.lanes = {lane};
+        is_ok &= slots(chart.match(filter)) ==
+                 expected([lane](const Note &note) { return note.lane == lane; });
+    }
+    for (Side side : {SIDE_NONE, SIDE_LEFT, SIDE_RIGHT}) {
+        NoteFilter filter;
+        filter.sides = {side};
+        is_ok &= slots(chart.match(filter)) ==
+                 expected([side](const Note &note) { return note.side == side; });
+    }
+    for (Direction direction :
+         {DIR_NONE, DIR_RIGHT, DIR_URIGHT, DIR_UP, DIR_ULEFT, DIR_LEFT}) {
+        NoteFilter filter;
+        filter.directions = {direction};
+        is_ok &= slots(chart.match(filter)) ==
+                 expected([direction](const Note &note) {
+                     return note.direction == direction;
+                 });
+    }
+    NoteFilter longnotes;
+    longnotes.is_longnote = 1;
+    is_ok &= slots(chart.match(longnotes)) ==
+             expected([](const Note &note) { return note.is_longnote; });
+    return is_ok;
+}
+
+static Notechart make_chart() {
+    Notechart chart;
+    chart.add_notes({tap(0, LANE_H1, DIR_RIGHT, SIDE_LEFT),
+                     tap(48, LANE_H2, DIR_NONE, SIDE_RIGHT, true),
+                     tap(96, LANE_H5, DIR_URIGHT, SIDE_LEFT),
+                     tap(100, LANE_N1, DIR_UP, SIDE_NONE),
+                     tap(200, LANE_N3, DIR_NONE, SIDE_RIGHT, true),
+                     tap(400, LANE_E1, DIR_LEFT, SIDE_LEFT),
+                     tap(450, LANE_H3, DIR_ULEFT, SIDE_RIGHT)});
+    return chart;
+}
+
+static NoteHandle at(Notechart &chart, long tick, Lane lane) {
+    for (const std::shared_ptr<Note> &note : chart.notes) {
+        if (note->tick == tick && note->lane == lane) return note->id;
+    }
+    return NoteHandle{};
+}
+
+// Runs a transform that must be refused and checks nothing changed
+template <typename Transform>
+static void check_refused(Notechart &chart, Transform transform) {
+    std::string before = chart.to_string();
+    long version = chart.version();
+    uint64_t digest = chart.digest();
+    CHECK(!transform());
+    CHECK_EQ(chart.to_string(), before);
+    CHECK_EQ(chart.version(), version);
+    CHECK_EQ(chart.digest(), digest);
+    CHECK(is_consistent(chart));
+}
+
+static void test_shift() {
+    Notechart chart = make_chart();
+    CHECK(is_consistent(chart));
+
+    NoteHandle h1 = at(chart, 0, LANE_H1), h2 = at(chart, 48, LANE_H2);
+    CHECK(chart.shift_notes({h1, h2}, 100));
+    CHECK_EQ(chart.find_note(h1)->tick, 100L);
+    CHECK_EQ(chart.find_note(h2)->tick, 148L);
+    CHECK(is_consistent(chart));
+
+    // Onto an H3 note that is not selected
+    NoteHandle h3 = at(chart, 450, LANE_H3);
+    CHECK(chart.shift_notes({h3}, -300));
+    CHECK(is_consistent(chart));
+    chart.add_note(tap(250, LANE_H3));
+    check_refused(chart, [&] { return chart.shift_notes({h3}, 100); });
+    // Before tick 0
+    NoteHandle h5 = at(chart, 96, LANE_H5);
+    check_refused(chart, [&] { return chart.shift_notes({h5}, -97); });
+    CHECK(chart.shift_notes({h5}, -96));
+    CHECK(is_consistent(chart));
+
+    // Selected notes may pass over each other's cells
+    chart.add_note(tap(124, LANE_H1));
+    NoteHandle later = at(chart, 124, LANE_H1);
+    CHECK(chart.shift_notes({h1, later}, 24));
+    CHECK_EQ(chart.find_note(h1)->tick, 124L);
+    CHECK_EQ(chart.find_note(later)->tick, 148L);
+    CHECK(is_consistent(chart));
+}
+
+static void test_mirror() {
+    Notechart chart = make_chart();
+    NoteHandle h1 = at(chart, 0, LANE_H1), n1 = at(chart, 100, LANE_N1);
+    NoteHandle e1 = at(chart, 400, LANE_E1);
+    CHECK(chart.mirror_notes({h1, n1, e1}));
+    CHECK(chart.find_note(h1)->lane == LANE_H5);
+    CHECK(chart.find_note(h1)->direction == DIR_LEFT);
+    CHECK(chart.find_note(n1)->lane == LANE_N4);
+    CHECK(chart.find_note(n1)->direction == DIR_UP);
+    CHECK(chart.find_note(e1)->lane == LANE_E3);
+    CHECK(chart.find_note(e1)->direction == DIR_RIGHT);
+    CHECK(is_consistent(chart));
+
+    // The middle lane stays put
+    NoteHandle h3 = at(chart, 450, LANE_H3);
+    CHECK(chart.mirror_notes({h3}));
+    CHECK(chart.find_note(h3)->lane == LANE_H3);
+    CHECK(chart.find_note(h3)->direction == DIR_URIGHT);
+    CHECK(is_consistent(chart));
+
+    // H2 at 48 would land on an unselected H4
+    chart.add_note(tap(48, LANE_H4));
+    NoteHandle h2 = at(chart, 48, LANE_H2);
+    check_refused(chart, [&] { return chart.mirror_notes({h2}); });
+    // Unless both are mirrored together
+    NoteHandle h4 = at(chart, 48, LANE_H4);
+    CHECK(chart.mirror_notes({h2, h4}));
+    CHECK(chart.find_note(h2)->lane == LANE_H4);
+    CHECK(chart.find_note(h4)->lane == LANE_H2);
+    CHECK(is_consistent(chart));
+}
+
+static void test_swap_sides() {
+    Notechart chart = make_chart();
+    std::set<NoteHandle> all;
+    for (const std::shared_ptr<Note> &note : chart.notes) {
+        all.insert(note->id);
+    }
+    NoteHandle left = at(chart, 0, LANE_H1), right = at(chart, 48, LANE_H2);
+    NoteHandle none = at(chart, 100, LANE_N1);
+    chart.swap_sides(all);
+    CHECK(chart.find_note(left)->side == SIDE_RIGHT);
+    CHECK(chart.find_note(right)->side == SIDE_LEFT);
+    CHECK(chart.find_note(none)->side == SIDE_NONE);
+    CHECK(is_consistent(chart));
+}
+
+static void test_quantize() {
+    Notechart chart;
+    chart.add_notes({tap(5, LANE_H1), tap(20, LANE_H1), tap(30, LANE_H2),
+                     tap(48, LANE_H3), tap(70, LANE_H3)});
+    NoteHandle a = at(chart, 5, LANE_H1), b = at(chart, 20, LANE_H1);
+    NoteHandle c = at(chart, 30, LANE_H2), e = at(chart, 70, LANE_H3);
+
+    CHECK(chart.quantize_notes({a, b, c}, 24));
+    CHECK_EQ(chart.find_note(a)->tick, 0L);
+    CHECK_EQ(chart.find_note(b)->tick, 24L);
+    CHECK_EQ(chart.find_note(c)->tick, 24L);
+    CHECK(is_consistent(chart));
+
+    // Two selected notes rounding to one cell
+    check_refused(chart, [&] { return chart.quantize_notes({a, b}, 96); });
+    // Onto the unselected H3 at 48
+    check_refused(chart, [&] { return chart.quantize_notes({e}, 48); });
+    // Not a cell size
+    check_refused(chart, [&] { return chart.quantize_notes({e}, 0); });
+    check_refused(chart, [&] { return chart.quantize_notes({e}, -12); });
+    CHECK(chart.quantize_notes({e}, 12));
+    CHECK_EQ(chart.find_note(e)->tick, 72L);
+    CHECK(is_consistent(chart));
+}
+
+static void test_scale() {
+    Notechart chart;
+    chart.add_notes({tap(100, LANE_H1), tap(112, LANE_H1), tap(124, LANE_H2),
+                     tap(148, LANE_H1), tap(300, LANE_H1)});
+    NoteHandle a = at(chart, 100, LANE_H1), b = at(chart, 112, LANE_H1);
+    NoteHandle c = at(chart, 124, LANE_H2), d = at(chart, 148, LANE_H1);
+
+    // Around the earliest selected note
+    CHECK(chart.scale_notes({a, b, c}, 2.0));
+    CHECK_EQ(chart.find_note(a)->tick, 100L);
+    CHECK_EQ(chart.find_note(b)->tick, 124L);
+    CHECK_EQ(chart.find_note(c)->tick, 148L);
+    CHECK(is_consistent(chart));
+
+    // b would land on the unselected H1 at 148
+    check_refused(chart, [&] { return chart.scale_notes({a, b}, 2.0); });
+    // a and b merging into one cell
+    check_refused(chart, [&] { return chart.scale_notes({a, b}, 0.01); });
+    // Not a scale factor
+    for (double factor : {0.0, -1.0, (double)NAN, (double)INFINITY}) {
+        check_refused(chart, [&] { return chart.scale_notes({a, d}, factor); });
+    }
+    CHECK(chart.scale_notes({a, b, d}, 0.5));
+    CHECK_EQ(chart.find_note(b)->tick, 112L);
+    CHECK_EQ(chart.find_note(d)->tick, 124L);
+    CHECK(is_consistent(chart));
+}
+
+int main() {
+    test_shift();
+    test_mirror();
+    test_swap_sides();
+    test_quantize();
+    test_scale();
+    return test_result();
+}